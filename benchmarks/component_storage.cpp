@@ -0,0 +1,251 @@
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include "recs/component_storage.hpp"
+#include "recs/thread_pool.hpp"
+#include <memory>
+#include <random>
+
+namespace
+{
+
+template <uint32_t N> struct Component
+{
+    float value[4]{};
+};
+
+// Storages that are filled inside the measurement and torn down outside it
+using Storages = std::vector<std::unique_ptr<recs::ComponentStorage>>;
+
+Storages makeStorages(int runs)
+{
+    Storages storages;
+    storages.reserve(runs);
+    for (int i = 0; i < runs; ++i)
+        storages.push_back(std::make_unique<recs::ComponentStorage>());
+    return storages;
+}
+
+std::vector<recs::EntityId> addEntities(
+    recs::ComponentStorage &cs, uint32_t entity_count)
+{
+    std::vector<recs::EntityId> entities;
+    entities.reserve(entity_count);
+    for (uint32_t i = 0; i < entity_count; ++i)
+        entities.push_back(cs.addEntity());
+    return entities;
+}
+
+template <uint32_t... Ns>
+void addComponents(
+    recs::ComponentStorage &cs, std::vector<recs::EntityId> const &entities)
+{
+    for (recs::EntityId const e : entities)
+        (cs.addComponent(e, Component<Ns>{}), ...);
+}
+
+template <uint32_t... Ns> recs::ComponentMask mask()
+{
+    recs::ComponentMask mask;
+    (void(mask.set(recs::TypeId::get<Component<Ns>>())), ...);
+    return mask;
+}
+
+std::string name(char const *operation, uint32_t entity_count)
+{
+    return std::string{operation} + " " + std::to_string(entity_count);
+}
+
+template <uint32_t... Ns>
+void benchmarkAddComponents(uint32_t entity_count, char const *operation)
+{
+    BENCHMARK_ADVANCED(name(operation, entity_count).c_str())
+    (Catch::Benchmark::Chronometer meter)
+    {
+        Storages storages = makeStorages(meter.runs());
+        std::vector<std::vector<recs::EntityId>> entities;
+        for (std::unique_ptr<recs::ComponentStorage> const &cs : storages)
+            entities.push_back(addEntities(*cs, entity_count));
+
+        meter.measure([&](int i)
+                      { addComponents<Ns...>(*storages[i], entities[i]); });
+    };
+}
+
+void benchmarkOperations(uint32_t entity_count)
+{
+    BENCHMARK_ADVANCED(name("addEntity", entity_count).c_str())
+    (Catch::Benchmark::Chronometer meter)
+    {
+        Storages storages = makeStorages(meter.runs());
+        meter.measure([&](int i)
+                      { return addEntities(*storages[i], entity_count); });
+    };
+
+    benchmarkAddComponents<0>(entity_count, "addComponent x1");
+    benchmarkAddComponents<0, 1, 2, 3>(entity_count, "addComponent x4");
+    benchmarkAddComponents<0, 1, 2, 3, 4, 5, 6, 7>(
+        entity_count, "addComponent x8");
+
+    BENCHMARK_ADVANCED(name("removeEntity", entity_count).c_str())
+    (Catch::Benchmark::Chronometer meter)
+    {
+        Storages storages = makeStorages(meter.runs());
+        std::vector<std::vector<recs::EntityId>> entities;
+        for (std::unique_ptr<recs::ComponentStorage> const &cs : storages)
+        {
+            entities.push_back(addEntities(*cs, entity_count));
+            addComponents<0, 1, 2, 3>(*cs, entities.back());
+        }
+
+        meter.measure(
+            [&](int i)
+            {
+                for (recs::EntityId const e : entities[i])
+                    storages[i]->removeEntity(e);
+            });
+    };
+
+    // Every entity has components 0-3 and every other also has 4
+    recs::ComponentStorage cs;
+    std::vector<recs::EntityId> const entities = addEntities(cs, entity_count);
+    addComponents<0, 1, 2, 3>(cs, entities);
+    for (size_t i = 0; i < entities.size(); i += 2)
+        cs.addComponent(entities[i], Component<4>{});
+
+    BENCHMARK(name("getEntities x1", entity_count).c_str())
+    {
+        return cs.getEntities(mask<0>());
+    };
+    BENCHMARK(name("getEntities x4", entity_count).c_str())
+    {
+        return cs.getEntities(mask<0, 1, 2, 3>());
+    };
+    BENCHMARK(name("getEntities half x2", entity_count).c_str())
+    {
+        return cs.getEntities(mask<0, 4>());
+    };
+    BENCHMARK(name("getEntities none", entity_count).c_str())
+    {
+        return cs.getEntities(mask<5>());
+    };
+
+    recs::ThreadPool pool;
+    BENCHMARK(name("getEntities x4 parallel", entity_count).c_str())
+    {
+        return cs.getEntities(mask<0, 1, 2, 3>(), pool);
+    };
+    BENCHMARK(name("getEntities all parallel", entity_count).c_str())
+    {
+        return cs.getEntities(recs::ComponentMask{}, pool);
+    };
+
+    BENCHMARK(name("getComponent", entity_count).c_str())
+    {
+        for (recs::EntityId const e : entities)
+            cs.getComponent<Component<0>>(e).value[0] += 1.f;
+    };
+    BENCHMARK(name("readComponent", entity_count).c_str())
+    {
+        float sum = 0.f;
+        for (recs::EntityId const e : entities)
+            sum += cs.readComponent<Component<1>>(e).value[0];
+        return sum;
+    };
+}
+
+// Adds entity_count entities in a random tree so that the parents are spread
+// over the entity indices
+std::vector<recs::EntityId> addHierarchy(
+    recs::ComponentStorage &cs, uint32_t entity_count)
+{
+    std::mt19937 rng{0};
+    std::vector<recs::EntityId> entities = addEntities(cs, entity_count);
+    addComponents<0, 1>(cs, entities);
+    for (uint32_t i = 1; i < entity_count; ++i)
+    {
+        std::uniform_int_distribution<uint32_t> parent{0, i - 1};
+        cs.setParent(entities[i], entities[parent(rng)]);
+    }
+    cs.updateHierarchy();
+    return entities;
+}
+
+// Component<0> is the local value and Component<1> the propagated world value
+void benchmarkHierarchy(uint32_t entity_count)
+{
+    recs::ComponentStorage cs;
+    std::vector<recs::EntityId> const entities =
+        addHierarchy(cs, entity_count);
+
+    BENCHMARK(name("propagate parent chase", entity_count).c_str())
+    {
+        for (recs::EntityId const e : entities)
+        {
+            float world = 0.f;
+            for (recs::EntityId parent = e; cs.isValid(parent);
+                 parent = cs.getParent(parent))
+                world += cs.readComponent<Component<0>>(parent).value[0];
+            cs.getComponent<Component<1>>(e).value[0] = world;
+        }
+    };
+    BENCHMARK(name("propagate levels", entity_count).c_str())
+    {
+        for (size_t depth = 0; depth < cs.hierarchyLevelCount(); ++depth)
+        {
+            recs::ComponentStorage::HierarchyLevel const level =
+                cs.getHierarchyLevel(depth);
+            for (size_t i = 0; i < level.entities.size(); ++i)
+            {
+                float world =
+                    cs.readComponent<Component<0>>(level.entities[i]).value[0];
+                if (depth > 0)
+                    world += cs.readComponent<Component<1>>(level.parents[i])
+                                 .value[0];
+                cs.getComponent<Component<1>>(level.entities[i]).value[0] =
+                    world;
+            }
+        }
+    };
+    // World values grouped by level so parents are read from the previous
+    // level instead of through their components
+    std::vector<float> worlds(cs.hierarchySize());
+    BENCHMARK(name("propagate level positions", entity_count).c_str())
+    {
+        for (size_t depth = 0; depth < cs.hierarchyLevelCount(); ++depth)
+        {
+            recs::ComponentStorage::HierarchyLevel const level =
+                cs.getHierarchyLevel(depth);
+            for (size_t i = 0; i < level.entities.size(); ++i)
+            {
+                float world =
+                    cs.readComponent<Component<0>>(level.entities[i]).value[0];
+                if (depth > 0)
+                    world += worlds[level.parent_positions[i]];
+                worlds[level.offset + i] = world;
+            }
+        }
+        return worlds.back();
+    };
+}
+
+} // namespace
+
+TEST_CASE("ComponentStorage hierarchy", "[component_storage]")
+{
+    // The parent chase walks all ancestors of each entity so it gets slow
+    for (uint32_t const entity_count : {10'000u, 100'000u})
+        benchmarkHierarchy(entity_count);
+}
+
+TEST_CASE("ComponentStorage operations", "[component_storage]")
+{
+    for (uint32_t const entity_count : {1'000u, 10'000u, 100'000u, 1'000'000u})
+        benchmarkOperations(entity_count);
+}
+
+// Hidden by default as the entity tables alone take over a gigabyte
+TEST_CASE("ComponentStorage operations 10M", "[component_storage][.10m]")
+{
+    benchmarkOperations(10'000'000);
+}
@@ -0,0 +1,93 @@
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include "recs/component_storage.hpp"
+#include "recs/type_registry.hpp"
+#include <random>
+
+namespace
+{
+
+struct Transform
+{
+    float trfn[12]{};
+};
+
+struct Velocity
+{
+    float v[3]{};
+};
+
+uint32_t const s_entity_count = 100'000;
+
+std::vector<recs::EntityId> populate(recs::ComponentStorage &cs)
+{
+    std::vector<recs::EntityId> entities;
+    entities.reserve(s_entity_count);
+    for (uint32_t i = 0; i < s_entity_count; ++i)
+    {
+        recs::EntityId const e = cs.addEntity();
+        cs.addComponent(e, Transform{});
+        cs.addComponent(e, Velocity{.v = {1.f, 0.f, 0.f}});
+        entities.push_back(e);
+    }
+    return entities;
+}
+
+void simulate(
+    recs::ComponentStorage &cs, std::vector<recs::EntityId> const &entities,
+    uint32_t changed_count, std::mt19937 &rng)
+{
+    std::uniform_int_distribution<size_t> dist{0, entities.size() - 1};
+    for (uint32_t i = 0; i < changed_count; ++i)
+    {
+        recs::EntityId const e = entities[dist(rng)];
+        cs.getComponent<Transform>(e).trfn[3] +=
+            cs.readComponent<Velocity>(e).v[0];
+    }
+}
+
+} // namespace
+
+TEST_CASE("Delta 100k entities", "[delta]")
+{
+    recs::TypeRegistry::registerType<Transform>("Transform");
+    recs::TypeRegistry::registerType<Velocity>("Velocity");
+
+    recs::ComponentStorage cs;
+    std::vector<recs::EntityId> const entities = populate(cs);
+    std::mt19937 rng{0};
+
+    recs::ComponentStorage replica;
+    std::vector<uint8_t> delta;
+    REQUIRE(cs.writeDelta(0, delta));
+    REQUIRE(replica.applyDelta(delta));
+
+    for (uint32_t const changed_count : {0u, 100u, 1'000u, 10'000u})
+    {
+        // Size of a single tick's delta for the name, the benchmark then
+        // streams ticks to the replica
+        uint32_t const since = cs.advanceChangeTick();
+        simulate(cs, entities, changed_count, rng);
+        delta.clear();
+        REQUIRE(cs.writeDelta(since, delta));
+        REQUIRE(replica.applyDelta(delta));
+
+        std::string const name = "Tick and stream " +
+                                 std::to_string(changed_count) +
+                                 " changes, " + std::to_string(delta.size()) +
+                                 " bytes per tick";
+        BENCHMARK_ADVANCED(name.c_str())(Catch::Benchmark::Chronometer meter)
+        {
+            meter.measure(
+                [&]
+                {
+                    uint32_t const tick = cs.advanceChangeTick();
+                    simulate(cs, entities, changed_count, rng);
+                    delta.clear();
+                    bool const written = cs.writeDelta(tick, delta);
+                    return written && replica.applyDelta(delta);
+                });
+        };
+    }
+}
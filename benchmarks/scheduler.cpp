@@ -0,0 +1,90 @@
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include "recs/scheduler.hpp"
+#include "recs/thread_pool.hpp"
+
+namespace
+{
+
+struct Position
+{
+    float v[3]{};
+};
+
+struct Velocity
+{
+    float v[3]{};
+};
+
+struct Health
+{
+    float value{100.f};
+};
+
+struct Damage
+{
+    float per_frame{0.f};
+};
+
+using MoveEntity =
+    recs::Access::Read<Velocity>::Write<Position>::As<recs::Entity>;
+void moveSystem(MoveEntity e)
+{
+    Velocity const &velocity = e.getComponent<Velocity>();
+    Position &position = e.getComponent<Position>();
+    for (uint32_t i = 0; i < 3; ++i)
+        position.v[i] += velocity.v[i];
+}
+
+using DamageEntity =
+    recs::Access::Read<Damage>::Write<Health>::As<recs::Entity>;
+void damageSystem(DamageEntity e)
+{
+    e.getComponent<Health>().value -= e.getComponent<Damage>().per_frame;
+}
+
+using DragEntity = recs::Access::Write<Velocity>::As<recs::Entity>;
+void dragSystem(DragEntity e)
+{
+    Velocity &velocity = e.getComponent<Velocity>();
+    for (uint32_t i = 0; i < 3; ++i)
+        velocity.v[i] *= .99f;
+}
+
+} // namespace
+
+TEST_CASE("Schedule::execute", "[scheduler]")
+{
+    for (uint32_t const entity_count : {1'000u, 10'000u, 100'000u, 1'000'000u})
+    {
+        recs::ComponentStorage cs;
+        for (uint32_t i = 0; i < entity_count; ++i)
+        {
+            recs::EntityId const e = cs.addEntity();
+            cs.addComponent(e, Position{});
+            cs.addComponent(e, Velocity{.v = {1.f, 0.f, 0.f}});
+            if (i % 2 == 0)
+            {
+                cs.addComponent(e, Health{});
+                cs.addComponent(e, Damage{.per_frame = 1.f});
+            }
+        }
+
+        // Damage is independent of the other two that conflict
+        recs::Scheduler scheduler;
+        scheduler.registerSystem(moveSystem);
+        scheduler.registerSystem(damageSystem);
+        scheduler.registerSystem(dragSystem);
+        recs::Schedule const schedule = scheduler.buildSchedule();
+
+        std::string const suffix = " " + std::to_string(entity_count);
+        BENCHMARK(("Serial" + suffix).c_str()) { schedule.execute(cs); };
+
+        recs::ThreadPool pool;
+        BENCHMARK(("Thread pool" + suffix).c_str())
+        {
+            schedule.execute(cs, pool);
+        };
+    }
+}
@@ -0,0 +1,121 @@
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include "recs/snapshot.hpp"
+#include <random>
+
+namespace
+{
+
+struct Transform
+{
+    float trfn[12]{};
+};
+
+struct Velocity
+{
+    float v[3]{};
+};
+
+uint32_t const s_entity_count = 100'000;
+
+std::vector<recs::EntityId> populate(recs::ComponentStorage &cs)
+{
+    std::vector<recs::EntityId> entities;
+    entities.reserve(s_entity_count);
+    for (uint32_t i = 0; i < s_entity_count; ++i)
+    {
+        recs::EntityId const e = cs.addEntity();
+        cs.addComponent(e, Transform{});
+        cs.addComponent(e, Velocity{.v = {1.f, 0.f, 0.f}});
+        entities.push_back(e);
+    }
+    return entities;
+}
+
+// Writes the transforms of a random subset of entities, like a tick of
+// simulation where only some of the world moves
+void simulate(
+    recs::ComponentStorage &cs, std::vector<recs::EntityId> const &entities,
+    uint32_t changed_count, std::mt19937 &rng)
+{
+    std::uniform_int_distribution<size_t> dist{0, entities.size() - 1};
+    for (uint32_t i = 0; i < changed_count; ++i)
+    {
+        recs::EntityId const e = entities[dist(rng)];
+        cs.getComponent<Transform>(e).trfn[3] +=
+            cs.readComponent<Velocity>(e).v[0];
+    }
+}
+
+} // namespace
+
+TEST_CASE("Snapshot 100k entities", "[snapshot]")
+{
+    recs::ComponentStorage cs;
+    std::vector<recs::EntityId> const entities = populate(cs);
+    std::mt19937 rng{0};
+
+    BENCHMARK_ADVANCED("Full capture")(Catch::Benchmark::Chronometer meter)
+    {
+        std::vector<recs::Snapshot> snapshots(meter.runs());
+        meter.measure([&](int i) { snapshots[i] = cs.captureSnapshot(); });
+    };
+
+    for (uint32_t const changed_count : {0u, 100u, 1'000u, 10'000u})
+    {
+        // Includes the simulated writes but those are cheap compared to the
+        // chunk copies they cause
+        std::string const name =
+            "Tick and capture with " + std::to_string(changed_count) +
+            " changes";
+        BENCHMARK_ADVANCED(name.c_str())(Catch::Benchmark::Chronometer meter)
+        {
+            std::vector<recs::Snapshot> snapshots(meter.runs() + 1);
+            snapshots[0] = cs.captureSnapshot();
+            meter.measure(
+                [&](int i)
+                {
+                    simulate(cs, entities, changed_count, rng);
+                    snapshots[i + 1] = cs.captureSnapshot(&snapshots[i]);
+                });
+        };
+    }
+
+    // Rollback a few ticks back and forth with some changes in between
+    BENCHMARK_ADVANCED("Restore 4 ticks back and forth")
+    (Catch::Benchmark::Chronometer meter)
+    {
+        recs::Snapshot const target = cs.captureSnapshot();
+        recs::Snapshot previous = target;
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            simulate(cs, entities, 1'000, rng);
+            previous = cs.captureSnapshot(&previous);
+        }
+
+        meter.measure(
+            [&]
+            {
+                cs.restoreSnapshot(target);
+                cs.restoreSnapshot(previous);
+            });
+    };
+
+    BENCHMARK_ADVANCED("Write all and restore")
+    (Catch::Benchmark::Chronometer meter)
+    {
+        recs::ComponentStorage other;
+        std::vector<recs::EntityId> const other_entities = populate(other);
+        recs::Snapshot const target = other.captureSnapshot();
+
+        // Writing everything makes all chunks differ from the target
+        meter.measure(
+            [&]
+            {
+                for (recs::EntityId const e : other_entities)
+                    other.getComponent<Transform>(e).trfn[0] += 1.f;
+                other.restoreSnapshot(target);
+            });
+    };
+}
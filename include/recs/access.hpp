@@ -55,6 +55,25 @@ class Entity
         return mask;
     }
 
+    [[nodiscard]] static ComponentMask readAccessMask()
+    {
+        ComponentMask mask;
+
+        ReadAccesses::setMask(mask);
+
+        return mask;
+    }
+
+    // Read components that are read from the committed buffer
+    [[nodiscard]] static ComponentMask doubleBufferedReadAccessMask()
+    {
+        ComponentMask mask;
+
+        ReadAccesses::setDoubleBufferedMask(mask);
+
+        return mask;
+    }
+
     // TODO:
     // Support structured bindings into components?
   private:
@@ -130,6 +149,15 @@ class Query
             m_range);
     }
 
+    [[nodiscard]] size_t size() const { return m_range.size(); }
+    [[nodiscard]] bool empty() const { return m_range.empty(); }
+    // Lets systems process the matches in slices
+    [[nodiscard]] EntityType operator[](size_t index) const
+    {
+        assert(index < m_range.size());
+        return EntityType{m_range, index};
+    }
+
     [[nodiscard]] static ComponentMask accessMask()
     {
         ComponentMask mask;
@@ -150,6 +178,25 @@ class Query
         return mask;
     }
 
+    [[nodiscard]] static ComponentMask readAccessMask()
+    {
+        ComponentMask mask;
+
+        ReadAccesses::setMask(mask);
+
+        return mask;
+    }
+
+    // Read components that are read from the committed buffer
+    [[nodiscard]] static ComponentMask doubleBufferedReadAccessMask()
+    {
+        ComponentMask mask;
+
+        ReadAccesses::setDoubleBufferedMask(mask);
+
+        return mask;
+    }
+
     friend class Iterator;
 
   private:
@@ -171,7 +218,7 @@ template <typename ReadAccesses, typename WriteAccesses, typename WithAccesses>
 Entity<ReadAccesses, WriteAccesses, WithAccesses>::Entity(
     ComponentStorage::Range const &range, size_t pos)
 : m_cs{&range.m_cs}
-, m_id{range.m_entities[pos]}
+, m_id{range.getId(pos)}
 {
     // TODO:
     // Figure out how to assert entity components here in addition to the
@@ -193,7 +240,10 @@ T const &Entity<ReadAccesses, WriteAccesses, WithAccesses>::getComponent() const
     assert(m_cs != nullptr);
     assert(
         m_cs->hasComponent<T>(m_id) && "The entity is missing this component");
-    return m_cs->getComponent<T>(m_id);
+    if constexpr (DoubleBuffered<T>::value)
+        return m_cs->readCommittedComponent<T>(m_id);
+    else
+        return m_cs->readComponent<T>(m_id);
 }
 
 template <typename ReadAccesses, typename WriteAccesses, typename WithAccesses>
@@ -13,6 +13,7 @@ template <> class AccessesType<>
   public:
     template <typename T> static consteval bool contains() { return false; }
     static void setMask(ComponentMask &) { }
+    static void setDoubleBufferedMask(ComponentMask &) { }
 };
 template <typename... Ts> class AccessesType
 {
@@ -30,6 +31,13 @@ template <typename... Ts> class AccessesType
     {
         (void(mask.set(TypeId::get<Ts>())), ...);
     }
+
+    static void setDoubleBufferedMask(ComponentMask &mask)
+    {
+        ((DoubleBuffered<Ts>::value ? void(mask.set(TypeId::get<Ts>()))
+                                    : void()),
+         ...);
+    }
 };
 
 template <typename... Ts> class ReadAccessesType : public AccessesType<Ts...>
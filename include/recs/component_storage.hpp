@@ -2,14 +2,20 @@
 
 #include "concepts.hpp"
 #include "entity_id.hpp"
+#include "file_mapping.hpp"
+#include "hierarchical_bitset.hpp"
 #include "type_id.hpp"
+#include <array>
+#include <atomic>
 #include <bitset>
+#include <chrono>
 #include <cstdint>
-#include <cstdlib>
 #include <cstring>
 #include <deque>
-#include <typeindex>
-#include <unordered_map>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <span>
 #include <vector>
 
 namespace recs
@@ -20,10 +26,16 @@ template <typename ReadAccesses, typename WriteAccesses, typename WithAccesses>
 class Entity;
 template <typename ReadAccesses, typename WriteAccesses, typename WithAccesses>
 class QueryIterator;
+class Snapshot;
+class ThreadPool;
+class TraceRecorder;
 
 class ComponentStorage
 {
   public:
+    // Gets a batch of entities that had a component added or removed
+    using ObserverFunc = std::function<void(std::span<EntityId const>)>;
+
     // Don't bother restricting immutable component access because this is only
     // used directly by the strongly typed Query:Iterator
     struct Range
@@ -31,7 +43,9 @@ class ComponentStorage
         Range(ComponentStorage const &cs, std::vector<EntityId> &&entities);
         ~Range() = default;
 
-        Range(Range &) = default;
+        // Copies share the immutable entity list so a single query result can
+        // be handed to multiple systems
+        Range(Range const &) = default;
         Range(Range &&) = default;
         Range &operator=(Range &) = delete;
         Range &operator=(Range &&) = delete;
@@ -39,12 +53,78 @@ class ComponentStorage
         [[nodiscard]] size_t size() const;
         [[nodiscard]] bool empty() const;
         [[nodiscard]] EntityId getId(size_t index) const;
+        [[nodiscard]] std::span<EntityId const> entities() const;
+        // Position of the first entity in a later slot than id. Query results
+        // are in slot order so this stays meaningful after id is removed.
+        [[nodiscard]] size_t upperBound(EntityId id) const;
         template <typename T>
             requires ValidComponent<T>
         [[nodiscard]] T &getComponent(size_t index) const;
 
         ComponentStorage const &m_cs;
-        std::vector<EntityId> m_entities;
+        std::shared_ptr<std::vector<EntityId> const> m_entities;
+    };
+
+    // Entities at a single depth of the hierarchy. Children of the same parent
+    // are contiguous and ordered by their parents' positions in the previous
+    // level so propagating e.g. world transforms is a linear pass per level.
+    // parents[i] is the parent of entities[i] and invalid on the root level.
+    // Positions index all levels in order, entities[i] being at offset + i.
+    // Propagated data kept by position is grouped by level and the parent's
+    // value is read from parent_positions[i] instead of through the parent's
+    // components.
+    struct HierarchyLevel
+    {
+        static constexpr size_t s_no_parent = ~size_t{0};
+
+        size_t offset{0};
+        std::span<EntityId const> entities;
+        std::span<EntityId const> parents;
+        // s_no_parent on the root level
+        std::span<size_t const> parent_positions;
+    };
+
+    struct ComponentStats
+    {
+        uint64_t type_id{0};
+        uint32_t component_size{0};
+        // Live components
+        uint64_t count{0};
+        uint64_t chunk_count{0};
+        // Chunks backed by the file from loadFromFile()
+        uint64_t mapped_chunk_count{0};
+        // Slots in the chunks that don't hold a live component
+        uint64_t empty_slot_count{0};
+        // Live component values
+        uint64_t payload_bytes{0};
+        // Everything else that's allocated for the type: empty slots, change
+        // ticks, committed buffers, the chunk table and presence bits
+        uint64_t overhead_bytes{0};
+    };
+
+    // Heap bytes are computed from container capacities and the known
+    // allocation sizes so allocator bookkeeping is not included
+    struct Stats
+    {
+        uint64_t entity_count{0};
+        // Size of the entity tables, alive entities included
+        uint64_t entity_slot_count{0};
+        // Slots of removed entities, reusable or retired
+        uint64_t dead_slot_count{0};
+        uint64_t freelist_length{0};
+        uint64_t mask_table_bytes{0};
+        // Generations, alive flags, change ticks and the freelist
+        uint64_t entity_table_bytes{0};
+        uint64_t hierarchy_bytes{0};
+        // Size of the file mapping that backs loaded chunks
+        uint64_t mapped_bytes{0};
+        // Sums over components
+        uint64_t component_payload_bytes{0};
+        uint64_t component_overhead_bytes{0};
+        // Heap bytes owned by the storage, mapped chunks excluded
+        uint64_t total_bytes{0};
+        // Only types that have a pool
+        std::vector<ComponentStats> components;
     };
 
     ComponentStorage() = default;
@@ -57,11 +137,46 @@ class ComponentStorage
 
     [[nodiscard]] EntityId addEntity();
 
+    // Preallocates the entity tables for count more entities so that adding
+    // them doesn't reallocate
+    void reserveEntities(uint64_t count);
+    // Allocates the chunks of T for the slots that the next count added
+    // entities will get. compact() frees the chunks that are still empty.
+    template <typename T>
+        requires ValidComponent<T>
+    void reserveComponents(uint64_t count);
+
     [[nodiscard]] bool isValid(EntityId id) const;
 
     [[nodiscard]] Range getEntities(ComponentMask mask) const;
+    // Splits the scan across the pool's workers and the calling thread. The
+    // result is the same as from the serial version. Can be called from tasks
+    // running in pool.
+    [[nodiscard]] Range getEntities(
+        ComponentMask mask, ThreadPool &pool) const;
 
+    // Children of the removed entity are detached and become roots
     void removeEntity(EntityId id);
+    // Removes the entity and all of its descendants
+    void removeEntityTree(EntityId id);
+
+    // parent has to be a valid entity that is not a descendant of child
+    void setParent(EntityId child, EntityId parent);
+    void removeParent(EntityId child);
+    // Returns an invalid id if the entity has no parent
+    [[nodiscard]] EntityId getParent(EntityId id) const;
+    [[nodiscard]] std::vector<EntityId> getChildren(EntityId id) const;
+
+    // Rebuilds the depth ordered levels if the hierarchy has changed since the
+    // previous update. The levels are only valid until the next hierarchy
+    // change so this should be called after structural changes, before
+    // systems iterate the levels.
+    void updateHierarchy();
+    // Entities that have neither a parent nor children are not in any level
+    [[nodiscard]] size_t hierarchyLevelCount() const;
+    // Number of positions over all levels
+    [[nodiscard]] size_t hierarchySize() const;
+    [[nodiscard]] HierarchyLevel getHierarchyLevel(size_t depth) const;
 
     template <typename T>
         requires ValidComponent<T>
@@ -74,69 +189,304 @@ class ComponentStorage
         requires(ValidComponent<Ts> && ...)
     [[nodiscard]] bool hasComponents(EntityId id) const;
 
+    // Marks the component changed for snapshots and deltas, use
+    // readComponent() for read only access
     template <typename T>
         requires ValidComponent<T>
     [[nodiscard]] T &getComponent(EntityId id) const;
 
+    template <typename T>
+        requires ValidComponent<T>
+    [[nodiscard]] T const &readComponent(EntityId id) const;
+
+    // Value of a DoubleBuffered component as of the last
+    // commitDoubleBuffers()
+    template <typename T>
+        requires(ValidComponent<T> && DoubleBuffered<T>::value)
+    [[nodiscard]] T const &readCommittedComponent(EntityId id) const;
+
+    // Copies the current values of the given types into their committed
+    // buffers. Only chunks that have changed since the last commit are
+    // copied. Advances the change tick.
+    void commitDoubleBuffers(ComponentMask const &types);
+
     template <typename T>
         requires ValidComponent<T>
     void removeComponent(EntityId id);
 
+    // Writes the entity tables, hierarchy and component chunks into a single
+    // file that loadFromFile() can map directly. All present component types
+    // have to be registered in TypeRegistry.
+    [[nodiscard]] bool saveToFile(std::filesystem::path const &path) const;
+    // Replaces the current contents. Component chunks are used in place from a
+    // private mapping of the file so the load cost mostly depends on the entity
+    // count and not on the component data size. Returns false and leaves the
+    // storage empty if the file is invalid or has unregistered types.
+    [[nodiscard]] bool loadFromFile(std::filesystem::path const &path);
+
+    // Captures the current state. Component chunks and entity table blocks
+    // that haven't changed since previous was captured or restored are shared
+    // with it instead of copied so the cost is proportional to what was
+    // changed. previous has to be captured from this storage.
+    [[nodiscard]] Snapshot captureSnapshot(Snapshot const *previous = nullptr);
+    // Only copies back chunks and blocks that have changed since the snapshot
+    // was captured or restored.
+    void restoreSnapshot(Snapshot const &snapshot);
+
+    // Changes are stamped with the current change tick. Advancing it lets
+    // consumers like writeDelta() tell apart changes made before and after
+    // that point. Capturing and restoring snapshots also advance the tick.
+    [[nodiscard]] uint32_t changeTick() const;
+    // Returns the new tick
+    uint32_t advanceChangeTick();
+
+    // Appends a compact binary delta of the entities that were created,
+    // destroyed or had components added or removed, and the component values
+    // that were written on or after since_tick. A since_tick of 0 writes the
+    // whole state. All present component types have to be registered in
+    // TypeRegistry. Hierarchy links are not included.
+    [[nodiscard]] bool writeDelta(
+        uint32_t since_tick, std::vector<uint8_t> &out) const;
+    // Patches this storage with a delta written by another storage. Deltas
+    // have to be applied in order and the entities should not be modified
+    // otherwise for the ids to match the source. Returns false if the delta is
+    // malformed or has unregistered types, in which case the storage might be
+    // partially patched.
+    [[nodiscard]] bool applyDelta(std::span<uint8_t const> delta);
+
+    // Walks the chunk tables so the cost is linear in the allocated chunks
+    [[nodiscard]] Stats stats() const;
+
+    // Releases memory left behind by removals: frees chunks without live
+    // components, trims trailing dead entity slots and shrinks the tables to
+    // fit. Live ids stay valid and ids of trimmed slots stay invalid as the
+    // generations of regrown slots continue from the trimmed ones. Returns
+    // true when the pass is complete. If the budget runs out, the next call
+    // continues from where this one stopped. The tables are trimmed in the
+    // last step, which is linear in the trimmed slots and the freelist.
+    bool compact(
+        std::chrono::nanoseconds budget = std::chrono::nanoseconds::max());
+
+    // Records structural operations, completed compactions and queries into
+    // recorder until detached with nullptr. recorder has to outlive the
+    // attachment.
+    void setTraceRecorder(TraceRecorder *recorder);
+
+    // Observers get batches of the entities that T was added to or removed
+    // from since the previous flushObservers(), in the order of the changes.
+    // Removals include removeEntity() and changes include applyDelta() but
+    // snapshots and loaded files replace the contents without events. An
+    // entity can be in a batch more than once and might have changed again
+    // since, so observers should check isValid() and hasComponent() where it
+    // matters. Observers can't be added during a flush.
+    template <typename T>
+        requires ValidComponent<T>
+    void onAdd(ObserverFunc &&observer);
+    template <typename T>
+        requires ValidComponent<T>
+    void onRemove(ObserverFunc &&observer);
+    // Delivers the buffered events, including ones from changes that the
+    // observers make. Schedule executions call this before running systems,
+    // except pipelined ones as the previous frame can still be running.
+    void flushObservers();
+
+    friend class Snapshot;
+    friend class TraceReplayer;
+
   private:
+    // Components are stored in fixed size chunks indexed by the entity index.
+    // Lookups are a couple of indirections instead of a hash lookup and
+    // components of neighboring entities are next to each other. Chunks are
+    // allocated on first use so sparse components only pay for the index
+    // ranges they are used in.
     // TODO:
-    // Not a linear array because content might be sparse. Still, this should be
-    // some kind of sparse block allocated thing instead of a hashmap of
-    // individual allocations per component instance to have some kind of cache
-    // coherency and avoid hash lookups on every single entitys' every single
-    // component. However, even if this was allocated as tight blocks, it would
-    // still likely have terrible cache locality by itself: entities with
-    // interesting subsets of components will be scattered around arbitrarily.
-    // How should grouping be implemented?
-    using ComponentMap = std::unordered_map<uint64_t, void *>;
-
-    std::vector<ComponentMap> m_component_maps;
+    // Entities with interesting subsets of components will still be scattered
+    // around arbitrarily. How should grouping be implemented?
+    static uint64_t const s_chunk_size = 512;
+
+    struct ComponentChunk
+    {
+        uint8_t *data{nullptr};
+        // Live components in this chunk
+        uint32_t count{0};
+        // Points into m_file_mapping instead of an owned allocation
+        bool mapped{false};
+        // Change tick of the last write. Mutable as writes happen through
+        // the const getComponent(), concurrently from multiple systems, so
+        // this should only be accessed through atomic_ref when systems could
+        // be running.
+        mutable uint32_t changed_tick{0};
+        // Change ticks of the individual components. Always owned, even if
+        // data is mapped.
+        uint32_t *changed_ticks{nullptr};
+        // Committed copy of data for double buffered types, allocated on the
+        // first commit
+        uint8_t *committed{nullptr};
+        // Change tick of data when it was last committed
+        uint32_t committed_tick{0};
+    };
+
+    struct ComponentPool
+    {
+        uint32_t component_size{0};
+        uint32_t component_alignment{0};
+        uint64_t count{0};
+        std::vector<ComponentChunk> chunks;
+        // Entity indices that have the component, intersected by queries
+        HierarchicalBitset presence;
+    };
+
+    // Queries are scanned in blocks of entity indices that match a single
+    // summary word of the presence bits
+    static uint64_t const s_query_block_size = 64 * 64;
+
+    struct QuerySets
+    {
+        // Empty queries scan the alive flags instead
+        std::array<
+            HierarchicalBitset const *, TypeId::s_max_component_type_count>
+            sets;
+        size_t count{0};
+        uint64_t block_count{0};
+    };
+
+    // Shared with the workers of a parallel getEntities()
+    struct ParallelQuery;
+
+    struct ComponentObservers
+    {
+        std::vector<ObserverFunc> on_add;
+        std::vector<ObserverFunc> on_remove;
+        // Events buffered until the next flush
+        std::vector<EntityId> added;
+        std::vector<EntityId> removed;
+    };
+
+    // Returns false if nothing can match
+    [[nodiscard]] bool getQuerySets(
+        ComponentMask const &mask, QuerySets &sets) const;
+    // Appends the matches in blocks [begin, end) in index order
+    void appendMatches(
+        QuerySets const &sets, uint64_t begin, uint64_t end,
+        std::vector<EntityId> &ids) const;
+
+    // Returns uninitialized storage for the component
+    [[nodiscard]] void *allocateComponent(
+        EntityId id, uint64_t type_id, uint32_t size, uint32_t alignment);
+    void releaseComponent(EntityId id, uint64_t type_id);
+    [[nodiscard]] ComponentPool &getPool(
+        uint64_t type_id, uint32_t size, uint32_t alignment);
+    void reserveComponents(
+        uint64_t type_id, uint32_t size, uint32_t alignment, uint64_t count);
+    static void allocateChunk(ComponentPool const &pool, ComponentChunk &chunk);
+    static void freeChunk(ComponentPool const &pool, ComponentChunk &chunk);
+    void clear();
+
+    template <typename T>
+    [[nodiscard]] ComponentChunk const &getChunk(EntityId id) const;
+    void markComponentChanged(ComponentChunk const &chunk, uint64_t slot) const;
+    void markEntityChanged(uint64_t index);
+    void markHierarchyChanged();
+    // Sets the presence bits of [begin, end) from the entity masks
+    void updatePresence(uint64_t begin, uint64_t end);
+    // The incremental part of compact()
+    [[nodiscard]] bool freeEmptyChunks(std::chrono::nanoseconds budget);
+    // Trims trailing dead slots, but not below min_count
+    void trimEntityTables(uint64_t min_count);
+    void traceAddComponent(EntityId id, uint64_t type_id);
+    void traceRemoveComponent(EntityId id, uint64_t type_id);
+    [[nodiscard]] ComponentObservers &getObservers(uint64_t type_id);
+
+    std::vector<ComponentPool> m_component_pools;
     std::vector<uint16_t> m_entity_generations;
     // TODO: This could be a bit in the stored generation
     std::vector<bool> m_entity_alive;
     std::deque<uint64_t> m_entity_freelist;
+    // Generation of new slots so that they don't match ids of trimmed slots
+    uint16_t m_generation_floor{0};
+    // Where an interrupted compact() continues from
+    uint64_t m_compact_pool{0};
+    uint64_t m_compact_chunk{0};
 
     std::vector<ComponentMask> m_entity_component_masks;
+
+    // Stamped on changes to track what has to be copied into snapshots. Only
+    // grows so that a tick identifies the contents of a chunk or block.
+    uint32_t m_change_tick{1};
+    // Change ticks of s_chunk_size sized blocks of the entity tables
+    std::vector<uint32_t> m_entity_block_ticks;
+    // Structural change ticks of individual entities
+    std::vector<uint32_t> m_entity_changed_ticks;
+    uint32_t m_freelist_changed_tick{0};
+    uint32_t m_hierarchy_changed_tick{0};
+
+    // Intrusive links so that (re)parenting and cascading removal don't need to
+    // search or allocate per node.
+    struct HierarchyNode
+    {
+        static uint64_t const s_null = 0xFFFF'FFFF'FFFF'FFFF;
+
+        uint64_t parent{s_null};
+        uint64_t first_child{s_null};
+        uint64_t next_sibling{s_null};
+        uint64_t prev_sibling{s_null};
+    };
+
+    void detachFromParent(uint64_t index);
+    void detachChildren(uint64_t index);
+    // Checks that the links of loaded nodes are consistent and acyclic
+    [[nodiscard]] static bool validHierarchy(
+        std::vector<HierarchyNode> const &nodes,
+        std::vector<bool> const &alive);
+
+    // Only grown when parents are set, indexed by entity index
+    std::vector<HierarchyNode> m_hierarchy_nodes;
+    std::vector<EntityId> m_hierarchy_entities;
+    std::vector<EntityId> m_hierarchy_parents;
+    std::vector<size_t> m_hierarchy_parent_positions;
+    // Level i is [offsets[i], offsets[i + 1])
+    std::vector<size_t> m_hierarchy_level_offsets{0};
+    bool m_hierarchy_dirty{false};
+
+    // Backs chunks loaded from a file
+    FileMapping m_file_mapping;
+
+    TraceRecorder *m_trace_recorder{nullptr};
+
+    // Indexed by type id. Structural changes only append to the buffers of
+    // types that are observed.
+    std::vector<ComponentObservers> m_observers;
+    ComponentMask m_observed_adds;
+    ComponentMask m_observed_removes;
+    bool m_flushing_observers{false};
 };
 
 template <typename T>
     requires ValidComponent<T>
 T &ComponentStorage::Range::getComponent(size_t index) const
 {
-    assert(index < m_entities.size());
-    EntityId const id = m_entities[index];
+    EntityId const id = getId(index);
     assert(m_cs.hasComponent<T>(id));
     return m_cs.getComponent<T>(id);
 }
 
 template <typename T>
     requires ValidComponent<T>
-void ComponentStorage::addComponent(EntityId id, T const &c)
+void ComponentStorage::reserveComponents(uint64_t count)
 {
-    assert(isValid(id));
+    reserveComponents(TypeId::get<T>(), sizeof(T), alignof(T), count);
+}
 
+template <typename T>
+    requires ValidComponent<T>
+void ComponentStorage::addComponent(EntityId id, T const &c)
+{
     uint64_t const type_id = TypeId::get<T>();
-    if (m_component_maps.size() <= type_id)
-        m_component_maps.resize(type_id + 1);
-    ComponentMap &map = m_component_maps[type_id];
-
-    uint64_t const index = id.index();
-    assert(!map.contains(index) && "The entity already has this component");
-
-    T *ptr = (T *)std::malloc(sizeof(T));
-    assert(ptr != nullptr);
+    void *ptr = allocateComponent(id, type_id, sizeof(T), alignof(T));
     std::memcpy(ptr, &c, sizeof(T));
 
-    map.emplace(index, ptr);
-
-    assert(m_entity_component_masks.size() > index);
-    ComponentMask &mask = m_entity_component_masks[index];
-    assert(!mask.test(type_id));
-    mask.set(type_id);
+    if (m_trace_recorder != nullptr)
+        traceAddComponent(id, type_id);
 }
 
 template <typename T>
@@ -164,40 +514,106 @@ template <typename T>
     requires ValidComponent<T>
 T &ComponentStorage::getComponent(EntityId id) const
 {
-    assert(isValid(id));
+    ComponentChunk const &chunk = getChunk<T>(id);
+    uint64_t const slot = id.index() % s_chunk_size;
+    markComponentChanged(chunk, slot);
 
-    uint64_t const type_id = TypeId::get<T>();
-    assert(type_id < m_component_maps.size());
-    ComponentMap const &map = m_component_maps[type_id];
+    return *(T *)(chunk.data + slot * sizeof(T));
+}
 
-    uint64_t const index = id.index();
-    T *ptr = (T *)map.at(index);
-    assert(ptr != nullptr);
+template <typename T>
+    requires ValidComponent<T>
+T const &ComponentStorage::readComponent(EntityId id) const
+{
+    ComponentChunk const &chunk = getChunk<T>(id);
 
-    return *ptr;
+    return *(T const *)(chunk.data + (id.index() % s_chunk_size) * sizeof(T));
+}
+
+template <typename T>
+    requires(ValidComponent<T> && DoubleBuffered<T>::value)
+T const &ComponentStorage::readCommittedComponent(EntityId id) const
+{
+    ComponentChunk const &chunk = getChunk<T>(id);
+    assert(
+        chunk.committed != nullptr &&
+        "commitDoubleBuffers() hasn't been called after adding the component");
+
+    return *(
+        T const *)(chunk.committed + (id.index() % s_chunk_size) * sizeof(T));
 }
 
 template <typename T>
     requires ValidComponent<T>
 void ComponentStorage::removeComponent(EntityId id)
 {
-    assert(isValid(id));
+    uint64_t const type_id = TypeId::get<T>();
+    if (m_trace_recorder != nullptr)
+        traceRemoveComponent(id, type_id);
+
+    releaseComponent(id, type_id);
+}
+
+template <typename T>
+    requires ValidComponent<T>
+void ComponentStorage::onAdd(ObserverFunc &&observer)
+{
+    assert(observer);
+    assert(!m_flushing_observers);
 
     uint64_t const type_id = TypeId::get<T>();
-    assert(type_id < m_component_maps.size());
-    ComponentMap &map = m_component_maps[type_id];
+    getObservers(type_id).on_add.push_back(std::move(observer));
+    m_observed_adds.set(type_id);
+}
 
-    uint64_t const index = id.index();
-    T *ptr = (T *)map.at(index);
-    assert(ptr != nullptr);
+template <typename T>
+    requires ValidComponent<T>
+void ComponentStorage::onRemove(ObserverFunc &&observer)
+{
+    assert(observer);
+    assert(!m_flushing_observers);
 
-    std::free(ptr);
-    map.erase(index);
+    uint64_t const type_id = TypeId::get<T>();
+    getObservers(type_id).on_remove.push_back(std::move(observer));
+    m_observed_removes.set(type_id);
+}
 
-    assert(m_entity_component_masks.size() > index);
-    ComponentMask &mask = m_entity_component_masks[index];
-    assert(mask.test(type_id));
-    mask.reset(type_id);
+template <typename T>
+ComponentStorage::ComponentChunk const &ComponentStorage::getChunk(
+    EntityId id) const
+{
+    assert(hasComponent<T>(id) && "The entity is missing this component");
+
+    uint64_t const type_id = TypeId::get<T>();
+    assert(type_id < m_component_pools.size());
+    ComponentPool const &pool = m_component_pools[type_id];
+    assert(pool.component_size == sizeof(T));
+
+    uint64_t const chunk_index = id.index() / s_chunk_size;
+    assert(chunk_index < pool.chunks.size());
+    ComponentChunk const &chunk = pool.chunks[chunk_index];
+    assert(chunk.data != nullptr);
+
+    return chunk;
+}
+
+inline void ComponentStorage::markComponentChanged(
+    ComponentChunk const &chunk, uint64_t slot) const
+{
+    // Pipelined schedules advance the tick while systems of the previous
+    // frame can still be writing
+    uint32_t const change_tick =
+        std::atomic_ref<uint32_t>{const_cast<uint32_t &>(m_change_tick)}.load(
+            std::memory_order_relaxed);
+
+    // Check first to avoid bouncing the cache line between threads writing
+    // into neighboring chunks
+    std::atomic_ref<uint32_t> const tick{chunk.changed_tick};
+    if (tick.load(std::memory_order_relaxed) != change_tick)
+        tick.store(change_tick, std::memory_order_relaxed);
+
+    // Systems don't write the same component concurrently
+    chunk.changed_ticks[slot] = change_tick;
 }
 
 } // namespace recs
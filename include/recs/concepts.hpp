@@ -18,4 +18,12 @@ template <typename T>
 concept ValidComponent =
     (std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>);
 
+// Specialize as std::true_type to double buffer a component type. Systems that
+// read it see the values committed at the start of the frame while systems
+// that write it update the next values, so readers and writers of the type can
+// run in parallel.
+template <typename T> struct DoubleBuffered : std::false_type
+{
+};
+
 } // namespace recs
@@ -7,6 +7,7 @@ namespace recs
 {
 
 class ComponentStorage;
+class TraceReplayer;
 
 // NOTE:
 // This assumes a single ComponentStorage as entities from multiple storages can
@@ -31,6 +32,7 @@ class EntityId
     }
 
     friend class ComponentStorage;
+    friend class TraceReplayer;
 
   private:
     static uint64_t const s_invalid_id = 0xFFFF'FFFF'FFFF'FFFF;
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+namespace recs
+{
+
+class ThreadPool;
+
+// Runs the tasks of a parallel Schedule::execute(). Lets an external job
+// system drive the schedule instead of a ThreadPool competing for the same
+// cores.
+class Executor
+{
+  public:
+    static uint32_t const s_unknown_thread = ~0u;
+
+    Executor() = default;
+    virtual ~Executor() = default;
+
+    Executor(Executor const &) = delete;
+    Executor(Executor &&) = delete;
+    Executor &operator=(Executor const &) = delete;
+    Executor &operator=(Executor &&) = delete;
+
+    // Can be called from within tasks
+    virtual void submit(std::function<void()> &&task) = 0;
+    // Runs task on the given worker. Executors that can't pin tasks run it
+    // like submit().
+    virtual void submitTo(uint32_t worker, std::function<void()> &&task);
+    // Runs task on a thread that's in wait(), e.g. the main thread for work
+    // that isn't thread safe. Tasks submitted while nothing waits run in the
+    // next wait().
+    virtual void submitToWaiter(std::function<void()> &&task) = 0;
+    // Returns once submitted tasks have decremented counter to 0 through
+    // decrement(). The tasks have to be able to progress while the caller
+    // waits, e.g. by running them on the calling thread or yielding the
+    // calling fiber.
+    virtual void wait(std::atomic<uint32_t> &counter) = 0;
+    // The waiter can return and release counter as soon as it reaches 0 so
+    // this can't touch it afterwards
+    virtual void decrement(std::atomic<uint32_t> &counter) = 0;
+
+    // Index of the calling worker for profiles or s_unknown_thread
+    [[nodiscard]] virtual uint32_t currentThread() const;
+};
+
+// Runs the tasks in submission order on the thread calling wait(). Executes
+// schedules deterministically without any threads, e.g. in tests.
+class SerialExecutor : public Executor
+{
+  public:
+    SerialExecutor() = default;
+    ~SerialExecutor() override = default;
+
+    void submit(std::function<void()> &&task) override;
+    void submitToWaiter(std::function<void()> &&task) override;
+    void wait(std::atomic<uint32_t> &counter) override;
+    void decrement(std::atomic<uint32_t> &counter) override;
+
+  private:
+    std::deque<std::function<void()>> m_tasks;
+};
+
+// Runs the tasks on a ThreadPool, the default for Schedule::execute()
+class PoolExecutor : public Executor
+{
+  public:
+    explicit PoolExecutor(ThreadPool &pool);
+    ~PoolExecutor() override = default;
+
+    void submit(std::function<void()> &&task) override;
+    void submitTo(uint32_t worker, std::function<void()> &&task) override;
+    void submitToWaiter(std::function<void()> &&task) override;
+    void wait(std::atomic<uint32_t> &counter) override;
+    void decrement(std::atomic<uint32_t> &counter) override;
+    [[nodiscard]] uint32_t currentThread() const override;
+
+  private:
+    ThreadPool &m_pool;
+    std::mutex m_mutex;
+    // Signaled when a counter reaches 0 or a waiter task is added
+    std::condition_variable m_changed;
+    std::deque<std::function<void()>> m_waiter_tasks;
+};
+
+} // namespace recs
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+namespace recs
+{
+
+// Private copy-on-write mapping of a whole file. Writes through data() are
+// visible only to this process and never reach the file.
+class FileMapping
+{
+  public:
+    FileMapping() = default;
+    ~FileMapping();
+
+    FileMapping(FileMapping const &) = delete;
+    FileMapping(FileMapping &&other) noexcept;
+    FileMapping &operator=(FileMapping const &) = delete;
+    FileMapping &operator=(FileMapping &&other) noexcept;
+
+    // Returns false if the file couldn't be opened or mapped
+    [[nodiscard]] bool open(std::filesystem::path const &path);
+    void close();
+
+    [[nodiscard]] uint8_t *data() const;
+    [[nodiscard]] size_t size() const;
+
+  private:
+    uint8_t *m_data{nullptr};
+    size_t m_size{0};
+};
+
+} // namespace recs
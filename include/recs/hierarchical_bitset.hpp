@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace recs
+{
+
+// Two level bitset where every summary bit tells if the corresponding word of
+// the actual bits has any set bits. Intersecting sets a summary word at a
+// time skips 4096 bit wide empty ranges with a single AND.
+class HierarchicalBitset
+{
+  public:
+    // Grows the set as needed
+    void set(uint64_t index);
+    void reset(uint64_t index);
+    [[nodiscard]] bool test(uint64_t index) const;
+
+    void clear();
+    // Resets all bits at and after index
+    void truncate(uint64_t index);
+    // Allocates room for bits [0, count) so that setting them doesn't
+    // reallocate
+    void reserve(uint64_t count);
+    void shrinkToFit();
+
+    // Words past the end are zero
+    [[nodiscard]] std::span<uint64_t const> words() const;
+    // Bit i is set if words()[i] is non-zero
+    [[nodiscard]] std::span<uint64_t const> summary() const;
+
+    [[nodiscard]] uint64_t allocatedBytes() const;
+
+  private:
+    std::vector<uint64_t> m_words;
+    std::vector<uint64_t> m_summary;
+};
+
+} // namespace recs
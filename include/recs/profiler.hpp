@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace recs
+{
+
+// Records per system timings of the frames a Schedule executes with it into a
+// ring buffer of the most recent frames. Recording is skipped entirely when
+// disabled.
+class Profiler
+{
+  public:
+    // Times are in nanoseconds since an arbitrary epoch shared by all samples
+    struct SystemSample
+    {
+        std::string name;
+        uint64_t start_ns{0};
+        uint64_t end_ns{0};
+        // Time from all dependencies finishing to the system starting
+        uint64_t queue_wait_ns{0};
+        uint64_t entity_count{0};
+        // Worker index in the pool or s_calling_thread
+        uint32_t thread{0};
+    };
+
+    struct FrameSample
+    {
+        uint64_t frame{0};
+        uint64_t start_ns{0};
+        uint64_t end_ns{0};
+        // In schedule order
+        std::vector<SystemSample> systems;
+    };
+
+    static uint32_t const s_calling_thread = ~0u;
+
+    explicit Profiler(size_t frame_capacity = 120);
+    ~Profiler() = default;
+
+    Profiler(Profiler const &) = delete;
+    Profiler(Profiler &&) = default;
+    Profiler &operator=(Profiler const &) = delete;
+    Profiler &operator=(Profiler &&) = default;
+
+    // Disabled profilers can be passed to execute() at no measurable cost.
+    // Shouldn't be toggled while a frame is being executed.
+    void setEnabled(bool enabled);
+    [[nodiscard]] bool enabled() const;
+
+    // Number of recorded frames, at most the capacity
+    [[nodiscard]] size_t frameCount() const;
+    // Oldest first
+    [[nodiscard]] FrameSample const &frame(size_t index) const;
+    void clear();
+
+    // Writes the recorded frames as Chrome trace event JSON that can be opened
+    // in Perfetto or chrome://tracing
+    void writeChromeTrace(std::ostream &out) const;
+    [[nodiscard]] bool exportChromeTrace(
+        std::filesystem::path const &path) const;
+
+    [[nodiscard]] static uint64_t now();
+
+    friend class Schedule;
+
+  private:
+    // Returns the oldest slot reset for a new frame
+    [[nodiscard]] FrameSample &beginFrame(size_t system_count);
+
+    bool m_enabled{false};
+    std::vector<FrameSample> m_frames;
+    // Slot of the oldest frame
+    size_t m_first_frame{0};
+    size_t m_frame_count{0};
+    uint64_t m_next_frame{0};
+};
+
+} // namespace recs
@@ -2,14 +2,31 @@
 
 #include "access.hpp"
 #include "component_storage.hpp"
+#include "system_task.hpp"
+#include <chrono>
 #include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
 #include <type_traits>
 #include <unordered_set>
 
 namespace recs
 {
 
+class Executor;
 class Scheduler;
+class Profiler;
+class ThreadPool;
+
+// Ready systems of a higher class run first regardless of their critical paths
+enum class SystemPriority : uint8_t
+{
+    Low,
+    Normal,
+    High,
+};
 
 // Opaque hande so that this doesn't get invalidated when new systems are
 // allocated
@@ -23,11 +40,45 @@ class SystemRef
     SystemRef &operator=(SystemRef const &other) = default;
 
     SystemRef const &executeAfter(SystemRef dependency) const;
+    // Estimated run time that prioritizes the system if it's on a long chain
+    // of dependent systems. Schedule::updateCosts() replaces it with measured
+    // times.
+    SystemRef const &setCost(uint64_t cost_ns) const;
+    // Skips the system on executions where condition returns false. Conditions
+    // are checked on the calling thread before any system runs.
+    SystemRef const &runIf(std::function<bool()> condition) const;
+    // Skips the system on executions where any of its queries is empty
+    SystemRef const &runIfMatches() const;
+    // Lets Schedule::executePipelined() start the system before the previous
+    // frame has finished, once the previous frame's instance of it and the
+    // systems it conflicts with have
+    SystemRef const &pipeline() const;
+    // Runs the system on a rotating window of its entities per execution,
+    // continuing from where the previous one stopped. The window ends after
+    // max_entities or once max_time has passed, checked every
+    // Scheduler::s_slice_batch_size entities. Entities are visited in slot
+    // order so ones added or removed in between don't make the rotation skip
+    // or repeat others. Not supported for coroutine systems, which can slice
+    // their work themselves.
+    SystemRef const &timeSlice(
+        size_t max_entities,
+        std::chrono::microseconds max_time =
+            std::chrono::microseconds::max()) const;
+    SystemRef const &setPriority(SystemPriority priority) const;
+    // Runs the system on the thread that waits for the execution, e.g. for
+    // work that isn't thread safe. Pipelined frames run it during the next
+    // wait after it gets ready.
+    SystemRef const &runOnMainThread() const;
+    // Runs the system on the given worker of the pool, e.g. to keep its data
+    // in that core's caches. Executors that can't pin tasks and pools that
+    // don't have the worker run it on any thread.
+    SystemRef const &pinToWorker(uint32_t worker) const;
 
     [[nodiscard]] bool operator==(SystemRef other) const;
     [[nodiscard]] bool operator!=(SystemRef other) const;
 
     friend class Scheduler;
+    friend class Schedule;
 
   private:
     SystemRef(Scheduler &s, size_t index);
@@ -36,31 +87,160 @@ class SystemRef
     size_t m_index{0};
 };
 
-using SystemFunc = std::function<void(ComponentStorage const &)>;
+// Gets the results of the queries that the system was registered with, in the
+// same order. Returns the number of entities the system processed.
+using SystemFunc = std::function<uint64_t(
+    std::span<ComponentStorage::Range const *const> queries)>;
 
 class Schedule
 {
   public:
-    ~Schedule() = default;
+    ~Schedule();
 
     Schedule(Schedule const &) = delete;
-    Schedule(Schedule &&) = default;
+    Schedule(Schedule &&);
     Schedule &operator=(Schedule const &) = delete;
-    Schedule &operator=(Schedule &&) = default;
-
-    void execute(ComponentStorage const &cs) const;
+    Schedule &operator=(Schedule &&);
+
+    // Both commit the double buffered components the systems read before
+    // running them and record the frame into profiler if it's enabled.
+    // Systems can't change the structure of the storage so each distinct
+    // query is evaluated once per execution and shared by the systems using
+    // it. Storage observers are flushed before the queries are evaluated.
+    // Runs the systems one at a time in dependency order
+    void execute(ComponentStorage &cs, Profiler *profiler = nullptr) const;
+    // Runs the systems on the pool. Systems that don't depend on each other
+    // and have no conflicting accesses can run concurrently. Returns once all
+    // systems have finished.
+    void execute(
+        ComponentStorage &cs, ThreadPool &pool,
+        Profiler *profiler = nullptr) const;
+    // Runs the systems as tasks on executor like with a pool, except that
+    // the queries are evaluated on the calling thread
+    void execute(
+        ComponentStorage &cs, Executor &executor,
+        Profiler *profiler = nullptr) const;
+    // Starts a frame on executor and returns once the previous pipelined
+    // frame has finished. Pipelined systems of the new frame can start while
+    // the previous one is still running, other systems wait for it. The
+    // storage can only be accessed through the systems until
+    // finishPipelined() has been called, so results lag by a frame. Frames
+    // don't overlap if the systems read double buffered components and
+    // pipelined frames aren't profiled. Executor has to be the same and stay
+    // alive for all pipelined frames.
+    void executePipelined(ComponentStorage &cs, Executor &executor);
+    // Waits for the frame in flight, if any
+    void finishPipelined();
+
+    // Distinct queries evaluated per execution
+    [[nodiscard]] size_t queryCount() const;
+
+    // Disabled systems are skipped without rebuilding the schedule and the
+    // queries only they use aren't evaluated. Dependents of a skipped system
+    // still wait for its dependencies. system has to be from the Scheduler
+    // that built this. Shouldn't be called while executing.
+    void setEnabled(SystemRef system, bool enabled);
+    [[nodiscard]] bool enabled(SystemRef system) const;
+
+    // Replaces the cost estimates with the mean times measured over the
+    // frames in profiler and updates the priorities. Frames that weren't
+    // recorded with this schedule are skipped. Shouldn't be called while
+    // executing.
+    void updateCosts(Profiler const &profiler);
+    // Longest chain of dependent system costs, the lower bound for the
+    // execution time regardless of the thread count
+    [[nodiscard]] uint64_t criticalPathNs() const;
+    // Execution time in nanoseconds on thread_count workers, simulated with
+    // the same prioritization as the parallel execute()
+    [[nodiscard]] uint64_t predictedMakespanNs(uint32_t thread_count) const;
 
     friend class Scheduler;
 
   private:
-    Schedule(std::vector<SystemFunc> &&systems);
+    struct System
+    {
+        SystemFunc func;
+        std::string name;
+        // Indices of systems that have to wait for this one
+        std::vector<size_t> dependents;
+        uint32_t dependency_count{0};
+        // Range of the system's queries in m_system_queries
+        size_t query_offset{0};
+        size_t query_count{0};
+        std::function<bool()> condition;
+        bool enabled{true};
+        bool require_matches{false};
+        bool pipelined{false};
+        // Systems of the previous pipelined frame this waits for, only set
+        // for pipelined systems
+        std::vector<size_t> frame_blockers;
+        // 0 if unknown
+        uint64_t cost_ns{0};
+        // Cost of the longest chain from the start of this system to the end
+        // of the schedule. Ready systems with higher priorities run first
+        // within a priority class.
+        uint64_t priority{0};
+        SystemPriority priority_class{SystemPriority::Normal};
+        bool main_thread{false};
+        std::optional<uint32_t> worker;
+    };
 
-    std::vector<SystemFunc> m_systems;
+    Schedule(
+        std::vector<System> &&systems, ComponentMask const &double_buffered,
+        std::vector<ComponentMask> &&query_masks,
+        std::vector<size_t> &&system_queries,
+        std::vector<size_t> &&schedule_indices);
+
+    // Flags the enabled systems whose conditions pass
+    [[nodiscard]] std::vector<bool> activeSystems() const;
+    // Evaluates the distinct queries of active systems into results, scanning
+    // on pool if it's not null, and returns the results in m_system_queries
+    // order. Queries without active systems are left empty.
+    [[nodiscard]] std::vector<ComponentStorage::Range const *> evaluateQueries(
+        ComponentStorage const &cs, ThreadPool *pool,
+        std::vector<bool> const &active,
+        std::vector<ComponentStorage::Range> &results) const;
+    struct Frame;
+
+    // Evaluates the queries, on query_pool if it's not null, and starts the
+    // systems without waiting for them. Pipelined frames track their
+    // finished systems for the next one and wait for previous if it's not
+    // null.
+    [[nodiscard]] std::unique_ptr<Frame> startFrame(
+        ComponentStorage &cs, Executor &executor, ThreadPool *query_pool,
+        Profiler *profiler, bool pipelined, Frame *previous) const;
+    // Runs the systems on executor, evaluating the queries on query_pool if
+    // it's not null
+    void executeParallel(
+        ComponentStorage &cs, Executor &executor, ThreadPool *query_pool,
+        Profiler *profiler) const;
+    // Returns 0 without running the system if it requires matches and one of
+    // its queries is empty
+    [[nodiscard]] static uint64_t runSystem(
+        System const &system,
+        std::vector<ComponentStorage::Range const *> const &queries);
+    void updatePriorities();
+    // Orders ready system indices into a max heap by priority class and
+    // priority, earlier systems first on ties
+    [[nodiscard]] bool lowerPriority(size_t a, size_t b) const;
+
+    // In a valid serial execution order
+    std::vector<System> m_systems;
+    std::vector<size_t> m_roots;
+    ComponentMask m_double_buffered;
+    std::vector<ComponentMask> m_query_masks;
+    // Indices into m_query_masks
+    std::vector<size_t> m_system_queries;
+    // Schedule index of each system by its registration index
+    std::vector<size_t> m_schedule_indices;
+    std::unique_ptr<Frame> m_pipelined_frame;
 };
 
 class Scheduler
 {
   public:
+    static constexpr size_t s_slice_batch_size = 16;
+
     Scheduler() = default;
     ~Scheduler() = default;
 
@@ -72,15 +252,36 @@ class Scheduler
     // TODO: Remedy had the system function as a template argument
     template <typename EntityReads, typename EntityWrites, typename EntityWiths>
     SystemRef registerSystem(
-        void (*system)(Entity<EntityReads, EntityWrites, EntityWiths>));
+        void (*system)(Entity<EntityReads, EntityWrites, EntityWiths>),
+        std::string name = {});
 
     // TODO: Remedy had the system function as a template argument
     template <
         typename EntityReads, typename EntityWrites, typename EntityWiths,
         typename QueryReads, typename QueryWrites, typename QueryWiths>
-    SystemRef registerSystem(void (*system)(
-        Entity<EntityReads, EntityWrites, EntityWiths>,
-        Query<QueryReads, QueryWrites, QueryWiths> const &));
+    SystemRef registerSystem(
+        void (*system)(
+            Entity<EntityReads, EntityWrites, EntityWiths>,
+            Query<QueryReads, QueryWrites, QueryWiths> const &),
+        std::string name = {});
+
+    // Coroutine systems are resumed once per execution and can suspend
+    // until the next one, e.g. when the budget of the execution runs out.
+    // Each schedule built runs its own instance of the coroutine.
+    template <typename QueryReads, typename QueryWrites, typename QueryWiths>
+    SystemRef registerSystem(
+        SystemTask (*system)(
+            SystemFrame<Query<QueryReads, QueryWrites, QueryWiths>> &),
+        std::string name = {},
+        std::chrono::nanoseconds budget = std::chrono::nanoseconds::max());
+
+    // Schedules built while set ignore the time budgets of sliced and
+    // coroutine systems, so their results don't depend on timing. Conflicting
+    // systems always run in schedule order and parallel queries keep the slot
+    // order, so the results are then identical regardless of the executor or
+    // thread count as long as systems don't share unordered state of their
+    // own.
+    void setDeterministic(bool deterministic);
 
     [[nodiscard]] Schedule buildSchedule();
 
@@ -90,10 +291,43 @@ class Scheduler
     struct System
     {
         SystemFunc func;
+        // Creates func for each schedule instead if set, for systems that
+        // have state across executions
+        std::function<SystemFunc(bool deterministic)> make_func;
+        // Runs the system on entities [begin, end) of the first query
+        std::function<void(
+            std::span<ComponentStorage::Range const *const> queries,
+            size_t begin, size_t end)>
+            slice_func;
+        // 0 if the system isn't time sliced
+        size_t slice_entities{0};
+        std::chrono::microseconds slice_time{
+            std::chrono::microseconds::max()};
+        bool pipelined{false};
+        // Shows up in profiles, defaults to the registration index
+        std::string name;
+        // Double buffered reads are only in double_buffered_read_mask as they
+        // don't conflict with writes
+        ComponentMask read_mask;
+        ComponentMask write_mask;
+        ComponentMask double_buffered_read_mask;
+        // Masks of the queries func gets, in order
+        std::vector<ComponentMask> query_masks;
+        uint64_t cost_ns{0};
+        std::function<bool()> condition;
+        bool require_matches{false};
+        SystemPriority priority_class{SystemPriority::Normal};
+        bool main_thread{false};
+        std::optional<uint32_t> worker;
         std::vector<SystemRef> dependencies;
         std::vector<SystemRef> dependents;
     };
 
+    [[nodiscard]] static bool conflicts(System const &a, System const &b);
+    // Creates the func of a time sliced system with its own cursor
+    [[nodiscard]] static SystemFunc makeSlicedFunc(
+        System const &system, bool deterministic);
+
     [[nodiscard]] bool dependsOn(
         SystemRef dependent, SystemRef dependency) const;
 
@@ -101,31 +335,49 @@ class Scheduler
     // SystemRefs valid
     std::vector<System> m_systems;
     std::unordered_set<size_t> m_roots;
+    bool m_deterministic{false};
 };
 
 template <typename EntityReads, typename EntityWrites, typename EntityWiths>
 SystemRef Scheduler::registerSystem(
-    void (*system)(Entity<EntityReads, EntityWrites, EntityWiths>))
+    void (*system)(Entity<EntityReads, EntityWrites, EntityWiths>),
+    std::string name)
 {
     using EntityT = Entity<EntityReads, EntityWrites, EntityWiths>;
 
     ComponentMask const access_mask = EntityT::accessMask();
-    ComponentMask const write_access_mask = EntityT::writeAccessMask();
+    ComponentMask const double_buffered_read_mask =
+        EntityT::doubleBufferedReadAccessMask();
 
-    System const s{
+    System s{
         .func =
-            [system, access_mask](ComponentStorage const &cs)
+            [system](std::span<ComponentStorage::Range const *const> queries)
         {
             Query<EntityReads, EntityWrites, EntityWiths> const entities_query{
-                cs.getEntities(access_mask)};
+                ComponentStorage::Range{*queries[0]}};
             for (EntityT entity : entities_query)
                 system(entity);
+            return entities_query.size();
         },
+        .slice_func =
+            [system](
+                std::span<ComponentStorage::Range const *const> queries,
+                size_t begin, size_t end)
+        {
+            ComponentStorage::Range const &range = *queries[0];
+            for (size_t i = begin; i < end; ++i)
+                system(EntityT{range, i});
+        },
+        .name = std::move(name),
+        .read_mask = EntityT::readAccessMask() & ~double_buffered_read_mask,
+        .write_mask = EntityT::writeAccessMask(),
+        .double_buffered_read_mask = double_buffered_read_mask,
+        .query_masks = {access_mask},
     };
 
     SystemRef const ref{*this, m_systems.size()};
 
-    m_systems.push_back(s);
+    m_systems.push_back(std::move(s));
     // No dependencies for a new system so mark as a root
     m_roots.insert(ref.m_index);
 
@@ -135,34 +387,113 @@ SystemRef Scheduler::registerSystem(
 template <
     typename EntityReads, typename EntityWrites, typename EntityWiths,
     typename QueryReads, typename QueryWrites, typename QueryWiths>
-SystemRef Scheduler::registerSystem(void (*system)(
-    Entity<EntityReads, EntityWrites, EntityWiths>,
-    Query<QueryReads, QueryWrites, QueryWiths> const &))
+SystemRef Scheduler::registerSystem(
+    void (*system)(
+        Entity<EntityReads, EntityWrites, EntityWiths>,
+        Query<QueryReads, QueryWrites, QueryWiths> const &),
+    std::string name)
 {
     using EntityT = Entity<EntityReads, EntityWrites, EntityWiths>;
     using QueryT = Query<QueryReads, QueryWrites, QueryWiths>;
 
     ComponentMask const access_mask = EntityT::accessMask();
-    ComponentMask const write_access_mask = EntityT::writeAccessMask();
     ComponentMask const query_access_mask = QueryT::accessMask();
-    ComponentMask const query_write_access_mask = QueryT::writeAccessMask();
+    ComponentMask const double_buffered_read_mask =
+        EntityT::doubleBufferedReadAccessMask() |
+        QueryT::doubleBufferedReadAccessMask();
 
-    System const s{
+    System s{
         .func =
-            [system, access_mask, query_access_mask](ComponentStorage const &cs)
+            [system](std::span<ComponentStorage::Range const *const> queries)
         {
-            QueryT const query{cs.getEntities(query_access_mask)};
+            QueryT const query{ComponentStorage::Range{*queries[1]}};
 
             Query<EntityReads, EntityWrites, EntityWiths> const entities_query{
-                cs.getEntities(access_mask)};
+                ComponentStorage::Range{*queries[0]}};
             for (EntityT entity : entities_query)
                 system(entity, query);
+            return entities_query.size();
+        },
+        .slice_func =
+            [system](
+                std::span<ComponentStorage::Range const *const> queries,
+                size_t begin, size_t end)
+        {
+            QueryT const query{ComponentStorage::Range{*queries[1]}};
+
+            ComponentStorage::Range const &range = *queries[0];
+            for (size_t i = begin; i < end; ++i)
+                system(EntityT{range, i}, query);
+        },
+        .name = std::move(name),
+        .read_mask = (EntityT::readAccessMask() | QueryT::readAccessMask()) &
+                     ~double_buffered_read_mask,
+        .write_mask = EntityT::writeAccessMask() | QueryT::writeAccessMask(),
+        .double_buffered_read_mask = double_buffered_read_mask,
+        .query_masks = {access_mask, query_access_mask},
+    };
+
+    SystemRef const ref{*this, m_systems.size()};
+
+    m_systems.push_back(std::move(s));
+    // No dependencies for a new system so mark as a root
+    m_roots.insert(ref.m_index);
+
+    return ref;
+}
+
+template <typename QueryReads, typename QueryWrites, typename QueryWiths>
+SystemRef Scheduler::registerSystem(
+    SystemTask (*system)(
+        SystemFrame<Query<QueryReads, QueryWrites, QueryWiths>> &),
+    std::string name, std::chrono::nanoseconds budget)
+{
+    using QueryT = Query<QueryReads, QueryWrites, QueryWiths>;
+
+    ComponentMask const double_buffered_read_mask =
+        QueryT::doubleBufferedReadAccessMask();
+
+    System s{
+        .make_func =
+            [system, budget](bool deterministic) -> SystemFunc
+        {
+            struct State
+            {
+                SystemFrame<QueryT> frame;
+                SystemTask task;
+            };
+            // Shared by the copies of the returned func
+            std::shared_ptr<State> const state = std::make_shared<State>();
+
+            bool const unlimited =
+                deterministic || budget == std::chrono::nanoseconds::max();
+
+            return [system, budget, unlimited, state](
+                       std::span<ComponentStorage::Range const *const> queries)
+            {
+                state->frame.m_range = queries[0];
+                state->frame.m_deadline =
+                    unlimited ? std::chrono::steady_clock::time_point::max()
+                              : deadlineAfter(budget);
+
+                if (!state->task.valid() || state->task.done())
+                    state->task = system(state->frame);
+                state->task.resume();
+
+                state->frame.m_range = nullptr;
+                return static_cast<uint64_t>(queries[0]->size());
+            };
         },
+        .name = std::move(name),
+        .read_mask = QueryT::readAccessMask() & ~double_buffered_read_mask,
+        .write_mask = QueryT::writeAccessMask(),
+        .double_buffered_read_mask = double_buffered_read_mask,
+        .query_masks = {QueryT::accessMask()},
     };
 
     SystemRef const ref{*this, m_systems.size()};
 
-    m_systems.push_back(s);
+    m_systems.push_back(std::move(s));
     // No dependencies for a new system so mark as a root
     m_roots.insert(ref.m_index);
 
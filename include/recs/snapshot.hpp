@@ -0,0 +1,76 @@
+#pragma once
+
+#include "component_storage.hpp"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace recs
+{
+
+// State of a ComponentStorage from ComponentStorage::captureSnapshot(). The
+// copied chunks are immutable and shared between snapshots so keeping a window
+// of snapshots around e.g. for rollback costs roughly the changes between
+// them.
+class Snapshot
+{
+  public:
+    Snapshot() = default;
+    ~Snapshot() = default;
+
+    Snapshot(Snapshot const &) = default;
+    Snapshot(Snapshot &&) = default;
+    Snapshot &operator=(Snapshot const &) = default;
+    Snapshot &operator=(Snapshot &&) = default;
+
+    // Storage change tick that the snapshot was captured on
+    [[nodiscard]] uint32_t tick() const;
+    // Bytes copied from the storage on capture, excluding shared chunks
+    [[nodiscard]] uint64_t copiedBytes() const;
+
+    friend class ComponentStorage;
+
+  private:
+    // The changed ticks are the storage ticks of the copied data so that
+    // unchanged data can be detected by comparing to the live ticks
+    struct EntityBlock
+    {
+        std::vector<uint16_t> generations;
+        std::vector<uint8_t> alive;
+        std::vector<ComponentMask> masks;
+        uint32_t changed_tick{0};
+    };
+
+    struct Chunk
+    {
+        std::unique_ptr<uint8_t[]> data;
+        uint32_t count{0};
+        uint32_t changed_tick{0};
+    };
+
+    struct Pool
+    {
+        uint32_t component_size{0};
+        uint32_t component_alignment{0};
+        uint64_t count{0};
+        // nullptr for chunks without components
+        std::vector<std::shared_ptr<Chunk const>> chunks;
+    };
+
+    struct Hierarchy
+    {
+        std::vector<ComponentStorage::HierarchyNode> nodes;
+        uint32_t changed_tick{0};
+    };
+
+    ComponentStorage const *m_storage{nullptr};
+    uint32_t m_tick{0};
+    uint64_t m_copied_bytes{0};
+    uint64_t m_entity_count{0};
+    std::vector<std::shared_ptr<EntityBlock const>> m_entity_blocks;
+    std::vector<uint64_t> m_entity_freelist;
+    std::shared_ptr<Hierarchy const> m_hierarchy;
+    std::vector<Pool> m_pools;
+};
+
+} // namespace recs
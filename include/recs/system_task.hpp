@@ -0,0 +1,117 @@
+#pragma once
+
+#include "access.hpp"
+#include <cassert>
+#include <chrono>
+#include <coroutine>
+
+namespace recs
+{
+
+class Scheduler;
+
+// Return type of coroutine systems. The coroutine starts suspended and the
+// schedule resumes it once per execution until it completes, after which the
+// next execution starts it again.
+class SystemTask
+{
+  public:
+    struct promise_type
+    {
+        [[nodiscard]] SystemTask get_return_object();
+        [[nodiscard]] std::suspend_always initial_suspend() noexcept;
+        [[nodiscard]] std::suspend_always final_suspend() noexcept;
+        void return_void();
+        void unhandled_exception();
+    };
+
+    SystemTask() = default;
+    ~SystemTask();
+
+    SystemTask(SystemTask const &) = delete;
+    SystemTask(SystemTask &&other) noexcept;
+    SystemTask &operator=(SystemTask const &) = delete;
+    SystemTask &operator=(SystemTask &&other) noexcept;
+
+    // False if this doesn't hold a coroutine
+    [[nodiscard]] bool valid() const;
+    [[nodiscard]] bool done() const;
+    void resume() const;
+
+  private:
+    explicit SystemTask(std::coroutine_handle<promise_type> handle);
+
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+// Returns the time budget from now, saturating to time_point::max() instead of
+// overflowing the clock on large budgets
+template <typename Rep, typename Period>
+[[nodiscard]] std::chrono::steady_clock::time_point deadlineAfter(
+    std::chrono::duration<Rep, Period> budget)
+{
+    using Clock = std::chrono::steady_clock;
+    using Budget = std::chrono::duration<Rep, Period>;
+
+    Clock::time_point const now = Clock::now();
+    // Compared in the budget's units so that the max budget doesn't overflow
+    // when converted to the clock's
+    if (budget >= std::chrono::duration_cast<Budget>(
+                      Clock::time_point::max() - now))
+        return Clock::time_point::max();
+    return now + std::chrono::duration_cast<Clock::duration>(budget);
+}
+
+// Suspends only if the execution's budget has run out
+struct BudgetAwaiter
+{
+    bool over_budget{false};
+
+    [[nodiscard]] bool await_ready() const noexcept { return !over_budget; }
+    void await_suspend(std::coroutine_handle<>) const noexcept { }
+    void await_resume() const noexcept { }
+};
+
+// Handle to the current execution that a coroutine system gets. The system
+// holds its declared accesses only while it's running so results from query()
+// shouldn't be used across suspensions. Indices into them can be, though
+// entities might have been added or removed in between.
+template <typename QueryT> class SystemFrame
+{
+  public:
+    SystemFrame() = default;
+    ~SystemFrame() = default;
+
+    SystemFrame(SystemFrame const &) = delete;
+    SystemFrame(SystemFrame &&) = delete;
+    SystemFrame &operator=(SystemFrame const &) = delete;
+    SystemFrame &operator=(SystemFrame &&) = delete;
+
+    // Matches of the system's query in the current execution
+    [[nodiscard]] QueryT query() const
+    {
+        assert(m_range != nullptr && "Not running");
+        return QueryT{ComponentStorage::Range{*m_range}};
+    }
+
+    // co_await suspends until the next execution
+    [[nodiscard]] std::suspend_always nextFrame() const { return {}; }
+    // co_await suspends until the next execution if the budget of this one has
+    // run out
+    [[nodiscard]] BudgetAwaiter yieldIfOverBudget() const
+    {
+        return BudgetAwaiter{.over_budget = overBudget()};
+    }
+    [[nodiscard]] bool overBudget() const
+    {
+        return std::chrono::steady_clock::now() >= m_deadline;
+    }
+
+    friend class Scheduler;
+
+  private:
+    ComponentStorage::Range const *m_range{nullptr};
+    std::chrono::steady_clock::time_point m_deadline;
+};
+
+} // namespace recs
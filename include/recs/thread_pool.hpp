@@ -0,0 +1,52 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace recs
+{
+
+// Fixed set of worker threads that run submitted tasks in submission order.
+// Workers prefer tasks pinned to them over the shared ones.
+class ThreadPool
+{
+  public:
+    // A thread_count of 0 uses one thread per hardware thread
+    explicit ThreadPool(uint32_t thread_count = 0);
+    // Waits for the queued tasks to finish
+    ~ThreadPool();
+
+    ThreadPool(ThreadPool const &) = delete;
+    ThreadPool(ThreadPool &&) = delete;
+    ThreadPool &operator=(ThreadPool const &) = delete;
+    ThreadPool &operator=(ThreadPool &&) = delete;
+
+    // Can be called from within tasks
+    void submit(std::function<void()> &&task);
+    // Runs task on the given worker or on any worker if the pool doesn't have
+    // that one
+    void submit(uint32_t worker, std::function<void()> &&task);
+
+    [[nodiscard]] uint32_t threadCount() const;
+
+    static uint32_t const s_not_a_worker = ~0u;
+    // Index of the calling worker in its pool or s_not_a_worker
+    [[nodiscard]] static uint32_t currentWorkerIndex();
+
+  private:
+    void workerLoop(uint32_t worker_index);
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_task_added;
+    std::deque<std::function<void()>> m_tasks;
+    std::vector<std::deque<std::function<void()>>> m_worker_tasks;
+    bool m_stopping{false};
+};
+
+} // namespace recs
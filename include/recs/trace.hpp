@@ -0,0 +1,145 @@
+#pragma once
+
+#include "component_storage.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <span>
+#include <vector>
+
+namespace recs
+{
+
+class ByteReader;
+
+// Records the structural operations done on a ComponentStorage that it's
+// attached to with ComponentStorage::setTraceRecorder(): entity and component
+// additions and removals, completed compactions and the masks of executed
+// queries. Component values, bulk operations like loading, snapshots and
+// deltas, and the hierarchy are not recorded.
+class TraceRecorder
+{
+  public:
+    TraceRecorder();
+    ~TraceRecorder() = default;
+
+    TraceRecorder(TraceRecorder const &) = delete;
+    TraceRecorder(TraceRecorder &&) = delete;
+    TraceRecorder &operator=(TraceRecorder const &) = delete;
+    TraceRecorder &operator=(TraceRecorder &&) = delete;
+
+    // Replays are timed per frame
+    void markFrame();
+
+    // These shouldn't be called while the attached storage is in use
+    [[nodiscard]] std::vector<uint8_t> const &data() const;
+    [[nodiscard]] bool save(std::filesystem::path const &path) const;
+    void clear();
+
+    friend class ComponentStorage;
+
+  private:
+    void recordAddEntity(uint64_t index);
+    void recordRemoveEntity(uint64_t index);
+    void recordAddComponent(
+        uint64_t index, uint64_t type_id, uint32_t size, uint32_t alignment);
+    void recordRemoveComponent(uint64_t index, uint64_t type_id);
+    void recordCompact(uint64_t entity_count);
+    // Can be called concurrently from systems
+    void recordQuery(ComponentMask const &mask);
+
+    // Writes the type definition on first use or when the layout becomes
+    // known. A size of 0 means the layout is not known yet.
+    [[nodiscard]] uint64_t traceType(
+        uint64_t type_id, uint32_t size, uint32_t alignment);
+
+    struct TraceType
+    {
+        uint64_t index{s_unmapped};
+        uint32_t size{0};
+    };
+    static uint64_t const s_unmapped = ~0ull;
+
+    std::mutex m_mutex;
+    std::vector<uint8_t> m_data;
+    // Indexed by type id
+    std::vector<TraceType> m_types;
+    uint64_t m_type_count{0};
+};
+
+// Re-executes a trace from TraceRecorder against a storage. The traced
+// component types are replayed as opaque zero-initialized types of the same
+// layout. The opaque types take ids from TypeId::allocate(), which are never
+// freed, so a replayer keeps its ids across load() calls and reuses them for
+// traced types of the same index and layout.
+class TraceReplayer
+{
+  public:
+    enum class Result
+    {
+        Frame,
+        End,
+        Error,
+        // The process has run out of component type ids for the traced types
+        TypeIdsExhausted,
+    };
+
+    struct Stats
+    {
+        uint64_t entity_adds{0};
+        uint64_t entity_removes{0};
+        uint64_t component_adds{0};
+        uint64_t component_removes{0};
+        uint64_t queries{0};
+        // Total entities returned by the queries
+        uint64_t query_results{0};
+        uint64_t compactions{0};
+    };
+
+    TraceReplayer() = default;
+    ~TraceReplayer() = default;
+
+    TraceReplayer(TraceReplayer const &) = delete;
+    TraceReplayer(TraceReplayer &&) = delete;
+    TraceReplayer &operator=(TraceReplayer const &) = delete;
+    TraceReplayer &operator=(TraceReplayer &&) = delete;
+
+    // Returns false if the file couldn't be read or isn't a trace
+    [[nodiscard]] bool load(std::filesystem::path const &path);
+    [[nodiscard]] bool load(std::vector<uint8_t> trace);
+
+    // Replays the operations up to the next frame marker into cs. The same
+    // storage has to be used for the whole trace and it should start empty.
+    [[nodiscard]] Result replayFrame(ComponentStorage &cs);
+
+    [[nodiscard]] Stats const &stats() const;
+
+  private:
+    struct Type
+    {
+        uint64_t type_id{0};
+        uint32_t size{0};
+        uint32_t alignment{0};
+    };
+
+    [[nodiscard]] Result replayOps(ComponentStorage &cs, ByteReader &reader);
+    [[nodiscard]] bool readEntity(
+        ComponentStorage const &cs, ByteReader &reader, EntityId &id);
+    [[nodiscard]] bool readType(ByteReader &reader, Type const *&type);
+    // Returns TypeId::s_max_component_type_count if the ids have run out
+    [[nodiscard]] uint64_t opaqueTypeId(
+        uint64_t index, uint32_t size, uint32_t alignment);
+
+    std::vector<uint8_t> m_trace;
+    size_t m_position{0};
+    // Indexed by trace type index
+    std::vector<Type> m_types;
+    // Ids allocated by earlier loads with the last layout they were used with,
+    // indexed by trace type index
+    std::vector<Type> m_opaque_types;
+    // Replayed ids by traced entity index
+    std::vector<EntityId> m_entities;
+    Stats m_stats;
+};
+
+} // namespace recs
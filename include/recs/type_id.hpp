@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <bitset>
 #include <cstddef>
 #include <cstdint>
@@ -13,21 +14,36 @@ class TypeId
     // Use a reasonably large bitset to see the perf implications of this design
     static size_t const s_max_component_type_count = 1024;
 
-    // Returns a unique, thread-safe, constant id for the type. The ids can only
-    // be depended on within the process they were queried in so they should not
-    // be serialized.
+    // Returns a unique, thread-safe, constant id for the type. Ids are dense
+    // and handed out in first use order so they only match between processes
+    // that register all types with TypeRegistry in the same order at startup.
+    // Serialize TypeRegistry stable ids instead of these.
     template <typename T> static uint64_t get()
     {
-        // Static init is required to be thread safe. runningTypeId is thread
-        // safe in case multiple threads are initializing ids for different
-        // component types.
-        static uint64_t id = runningTypeId();
-        return id;
+        // The id is constant initialized so there is no static init guard to
+        // check once it has been assigned
+        uint64_t const id = s_ids<T>.load(std::memory_order_relaxed);
+        if (id != s_unassigned_id) [[likely]]
+            return id;
+        return assign(s_ids<T>);
     }
 
+    // Hands out an id that isn't tied to a C++ type, e.g. for replaying
+    // component types that aren't known to the process. Returns
+    // s_max_component_type_count if the ids have run out.
+    [[nodiscard]] static uint64_t allocate();
+
+    // Number of ids handed out so far
+    [[nodiscard]] static uint64_t count();
+
   private:
-    // Helper for typeId(), wrapping a thread-safe counter
-    static uint64_t runningTypeId();
+    static constexpr uint64_t s_unassigned_id = 0xFFFF'FFFF'FFFF'FFFF;
+
+    template <typename T>
+    static inline std::atomic<uint64_t> s_ids{s_unassigned_id};
+
+    // Assigns the next running id to the type if no other thread beat us to it
+    static uint64_t assign(std::atomic<uint64_t> &id);
 };
 
 // TODO: Should this be a in separate header?
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "concepts.hpp"
+#include "type_id.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace recs
+{
+
+// Explicit registry of component types, mapping the process local TypeIds to
+// names and ids that are stable between processes and builds so that
+// component data can be serialized.
+//
+// Registering all component types at startup, before any other use, assigns
+// the TypeIds densely in registration order. That makes them deterministic
+// between processes that share the registration code and keeps id assignment
+// off the frame.
+class TypeRegistry
+{
+  public:
+    static constexpr uint64_t s_invalid_id = 0xFFFF'FFFF'FFFF'FFFF;
+
+    struct TypeInfo
+    {
+        std::string name;
+        // Hash of the name
+        uint64_t stable_id{s_invalid_id};
+        uint32_t size{0};
+        uint32_t alignment{0};
+    };
+
+    // The name should be unique and not change between builds that share
+    // serialized data. Registering the same type again with the same name is a
+    // no-op. Returns the TypeId of the type.
+    template <typename T>
+        requires ValidComponent<T>
+    static uint64_t registerType(std::string_view name)
+    {
+        uint64_t const type_id = TypeId::get<T>();
+        registerType(type_id, name, sizeof(T), alignof(T));
+        return type_id;
+    }
+
+    // Returns nullptr if the type hasn't been registered. The returned info
+    // stays valid for the lifetime of the process.
+    [[nodiscard]] static TypeInfo const *info(uint64_t type_id);
+    // Returns s_invalid_id if the type hasn't been registered
+    [[nodiscard]] static uint64_t stableId(uint64_t type_id);
+    // Returns s_invalid_id if no type with the stable id has been registered
+    [[nodiscard]] static uint64_t typeId(uint64_t stable_id);
+
+    [[nodiscard]] static uint64_t hashName(std::string_view name);
+
+  private:
+    static void registerType(
+        uint64_t type_id, std::string_view name, uint32_t size,
+        uint32_t alignment);
+};
+
+} // namespace recs
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <vector>
+
+namespace recs
+{
+
+// Helpers for the binary formats, integers are LEB128 varints
+
+inline void writeVarint(std::vector<uint8_t> &out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+inline void writeBytes(
+    std::vector<uint8_t> &out, void const *data, size_t size)
+{
+    uint8_t const *bytes = static_cast<uint8_t const *>(data);
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+class ByteReader
+{
+  public:
+    ByteReader(std::span<uint8_t const> data, size_t position = 0)
+    : m_data{data}
+    , m_pos{position}
+    {
+    }
+
+    [[nodiscard]] bool readVarint(uint64_t &value)
+    {
+        value = 0;
+        for (uint32_t shift = 0; shift < 64; shift += 7)
+        {
+            if (m_pos >= m_data.size())
+                return false;
+
+            uint8_t const byte = m_data[m_pos++];
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    [[nodiscard]] bool readBytes(void *data, size_t size)
+    {
+        if (m_data.size() - m_pos < size)
+            return false;
+
+        std::memcpy(data, m_data.data() + m_pos, size);
+        m_pos += size;
+        return true;
+    }
+
+    [[nodiscard]] bool done() const { return m_pos == m_data.size(); }
+    [[nodiscard]] size_t position() const { return m_pos; }
+
+  private:
+    std::span<uint8_t const> m_data;
+    size_t m_pos{0};
+};
+
+} // namespace recs
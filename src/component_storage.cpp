@@ -1,36 +1,52 @@
 #include "recs/component_storage.hpp"
 
-#include <atomic>
+#include "recs/thread_pool.hpp"
+#include "recs/trace.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <condition_variable>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
 
 namespace recs
 {
 
-size_t ComponentStorage::Range::size() const { return m_entities.size(); }
+size_t ComponentStorage::Range::size() const { return m_entities->size(); }
 
-bool ComponentStorage::Range::empty() const { return m_entities.empty(); }
+bool ComponentStorage::Range::empty() const { return m_entities->empty(); }
 
 EntityId ComponentStorage::Range::getId(size_t index) const
 {
-    assert(index < m_entities.size());
-    return m_entities[index];
+    assert(index < m_entities->size());
+    return (*m_entities)[index];
 };
 
 ComponentStorage::Range::Range(
     ComponentStorage const &cs, std::vector<EntityId> &&entities)
 : m_cs{cs}
-, m_entities{std::move(entities)}
+, m_entities{
+      std::make_shared<std::vector<EntityId> const>(std::move(entities))}
 {
 }
 
-ComponentStorage::~ComponentStorage()
+std::span<EntityId const> ComponentStorage::Range::entities() const
 {
-    for (ComponentMap &cm : m_component_maps)
-    {
-        for (auto &[id, component] : cm)
-            std::free(component);
-    }
+    return *m_entities;
+}
+
+size_t ComponentStorage::Range::upperBound(EntityId id) const
+{
+    auto const it = std::upper_bound(
+        m_entities->begin(), m_entities->end(), id,
+        [](EntityId a, EntityId b) { return a.index() < b.index(); });
+    return static_cast<size_t>(it - m_entities->begin());
 }
 
+ComponentStorage::~ComponentStorage() { clear(); }
+
 EntityId ComponentStorage::addEntity()
 {
     uint64_t index;
@@ -39,10 +55,11 @@ EntityId ComponentStorage::addEntity()
     {
         assert(m_entity_generations.size() <= EntityId::s_max_index);
         index = (uint64_t)m_entity_generations.size();
-        m_entity_generations.push_back(0);
+        generation = m_generation_floor;
+        m_entity_generations.push_back(generation);
         m_entity_alive.push_back(true);
         m_entity_component_masks.emplace_back();
-        generation = 0;
+        m_entity_changed_ticks.push_back(m_change_tick);
     }
     else
     {
@@ -56,21 +73,43 @@ EntityId ComponentStorage::addEntity()
         assert(generation <= EntityId::s_max_generation);
         assert(!m_entity_alive[index]);
         m_entity_alive[index] = true;
+        m_freelist_changed_tick = m_change_tick;
     }
+    markEntityChanged(index);
+
+    if (m_trace_recorder != nullptr)
+        m_trace_recorder->recordAddEntity(index);
 
     EntityId const id{index, generation};
     return id;
 }
 
+void ComponentStorage::reserveEntities(uint64_t count)
+{
+    // Freed slots are reused first
+    if (count <= m_entity_freelist.size())
+        return;
+
+    uint64_t const entity_count =
+        m_entity_generations.size() + count - m_entity_freelist.size();
+    assert(entity_count <= EntityId::s_max_index + 1);
+    m_entity_generations.reserve(entity_count);
+    m_entity_alive.reserve(entity_count);
+    m_entity_component_masks.reserve(entity_count);
+    m_entity_changed_ticks.reserve(entity_count);
+    m_entity_block_ticks.reserve(
+        (entity_count + s_chunk_size - 1) / s_chunk_size);
+}
+
 bool ComponentStorage::isValid(EntityId id) const
 {
     if (!id.isValid())
         return false;
 
     uint64_t const index = id.index();
-    // Invalid index here is a bug because valid non-default initialized ids are
-    // only handed constructed by this class
-    assert(index < m_entity_generations.size());
+    // Slots of removed entities can be trimmed by compact()
+    if (index >= m_entity_generations.size())
+        return false;
 
     uint16_t const generation = id.generation();
     uint16_t const stored_generation = m_entity_generations[index];
@@ -86,58 +125,977 @@ bool ComponentStorage::isValid(EntityId id) const
 
 ComponentStorage::Range ComponentStorage::getEntities(ComponentMask mask) const
 {
+    if (m_trace_recorder != nullptr)
+        m_trace_recorder->recordQuery(mask);
+
+    std::vector<EntityId> ids;
+    QuerySets sets;
+    if (!getQuerySets(mask, sets))
+        return Range{*this, std::move(ids)};
+
+    if (sets.count == 0)
+        ids.reserve(m_entity_alive.size());
+    appendMatches(sets, 0, sets.block_count, ids);
+    if (sets.count == 0)
+        ids.shrink_to_fit();
+
+    return Range{*this, std::move(ids)};
+}
+
+struct ComponentStorage::ParallelQuery
+{
+    QuerySets sets;
+    std::vector<std::vector<EntityId>> segments;
+    std::atomic<uint64_t> next_segment{0};
+    std::mutex mutex;
+    std::condition_variable all_finished;
+    uint64_t finished_count{0};
+};
+
+ComponentStorage::Range ComponentStorage::getEntities(
+    ComponentMask mask, ThreadPool &pool) const
+{
+    if (m_trace_recorder != nullptr)
+        m_trace_recorder->recordQuery(mask);
+
     std::vector<EntityId> ids;
-    ids.reserve(m_entity_alive.size());
+    auto state = std::make_shared<ParallelQuery>();
+    if (!getQuerySets(mask, state->sets))
+        return Range{*this, std::move(ids)};
 
-    uint64_t const entity_count = static_cast<uint64_t>(m_entity_alive.size());
-    for (uint64_t id = 0; id < entity_count; ++id)
+    // Small scans are faster than waking up the workers
+    uint64_t const min_blocks_per_segment = 4;
+    uint64_t const block_count = state->sets.block_count;
+    uint64_t const segment_count = std::min<uint64_t>(
+        uint64_t{pool.threadCount()} * 4,
+        block_count / min_blocks_per_segment);
+    if (segment_count <= 1)
     {
-        if (m_entity_alive[id])
+        appendMatches(state->sets, 0, block_count, ids);
+        return Range{*this, std::move(ids)};
+    }
+
+    state->segments.resize(segment_count);
+    // The caller scans segments too and only waits for the segments that
+    // workers have already started. That way this can be called from tasks
+    // of the same pool without deadlocking when all workers are busy. Late
+    // helpers find no segments left and only touch the shared state.
+    auto const scanSegments = [this, segment_count](ParallelQuery &state)
+    {
+        uint64_t const block_count = state.sets.block_count;
+        while (true)
         {
-            ComponentMask const entityMask = m_entity_component_masks[id];
-            if ((entityMask & mask) == mask)
-            {
-                uint16_t const gen = m_entity_generations[id];
-                ids.push_back(EntityId{id, gen});
-            }
+            uint64_t const segment =
+                state.next_segment.fetch_add(1, std::memory_order_relaxed);
+            if (segment >= segment_count)
+                return;
+
+            uint64_t const begin = block_count * segment / segment_count;
+            uint64_t const end = block_count * (segment + 1) / segment_count;
+            appendMatches(state.sets, begin, end, state.segments[segment]);
+
+            std::lock_guard const lock{state.mutex};
+            if (++state.finished_count == segment_count)
+                state.all_finished.notify_one();
         }
+    };
+
+    uint32_t const helper_count = static_cast<uint32_t>(
+        std::min<uint64_t>(pool.threadCount(), segment_count - 1));
+    for (uint32_t i = 0; i < helper_count; ++i)
+        pool.submit([state, scanSegments] { scanSegments(*state); });
+    scanSegments(*state);
+
+    {
+        std::unique_lock lock{state->mutex};
+        state->all_finished.wait(
+            lock, [&] { return state->finished_count == segment_count; });
     }
 
-    ids.shrink_to_fit();
+    size_t total_count = 0;
+    for (std::vector<EntityId> const &segment : state->segments)
+        total_count += segment.size();
+    ids.reserve(total_count);
+    for (std::vector<EntityId> const &segment : state->segments)
+        ids.insert(ids.end(), segment.begin(), segment.end());
 
     return Range{*this, std::move(ids)};
 }
 
+bool ComponentStorage::getQuerySets(
+    ComponentMask const &mask, QuerySets &sets) const
+{
+    sets.count = 0;
+    if (mask.none())
+    {
+        sets.block_count =
+            (m_entity_alive.size() + s_query_block_size - 1) /
+            s_query_block_size;
+        return true;
+    }
+
+    // The smallest set bounds the words that can match
+    sets.block_count = std::numeric_limits<uint64_t>::max();
+    uint64_t const type_count = mask.count();
+    uint64_t const pool_count = m_component_pools.size();
+    for (uint64_t type_id = 0; type_id < pool_count; ++type_id)
+    {
+        if (mask.test(type_id))
+        {
+            HierarchicalBitset const &presence =
+                m_component_pools[type_id].presence;
+            sets.block_count = std::min<uint64_t>(
+                sets.block_count, presence.summary().size());
+            sets.sets[sets.count++] = &presence;
+        }
+    }
+
+    // Types without a pool have never been added to any entity
+    return sets.count == type_count;
+}
+
+void ComponentStorage::appendMatches(
+    QuerySets const &sets, uint64_t begin, uint64_t end,
+    std::vector<EntityId> &ids) const
+{
+    if (sets.count == 0)
+    {
+        uint64_t const index_end = std::min<uint64_t>(
+            end * s_query_block_size, m_entity_alive.size());
+        for (uint64_t index = begin * s_query_block_size; index < index_end;
+             ++index)
+        {
+            if (m_entity_alive[index])
+                ids.push_back(EntityId{index, m_entity_generations[index]});
+        }
+        return;
+    }
+
+    // Entities with components are alive so the presence bits of the queried
+    // types are enough
+    for (uint64_t s = begin; s < end; ++s)
+    {
+        uint64_t summary_word = ~0ull;
+        for (size_t i = 0; i < sets.count && summary_word != 0; ++i)
+            summary_word &= sets.sets[i]->summary()[s];
+
+        while (summary_word != 0)
+        {
+            uint64_t const w =
+                s * 64 + static_cast<uint64_t>(std::countr_zero(summary_word));
+            summary_word &= summary_word - 1;
+
+            // Set summary bits mean that the words exist
+            uint64_t word = ~0ull;
+            for (size_t i = 0; i < sets.count && word != 0; ++i)
+                word &= sets.sets[i]->words()[w];
+
+            while (word != 0)
+            {
+                uint64_t const index =
+                    w * 64 + static_cast<uint64_t>(std::countr_zero(word));
+                word &= word - 1;
+                assert(m_entity_alive[index]);
+                ids.push_back(EntityId{index, m_entity_generations[index]});
+            }
+        }
+    }
+}
+
 void ComponentStorage::removeEntity(EntityId id)
 {
     if (!isValid(id))
         return;
 
     uint64_t const index = id.index();
+    if (m_trace_recorder != nullptr)
+        m_trace_recorder->recordRemoveEntity(index);
+
     uint16_t &stored_generation = m_entity_generations[index];
     stored_generation++;
 
+    if (index < m_hierarchy_nodes.size())
+    {
+        detachFromParent(index);
+        detachChildren(index);
+    }
+
     assert(m_entity_alive[index]);
     m_entity_alive[index] = false;
+    markEntityChanged(index);
 
+    // Masks can't have types without a pool so there's no need to check the
+    // whole mask
     ComponentMask &mask = m_entity_component_masks[index];
-    const size_t mask_bit_count = mask.size();
-    for (size_t i = 0; i < mask_bit_count; ++i)
+    const size_t pool_count = m_component_pools.size();
+    for (size_t i = 0; i < pool_count; ++i)
     {
         if (mask[i])
         {
-            ComponentMap &cs = m_component_maps[i];
+            ComponentPool &pool = m_component_pools[i];
+            pool.presence.reset(index);
+            ComponentChunk &chunk = pool.chunks[index / s_chunk_size];
+            assert(chunk.count > 0);
+            chunk.count--;
+            chunk.changed_tick = m_change_tick;
+            assert(pool.count > 0);
+            pool.count--;
 
-            void *ptr = cs.at(index);
-            std::free(ptr);
-            cs.erase(index);
+            if (m_observed_removes[i])
+                m_observers[i].removed.push_back(id);
         }
     }
 
     mask.reset();
 
     if (stored_generation <= EntityId::s_max_generation)
+    {
         m_entity_freelist.push_back(index);
+        m_freelist_changed_tick = m_change_tick;
+    }
+}
+
+void ComponentStorage::removeEntityTree(EntityId id)
+{
+    if (!isValid(id))
+        return;
+
+    uint64_t const root_index = id.index();
+    if (root_index >= m_hierarchy_nodes.size())
+    {
+        removeEntity(id);
+        return;
+    }
+
+    // Gather the subtree in pre-order and remove in reverse so that every
+    // entity is a leaf by the time it's removed, keeping each removal O(1) in
+    // the hierarchy
+    std::vector<uint64_t> subtree;
+    std::vector<uint64_t> traversal_stack{root_index};
+    while (!traversal_stack.empty())
+    {
+        uint64_t const index = traversal_stack.back();
+        traversal_stack.pop_back();
+        subtree.push_back(index);
+
+        uint64_t child = m_hierarchy_nodes[index].first_child;
+        while (child != HierarchyNode::s_null)
+        {
+            traversal_stack.push_back(child);
+            child = m_hierarchy_nodes[child].next_sibling;
+        }
+    }
+
+    for (auto iter = subtree.rbegin(); iter != subtree.rend(); ++iter)
+    {
+        uint64_t const index = *iter;
+        removeEntity(EntityId{index, m_entity_generations[index]});
+    }
+}
+
+void ComponentStorage::setParent(EntityId child, EntityId parent)
+{
+    assert(isValid(child));
+    assert(isValid(parent));
+    assert(child != parent);
+
+    uint64_t const child_index = child.index();
+    uint64_t const parent_index = parent.index();
+
+    if (m_hierarchy_nodes.size() < m_entity_generations.size())
+        m_hierarchy_nodes.resize(m_entity_generations.size());
+
+    assert(
+        [&]
+        {
+            for (uint64_t i = parent_index; i != HierarchyNode::s_null;
+                 i = m_hierarchy_nodes[i].parent)
+            {
+                if (i == child_index)
+                    return false;
+            }
+            return true;
+        }() &&
+        "Cycle");
+
+    detachFromParent(child_index);
+
+    // Children are pushed to the front as sibling order is not significant
+    HierarchyNode &child_node = m_hierarchy_nodes[child_index];
+    HierarchyNode &parent_node = m_hierarchy_nodes[parent_index];
+    child_node.parent = parent_index;
+    child_node.next_sibling = parent_node.first_child;
+    if (parent_node.first_child != HierarchyNode::s_null)
+        m_hierarchy_nodes[parent_node.first_child].prev_sibling = child_index;
+    parent_node.first_child = child_index;
+
+    markHierarchyChanged();
+}
+
+void ComponentStorage::removeParent(EntityId child)
+{
+    assert(isValid(child));
+
+    uint64_t const index = child.index();
+    if (index < m_hierarchy_nodes.size())
+        detachFromParent(index);
+}
+
+EntityId ComponentStorage::getParent(EntityId id) const
+{
+    assert(isValid(id));
+
+    uint64_t const index = id.index();
+    if (index >= m_hierarchy_nodes.size())
+        return EntityId{};
+
+    uint64_t const parent_index = m_hierarchy_nodes[index].parent;
+    if (parent_index == HierarchyNode::s_null)
+        return EntityId{};
+
+    return EntityId{parent_index, m_entity_generations[parent_index]};
+}
+
+std::vector<EntityId> ComponentStorage::getChildren(EntityId id) const
+{
+    assert(isValid(id));
+
+    std::vector<EntityId> children;
+
+    uint64_t const index = id.index();
+    if (index >= m_hierarchy_nodes.size())
+        return children;
+
+    uint64_t child = m_hierarchy_nodes[index].first_child;
+    while (child != HierarchyNode::s_null)
+    {
+        children.push_back(EntityId{child, m_entity_generations[child]});
+        child = m_hierarchy_nodes[child].next_sibling;
+    }
+
+    return children;
+}
+
+void ComponentStorage::updateHierarchy()
+{
+    if (!m_hierarchy_dirty)
+        return;
+
+    m_hierarchy_entities.clear();
+    m_hierarchy_parents.clear();
+    m_hierarchy_parent_positions.clear();
+    m_hierarchy_level_offsets.clear();
+    m_hierarchy_level_offsets.push_back(0);
+
+    uint64_t const node_count = m_hierarchy_nodes.size();
+    for (uint64_t index = 0; index < node_count; ++index)
+    {
+        HierarchyNode const &node = m_hierarchy_nodes[index];
+        if (node.parent == HierarchyNode::s_null &&
+            node.first_child != HierarchyNode::s_null)
+        {
+            m_hierarchy_entities.push_back(
+                EntityId{index, m_entity_generations[index]});
+            m_hierarchy_parents.emplace_back();
+            m_hierarchy_parent_positions.push_back(HierarchyLevel::s_no_parent);
+        }
+    }
+
+    // Breadth first so that each level has the children of a parent next to
+    // each other, in the order of the parents in the previous level
+    while (m_hierarchy_entities.size() > m_hierarchy_level_offsets.back())
+    {
+        size_t const level_begin = m_hierarchy_level_offsets.back();
+        size_t const level_end = m_hierarchy_entities.size();
+        m_hierarchy_level_offsets.push_back(level_end);
+
+        for (size_t i = level_begin; i < level_end; ++i)
+        {
+            EntityId const parent = m_hierarchy_entities[i];
+            uint64_t child = m_hierarchy_nodes[parent.index()].first_child;
+            while (child != HierarchyNode::s_null)
+            {
+                m_hierarchy_entities.push_back(
+                    EntityId{child, m_entity_generations[child]});
+                m_hierarchy_parents.push_back(parent);
+                m_hierarchy_parent_positions.push_back(i);
+                child = m_hierarchy_nodes[child].next_sibling;
+            }
+        }
+    }
+
+    m_hierarchy_dirty = false;
+}
+
+size_t ComponentStorage::hierarchyLevelCount() const
+{
+    assert(!m_hierarchy_dirty && "updateHierarchy() not called after changes");
+    return m_hierarchy_level_offsets.size() - 1;
+}
+
+size_t ComponentStorage::hierarchySize() const
+{
+    assert(!m_hierarchy_dirty && "updateHierarchy() not called after changes");
+    return m_hierarchy_entities.size();
+}
+
+ComponentStorage::HierarchyLevel ComponentStorage::getHierarchyLevel(
+    size_t depth) const
+{
+    assert(!m_hierarchy_dirty && "updateHierarchy() not called after changes");
+    assert(depth + 1 < m_hierarchy_level_offsets.size());
+
+    size_t const begin = m_hierarchy_level_offsets[depth];
+    size_t const count = m_hierarchy_level_offsets[depth + 1] - begin;
+
+    return HierarchyLevel{
+        .offset = begin,
+        .entities = std::span{m_hierarchy_entities}.subspan(begin, count),
+        .parents = std::span{m_hierarchy_parents}.subspan(begin, count),
+        .parent_positions =
+            std::span{m_hierarchy_parent_positions}.subspan(begin, count),
+    };
+}
+
+void *ComponentStorage::allocateComponent(
+    EntityId id, uint64_t type_id, uint32_t size, uint32_t alignment)
+{
+    assert(isValid(id));
+
+    ComponentPool &pool = getPool(type_id, size, alignment);
+
+    uint64_t const index = id.index();
+    assert(m_entity_component_masks.size() > index);
+    ComponentMask &mask = m_entity_component_masks[index];
+    assert(!mask.test(type_id) && "The entity already has this component");
+    mask.set(type_id);
+    markEntityChanged(index);
+
+    uint64_t const chunk_index = index / s_chunk_size;
+    if (pool.chunks.size() <= chunk_index)
+        pool.chunks.resize(chunk_index + 1);
+    pool.presence.set(index);
+
+    ComponentChunk &chunk = pool.chunks[chunk_index];
+    if (chunk.data == nullptr)
+        allocateChunk(pool, chunk);
+    chunk.count++;
+    pool.count++;
+
+    uint64_t const slot = index % s_chunk_size;
+    chunk.changed_tick = m_change_tick;
+    chunk.changed_ticks[slot] = m_change_tick;
+
+    if (m_observed_adds[type_id])
+        m_observers[type_id].added.push_back(id);
+
+    return chunk.data + slot * size;
+}
+
+void ComponentStorage::releaseComponent(EntityId id, uint64_t type_id)
+{
+    assert(isValid(id));
+
+    uint64_t const index = id.index();
+    assert(m_entity_component_masks.size() > index);
+    ComponentMask &mask = m_entity_component_masks[index];
+    assert(mask.test(type_id) && "The entity is missing this component");
+    mask.reset(type_id);
+    markEntityChanged(index);
+
+    // Chunks are kept around even if they become empty to avoid thrashing
+    // allocations when components are repeatedly added and removed
+    assert(type_id < m_component_pools.size());
+    ComponentPool &pool = m_component_pools[type_id];
+    pool.presence.reset(index);
+    ComponentChunk &chunk = pool.chunks[index / s_chunk_size];
+    assert(chunk.count > 0);
+    chunk.count--;
+    chunk.changed_tick = m_change_tick;
+    assert(pool.count > 0);
+    pool.count--;
+
+    if (m_observed_removes[type_id])
+        m_observers[type_id].removed.push_back(id);
+}
+
+ComponentStorage::ComponentPool &ComponentStorage::getPool(
+    uint64_t type_id, uint32_t size, uint32_t alignment)
+{
+    if (m_component_pools.size() <= type_id)
+        m_component_pools.resize(type_id + 1);
+
+    ComponentPool &pool = m_component_pools[type_id];
+    if (pool.component_size == 0)
+    {
+        pool.component_size = size;
+        pool.component_alignment = alignment;
+    }
+    assert(pool.component_size == size);
+    assert(pool.component_alignment == alignment);
+
+    return pool;
+}
+
+void ComponentStorage::reserveComponents(
+    uint64_t type_id, uint32_t size, uint32_t alignment, uint64_t count)
+{
+    ComponentPool &pool = getPool(type_id, size, alignment);
+
+    // Same order as addEntity() hands out the slots
+    auto const reserveSlot = [&](uint64_t index)
+    {
+        uint64_t const chunk_index = index / s_chunk_size;
+        if (pool.chunks.size() <= chunk_index)
+            pool.chunks.resize(chunk_index + 1);
+
+        ComponentChunk &chunk = pool.chunks[chunk_index];
+        if (chunk.data == nullptr)
+            allocateChunk(pool, chunk);
+    };
+
+    // One past the last reserved slot
+    uint64_t end = 0;
+    uint64_t const reused_count =
+        std::min<uint64_t>(count, m_entity_freelist.size());
+    for (uint64_t i = 0; i < reused_count; ++i)
+    {
+        reserveSlot(m_entity_freelist[i]);
+        end = std::max(end, m_entity_freelist[i] + 1);
+    }
+
+    uint64_t const new_count = count - reused_count;
+    if (new_count > 0)
+    {
+        uint64_t const begin = m_entity_generations.size();
+        end = begin + new_count;
+        pool.chunks.reserve((end + s_chunk_size - 1) / s_chunk_size);
+        for (uint64_t index = begin; index < end; index += s_chunk_size)
+            reserveSlot(index);
+        reserveSlot(end - 1);
+    }
+
+    pool.presence.reserve(end);
+}
+
+void ComponentStorage::allocateChunk(
+    ComponentPool const &pool, ComponentChunk &chunk)
+{
+    assert(chunk.data == nullptr);
+    chunk.data = static_cast<uint8_t *>(::operator new(
+        s_chunk_size * pool.component_size,
+        std::align_val_t{pool.component_alignment}));
+    chunk.mapped = false;
+    chunk.changed_ticks = new uint32_t[s_chunk_size]{};
+}
+
+void ComponentStorage::freeChunk(
+    ComponentPool const &pool, ComponentChunk &chunk)
+{
+    if (chunk.data != nullptr && !chunk.mapped)
+        ::operator delete(
+            chunk.data, std::align_val_t{pool.component_alignment});
+    if (chunk.committed != nullptr)
+        ::operator delete(
+            chunk.committed, std::align_val_t{pool.component_alignment});
+    delete[] chunk.changed_ticks;
+    chunk = ComponentChunk{};
+}
+
+void ComponentStorage::clear()
+{
+    for (ComponentPool &pool : m_component_pools)
+    {
+        for (ComponentChunk &chunk : pool.chunks)
+            freeChunk(pool, chunk);
+    }
+    m_component_pools.clear();
+    m_file_mapping.close();
+
+    m_entity_generations.clear();
+    m_entity_alive.clear();
+    m_entity_freelist.clear();
+    m_entity_component_masks.clear();
+    m_entity_block_ticks.clear();
+    m_entity_changed_ticks.clear();
+
+    m_hierarchy_nodes.clear();
+    m_hierarchy_entities.clear();
+    m_hierarchy_parents.clear();
+    m_hierarchy_parent_positions.clear();
+    m_hierarchy_level_offsets.assign(1, 0);
+    m_hierarchy_dirty = false;
+
+    m_compact_pool = 0;
+    m_compact_chunk = 0;
+
+    // Buffered ids would refer to the cleared entities
+    for (ComponentObservers &observers : m_observers)
+    {
+        observers.added.clear();
+        observers.removed.clear();
+    }
+}
+
+void ComponentStorage::markEntityChanged(uint64_t index)
+{
+    uint64_t const block = index / s_chunk_size;
+    if (m_entity_block_ticks.size() <= block)
+        m_entity_block_ticks.resize(block + 1, 0);
+    m_entity_block_ticks[block] = m_change_tick;
+
+    assert(index < m_entity_changed_ticks.size());
+    m_entity_changed_ticks[index] = m_change_tick;
+}
+
+uint32_t ComponentStorage::changeTick() const { return m_change_tick; }
+
+uint32_t ComponentStorage::advanceChangeTick()
+{
+    assert(m_change_tick < std::numeric_limits<uint32_t>::max());
+    // Systems of a pipelined frame can be reading the tick
+    return std::atomic_ref<uint32_t>{m_change_tick}.fetch_add(
+               1, std::memory_order_relaxed) +
+           1;
+}
+
+void ComponentStorage::commitDoubleBuffers(ComponentMask const &types)
+{
+    for (uint64_t type_id = 0; type_id < m_component_pools.size(); ++type_id)
+    {
+        if (!types.test(type_id))
+            continue;
+
+        ComponentPool &pool = m_component_pools[type_id];
+        uint64_t const chunk_bytes = s_chunk_size * pool.component_size;
+        for (ComponentChunk &chunk : pool.chunks)
+        {
+            if (chunk.data == nullptr)
+                continue;
+
+            if (chunk.committed == nullptr)
+                chunk.committed = static_cast<uint8_t *>(::operator new(
+                    chunk_bytes, std::align_val_t{pool.component_alignment}));
+            else if (chunk.committed_tick == chunk.changed_tick)
+                continue;
+
+            std::memcpy(chunk.committed, chunk.data, chunk_bytes);
+            chunk.committed_tick = chunk.changed_tick;
+        }
+    }
+
+    // Writes after this have to be told apart from the committed values
+    (void)advanceChangeTick();
+}
+
+ComponentStorage::Stats ComponentStorage::stats() const
+{
+    Stats ret;
+
+    ret.entity_slot_count = m_entity_generations.size();
+    ret.freelist_length = m_entity_freelist.size();
+    for (bool const alive : m_entity_alive)
+        ret.entity_count += alive ? 1 : 0;
+    ret.dead_slot_count = ret.entity_slot_count - ret.entity_count;
+
+    ret.mask_table_bytes =
+        m_entity_component_masks.capacity() * sizeof(ComponentMask);
+    // vector<bool> packs its bits into words and the deque is counted as if
+    // it were contiguous
+    ret.entity_table_bytes =
+        m_entity_generations.capacity() * sizeof(uint16_t) +
+        m_entity_alive.capacity() / 8 +
+        m_entity_block_ticks.capacity() * sizeof(uint32_t) +
+        m_entity_changed_ticks.capacity() * sizeof(uint32_t) +
+        m_entity_freelist.size() * sizeof(uint64_t);
+    ret.hierarchy_bytes =
+        m_hierarchy_nodes.capacity() * sizeof(HierarchyNode) +
+        m_hierarchy_entities.capacity() * sizeof(EntityId) +
+        m_hierarchy_parents.capacity() * sizeof(EntityId) +
+        m_hierarchy_parent_positions.capacity() * sizeof(size_t) +
+        m_hierarchy_level_offsets.capacity() * sizeof(size_t);
+    ret.mapped_bytes = m_file_mapping.size();
+
+    // Payload in mapped chunks is in the mapping, not on the heap
+    uint64_t mapped_payload_bytes = 0;
+    uint64_t const pool_count = m_component_pools.size();
+    for (uint64_t type_id = 0; type_id < pool_count; ++type_id)
+    {
+        ComponentPool const &pool = m_component_pools[type_id];
+        if (pool.component_size == 0)
+            continue;
+
+        ComponentStats component{
+            .type_id = type_id,
+            .component_size = pool.component_size,
+            .count = pool.count,
+            .payload_bytes = pool.count * pool.component_size,
+            .overhead_bytes = pool.chunks.capacity() * sizeof(ComponentChunk) +
+                              pool.presence.allocatedBytes(),
+        };
+        for (ComponentChunk const &chunk : pool.chunks)
+        {
+            if (chunk.data == nullptr)
+                continue;
+
+            uint64_t const empty_slots = s_chunk_size - chunk.count;
+            component.chunk_count++;
+            component.empty_slot_count += empty_slots;
+            component.overhead_bytes += s_chunk_size * sizeof(uint32_t);
+            if (chunk.mapped)
+            {
+                component.mapped_chunk_count++;
+                mapped_payload_bytes +=
+                    uint64_t{chunk.count} * pool.component_size;
+            }
+            else
+                component.overhead_bytes += empty_slots * pool.component_size;
+            if (chunk.committed != nullptr)
+                component.overhead_bytes += s_chunk_size * pool.component_size;
+        }
+
+        ret.component_payload_bytes += component.payload_bytes;
+        ret.component_overhead_bytes += component.overhead_bytes;
+        ret.components.push_back(component);
+    }
+
+    ret.total_bytes = ret.mask_table_bytes + ret.entity_table_bytes +
+                      ret.hierarchy_bytes + ret.component_payload_bytes -
+                      mapped_payload_bytes + ret.component_overhead_bytes +
+                      m_component_pools.capacity() * sizeof(ComponentPool);
+
+    return ret;
+}
+
+bool ComponentStorage::compact(std::chrono::nanoseconds budget)
+{
+    if (!freeEmptyChunks(budget))
+        return false;
+
+    trimEntityTables(0);
+    if (m_trace_recorder != nullptr)
+        m_trace_recorder->recordCompact(m_entity_generations.size());
+
+    return true;
+}
+
+bool ComponentStorage::freeEmptyChunks(std::chrono::nanoseconds budget)
+{
+    auto const start = std::chrono::steady_clock::now();
+    // Checking the clock costs more than freeing a chunk
+    uint64_t const chunks_per_clock_check = 64;
+    uint64_t chunks_since_check = 0;
+
+    for (; m_compact_pool < m_component_pools.size(); ++m_compact_pool)
+    {
+        ComponentPool &pool = m_component_pools[m_compact_pool];
+        for (; m_compact_chunk < pool.chunks.size(); ++m_compact_chunk)
+        {
+            if (++chunks_since_check == chunks_per_clock_check)
+            {
+                chunks_since_check = 0;
+                if (std::chrono::steady_clock::now() - start >= budget)
+                    return false;
+            }
+
+            ComponentChunk &chunk = pool.chunks[m_compact_chunk];
+            if (chunk.data != nullptr && chunk.count == 0)
+                freeChunk(pool, chunk);
+        }
+        m_compact_chunk = 0;
+
+        while (!pool.chunks.empty() && pool.chunks.back().data == nullptr)
+            pool.chunks.pop_back();
+        pool.chunks.shrink_to_fit();
+        pool.presence.shrinkToFit();
+    }
+    m_compact_pool = 0;
+
+    return true;
+}
+
+void ComponentStorage::setTraceRecorder(TraceRecorder *recorder)
+{
+    m_trace_recorder = recorder;
+}
+
+void ComponentStorage::flushObservers()
+{
+    assert(!m_flushing_observers && "Observers can't flush");
+    m_flushing_observers = true;
+
+    auto const deliver = [](std::vector<EntityId> &buffer,
+                            std::vector<ObserverFunc> const &observers,
+                            std::vector<EntityId> &batch)
+    {
+        if (buffer.empty())
+            return false;
+
+        // Observers can buffer more events while the batch is delivered
+        batch.swap(buffer);
+        for (ObserverFunc const &observer : observers)
+            observer(batch);
+        batch.clear();
+        return true;
+    };
+
+    std::vector<EntityId> batch;
+    bool delivered = true;
+    while (delivered)
+    {
+        delivered = false;
+        for (ComponentObservers &observers : m_observers)
+        {
+            delivered |= deliver(observers.added, observers.on_add, batch);
+            delivered |=
+                deliver(observers.removed, observers.on_remove, batch);
+        }
+    }
+
+    m_flushing_observers = false;
+}
+
+ComponentStorage::ComponentObservers &ComponentStorage::getObservers(
+    uint64_t type_id)
+{
+    if (m_observers.size() <= type_id)
+        m_observers.resize(type_id + 1);
+    return m_observers[type_id];
+}
+
+void ComponentStorage::markHierarchyChanged()
+{
+    m_hierarchy_dirty = true;
+    m_hierarchy_changed_tick = m_change_tick;
+}
+
+void ComponentStorage::updatePresence(uint64_t begin, uint64_t end)
+{
+    assert(end <= m_entity_component_masks.size());
+
+    uint64_t const pool_count = m_component_pools.size();
+    for (uint64_t index = begin; index < end; ++index)
+    {
+        ComponentMask const &mask = m_entity_component_masks[index];
+        for (uint64_t type_id = 0; type_id < pool_count; ++type_id)
+        {
+            HierarchicalBitset &presence = m_component_pools[type_id].presence;
+            if (mask.test(type_id))
+                presence.set(index);
+            else
+                presence.reset(index);
+        }
+    }
+}
+
+void ComponentStorage::trimEntityTables(uint64_t min_count)
+{
+    uint64_t entity_count = m_entity_generations.size();
+    // Retired slots are kept so that their generations can't be reused
+    while (entity_count > min_count && !m_entity_alive[entity_count - 1] &&
+           m_entity_generations[entity_count - 1] <= EntityId::s_max_generation)
+    {
+        entity_count--;
+        m_generation_floor = std::max(
+            m_generation_floor, m_entity_generations[entity_count]);
+    }
+
+    if (entity_count < m_entity_generations.size())
+    {
+        std::erase_if(
+            m_entity_freelist,
+            [entity_count](uint64_t index) { return index >= entity_count; });
+        m_freelist_changed_tick = m_change_tick;
+
+        m_entity_generations.resize(entity_count);
+        m_entity_alive.resize(entity_count);
+        m_entity_component_masks.resize(entity_count);
+        m_entity_changed_ticks.resize(entity_count);
+        for (ComponentPool &pool : m_component_pools)
+            pool.presence.truncate(entity_count);
+        if (m_hierarchy_nodes.size() > entity_count)
+        {
+            m_hierarchy_nodes.resize(entity_count);
+            markHierarchyChanged();
+        }
+
+        uint64_t const block_count =
+            (entity_count + s_chunk_size - 1) / s_chunk_size;
+        m_entity_block_ticks.resize(block_count);
+        // The last block lost its tail so it doesn't match snapshots anymore
+        if (entity_count % s_chunk_size != 0)
+            m_entity_block_ticks.back() = m_change_tick;
+    }
+
+    m_entity_generations.shrink_to_fit();
+    m_entity_alive.shrink_to_fit();
+    m_entity_component_masks.shrink_to_fit();
+    m_entity_changed_ticks.shrink_to_fit();
+    m_entity_block_ticks.shrink_to_fit();
+    m_entity_freelist.shrink_to_fit();
+    m_hierarchy_nodes.shrink_to_fit();
+}
+
+void ComponentStorage::traceAddComponent(EntityId id, uint64_t type_id)
+{
+    assert(m_trace_recorder != nullptr);
+    assert(type_id < m_component_pools.size());
+
+    ComponentPool const &pool = m_component_pools[type_id];
+    m_trace_recorder->recordAddComponent(
+        id.index(), type_id, pool.component_size, pool.component_alignment);
+}
+
+void ComponentStorage::traceRemoveComponent(EntityId id, uint64_t type_id)
+{
+    assert(m_trace_recorder != nullptr);
+
+    if (isValid(id) && m_entity_component_masks[id.index()].test(type_id))
+        m_trace_recorder->recordRemoveComponent(id.index(), type_id);
+}
+
+void ComponentStorage::detachFromParent(uint64_t index)
+{
+    assert(index < m_hierarchy_nodes.size());
+
+    HierarchyNode &node = m_hierarchy_nodes[index];
+    if (node.parent == HierarchyNode::s_null)
+        return;
+
+    if (node.prev_sibling != HierarchyNode::s_null)
+        m_hierarchy_nodes[node.prev_sibling].next_sibling = node.next_sibling;
+    else
+        m_hierarchy_nodes[node.parent].first_child = node.next_sibling;
+    if (node.next_sibling != HierarchyNode::s_null)
+        m_hierarchy_nodes[node.next_sibling].prev_sibling = node.prev_sibling;
+
+    node.parent = HierarchyNode::s_null;
+    node.next_sibling = HierarchyNode::s_null;
+    node.prev_sibling = HierarchyNode::s_null;
+
+    markHierarchyChanged();
+}
+
+void ComponentStorage::detachChildren(uint64_t index)
+{
+    assert(index < m_hierarchy_nodes.size());
+
+    HierarchyNode &node = m_hierarchy_nodes[index];
+    if (node.first_child == HierarchyNode::s_null)
+        return;
+
+    uint64_t child = node.first_child;
+    while (child != HierarchyNode::s_null)
+    {
+        HierarchyNode &child_node = m_hierarchy_nodes[child];
+        child = child_node.next_sibling;
+        child_node.parent = HierarchyNode::s_null;
+        child_node.next_sibling = HierarchyNode::s_null;
+        child_node.prev_sibling = HierarchyNode::s_null;
+    }
+    node.first_child = HierarchyNode::s_null;
+
+    markHierarchyChanged();
 }
 
 } // namespace recs
@@ -0,0 +1,339 @@
+#include "recs/component_storage.hpp"
+
+#include "byte_stream.hpp"
+#include "recs/type_registry.hpp"
+#include <algorithm>
+
+namespace recs
+{
+
+namespace
+{
+
+// "RDLT" when read as little endian
+uint32_t const s_delta_magic = 0x544c'4452;
+uint32_t const s_delta_version = 1;
+
+// Layout, with integers as LEB128 varints unless noted:
+//   magic u32, version u32
+//   since tick, tick, entity count
+//   type count, per type: stable id u64, component size
+//   entity record count, per record:
+//     index delta to previous record, generation, alive u8,
+//     component type count, type table indices
+//   has freelist u8, if set: count, indices
+//   per type in the type table:
+//     component count, per component: index delta to previous, value bytes
+
+} // namespace
+
+bool ComponentStorage::writeDelta(
+    uint32_t since_tick, std::vector<uint8_t> &out) const
+{
+    std::vector<uint64_t> type_ids;
+    std::vector<uint64_t> stable_ids;
+    // Indexed by type id
+    std::vector<uint64_t> table_indices(m_component_pools.size());
+    for (uint64_t type_id = 0; type_id < m_component_pools.size(); ++type_id)
+    {
+        if (m_component_pools[type_id].count == 0)
+            continue;
+
+        uint64_t const stable_id = TypeRegistry::stableId(type_id);
+        if (stable_id == TypeRegistry::s_invalid_id)
+            return false;
+
+        table_indices[type_id] = type_ids.size();
+        type_ids.push_back(type_id);
+        stable_ids.push_back(stable_id);
+    }
+
+    writeBytes(out, &s_delta_magic, sizeof(s_delta_magic));
+    writeBytes(out, &s_delta_version, sizeof(s_delta_version));
+    writeVarint(out, since_tick);
+    writeVarint(out, m_change_tick);
+
+    uint64_t const entity_count = m_entity_generations.size();
+    writeVarint(out, entity_count);
+
+    writeVarint(out, type_ids.size());
+    for (size_t i = 0; i < type_ids.size(); ++i)
+    {
+        writeBytes(out, &stable_ids[i], sizeof(uint64_t));
+        writeVarint(out, m_component_pools[type_ids[i]].component_size);
+    }
+
+    // Block ticks can't be used to skip unchanged entities as restoring a
+    // snapshot rolls them back but scanning the per entity ticks is cheap
+    std::vector<uint64_t> changed_entities;
+    for (uint64_t index = 0; index < entity_count; ++index)
+    {
+        if (m_entity_changed_ticks[index] >= since_tick)
+            changed_entities.push_back(index);
+    }
+
+    writeVarint(out, changed_entities.size());
+    uint64_t previous_index = 0;
+    for (uint64_t const index : changed_entities)
+    {
+        writeVarint(out, index - previous_index);
+        previous_index = index;
+
+        writeVarint(out, m_entity_generations[index]);
+        bool const alive = m_entity_alive[index];
+        out.push_back(alive ? 1 : 0);
+
+        ComponentMask const &mask = m_entity_component_masks[index];
+        uint64_t const component_count = mask.count();
+        writeVarint(out, component_count);
+        for (uint64_t type_id = 0, written = 0; written < component_count;
+             ++type_id)
+        {
+            if (mask.test(type_id))
+            {
+                writeVarint(out, table_indices[type_id]);
+                written++;
+            }
+        }
+    }
+
+    bool const freelist_changed = m_freelist_changed_tick >= since_tick;
+    out.push_back(freelist_changed ? 1 : 0);
+    if (freelist_changed)
+    {
+        writeVarint(out, m_entity_freelist.size());
+        for (uint64_t const index : m_entity_freelist)
+            writeVarint(out, index);
+    }
+
+    std::vector<uint64_t> changed_components;
+    for (uint64_t const type_id : type_ids)
+    {
+        ComponentPool const &pool = m_component_pools[type_id];
+
+        changed_components.clear();
+        for (uint64_t c = 0; c < pool.chunks.size(); ++c)
+        {
+            ComponentChunk const &chunk = pool.chunks[c];
+            if (chunk.count == 0)
+                continue;
+
+            uint64_t const begin = c * s_chunk_size;
+            uint64_t const end =
+                std::min<uint64_t>(begin + s_chunk_size, entity_count);
+            for (uint64_t index = begin; index < end; ++index)
+            {
+                // Removed components can have newer ticks
+                if (chunk.changed_ticks[index - begin] >= since_tick &&
+                    m_entity_component_masks[index].test(type_id))
+                    changed_components.push_back(index);
+            }
+        }
+
+        writeVarint(out, changed_components.size());
+        previous_index = 0;
+        for (uint64_t const index : changed_components)
+        {
+            writeVarint(out, index - previous_index);
+            previous_index = index;
+
+            ComponentChunk const &chunk = pool.chunks[index / s_chunk_size];
+            writeBytes(
+                out,
+                chunk.data + (index % s_chunk_size) * pool.component_size,
+                pool.component_size);
+        }
+    }
+
+    return true;
+}
+
+bool ComponentStorage::applyDelta(std::span<uint8_t const> delta)
+{
+    ByteReader reader{delta};
+
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    if (!reader.readBytes(&magic, sizeof(magic)) ||
+        !reader.readBytes(&version, sizeof(version)) ||
+        magic != s_delta_magic || version != s_delta_version)
+        return false;
+
+    uint64_t since_tick = 0;
+    uint64_t tick = 0;
+    uint64_t entity_count = 0;
+    uint64_t type_count = 0;
+    if (!reader.readVarint(since_tick) || !reader.readVarint(tick) ||
+        !reader.readVarint(entity_count) || !reader.readVarint(type_count) ||
+        entity_count > EntityId::s_max_index + 1 ||
+        type_count > TypeId::s_max_component_type_count)
+        return false;
+
+    std::vector<TypeRegistry::TypeInfo const *> type_infos;
+    std::vector<uint64_t> type_ids;
+    for (uint64_t i = 0; i < type_count; ++i)
+    {
+        uint64_t stable_id = 0;
+        uint64_t component_size = 0;
+        if (!reader.readBytes(&stable_id, sizeof(stable_id)) ||
+            !reader.readVarint(component_size))
+            return false;
+
+        uint64_t const type_id = TypeRegistry::typeId(stable_id);
+        TypeRegistry::TypeInfo const *type_info = TypeRegistry::info(type_id);
+        if (type_info == nullptr || type_info->size != component_size)
+            return false;
+
+        type_infos.push_back(type_info);
+        type_ids.push_back(type_id);
+    }
+
+    // Slots that the source has trimmed with compact() only held removed
+    // entities. The tables are not trimmed here as the ids handed out by this
+    // storage don't continue from the source's generation floor.
+    for (uint64_t index = entity_count; index < m_entity_generations.size();
+         ++index)
+    {
+        if (m_entity_alive[index])
+            removeEntity(EntityId{index, m_entity_generations[index]});
+    }
+
+    while (m_entity_generations.size() < entity_count)
+    {
+        m_entity_generations.push_back(0);
+        m_entity_alive.push_back(false);
+        m_entity_component_masks.emplace_back();
+        m_entity_changed_ticks.push_back(m_change_tick);
+        markEntityChanged(m_entity_generations.size() - 1);
+    }
+
+    uint64_t record_count = 0;
+    if (!reader.readVarint(record_count) || record_count > entity_count)
+        return false;
+
+    uint64_t index = 0;
+    for (uint64_t r = 0; r < record_count; ++r)
+    {
+        uint64_t index_delta = 0;
+        uint64_t generation = 0;
+        uint8_t alive = 0;
+        uint64_t component_count = 0;
+        if (!reader.readVarint(index_delta) || !reader.readVarint(generation) ||
+            !reader.readBytes(&alive, sizeof(alive)) ||
+            !reader.readVarint(component_count) ||
+            index_delta >= entity_count - index ||
+            generation > EntityId::s_max_generation + 1 ||
+            component_count > type_count)
+            return false;
+        // Only retired slots are past the max generation
+        if (alive != 0 && generation > EntityId::s_max_generation)
+            return false;
+        index += index_delta;
+
+        ComponentMask mask;
+        for (uint64_t c = 0; c < component_count; ++c)
+        {
+            uint64_t table_index = 0;
+            if (!reader.readVarint(table_index) || table_index >= type_count)
+                return false;
+            mask.set(type_ids[table_index]);
+        }
+        if (alive == 0 && mask.any())
+            return false;
+
+        // Release what's no longer there through the old handle
+        if (m_entity_alive[index])
+        {
+            EntityId const old_id{index, m_entity_generations[index]};
+            ComponentMask const removed =
+                m_entity_component_masks[index] & ~mask;
+            for (uint64_t type_id = 0; type_id < removed.size(); ++type_id)
+            {
+                if (removed.test(type_id))
+                    releaseComponent(old_id, type_id);
+            }
+
+            if (alive == 0 && index < m_hierarchy_nodes.size())
+            {
+                detachFromParent(index);
+                detachChildren(index);
+            }
+        }
+        else
+            assert(m_entity_component_masks[index].none());
+
+        m_entity_generations[index] = static_cast<uint16_t>(generation);
+        m_entity_alive[index] = alive != 0;
+        markEntityChanged(index);
+        // Dead slots can't hold components and retired ones have no valid id
+        if (alive == 0)
+            continue;
+
+        // Values for added components follow in the component section
+        ComponentMask const added = mask & ~m_entity_component_masks[index];
+        EntityId const id{index, m_entity_generations[index]};
+        for (size_t i = 0; i < type_ids.size(); ++i)
+        {
+            if (added.test(type_ids[i]))
+                (void)allocateComponent(
+                    id, type_ids[i], type_infos[i]->size,
+                    type_infos[i]->alignment);
+        }
+    }
+
+    uint8_t has_freelist = 0;
+    if (!reader.readBytes(&has_freelist, sizeof(has_freelist)))
+        return false;
+    if (has_freelist != 0)
+    {
+        uint64_t freelist_count = 0;
+        if (!reader.readVarint(freelist_count) ||
+            freelist_count > entity_count)
+            return false;
+
+        m_entity_freelist.clear();
+        for (uint64_t i = 0; i < freelist_count; ++i)
+        {
+            uint64_t free_index = 0;
+            if (!reader.readVarint(free_index) || free_index >= entity_count)
+                return false;
+            m_entity_freelist.push_back(free_index);
+        }
+        m_freelist_changed_tick = m_change_tick;
+    }
+
+    for (size_t i = 0; i < type_ids.size(); ++i)
+    {
+        uint64_t const type_id = type_ids[i];
+        uint64_t component_count = 0;
+        if (!reader.readVarint(component_count) ||
+            component_count > entity_count)
+            return false;
+
+        index = 0;
+        for (uint64_t c = 0; c < component_count; ++c)
+        {
+            uint64_t index_delta = 0;
+            if (!reader.readVarint(index_delta) ||
+                index_delta >= entity_count - index)
+                return false;
+            index += index_delta;
+
+            if (!m_entity_component_masks[index].test(type_id))
+                return false;
+
+            ComponentPool const &pool = m_component_pools[type_id];
+            ComponentChunk const &chunk = pool.chunks[index / s_chunk_size];
+            uint64_t const slot = index % s_chunk_size;
+            if (!reader.readBytes(
+                    chunk.data + slot * pool.component_size,
+                    pool.component_size))
+                return false;
+            markComponentChanged(chunk, slot);
+        }
+    }
+
+    return reader.done();
+}
+
+} // namespace recs
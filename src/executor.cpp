@@ -0,0 +1,111 @@
+#include "recs/executor.hpp"
+
+#include "recs/thread_pool.hpp"
+#include <cassert>
+
+namespace recs
+{
+
+void Executor::submitTo(uint32_t worker, std::function<void()> &&task)
+{
+    (void)worker;
+    submit(std::move(task));
+}
+
+uint32_t Executor::currentThread() const { return s_unknown_thread; }
+
+void SerialExecutor::submit(std::function<void()> &&task)
+{
+    assert(task);
+    m_tasks.push_back(std::move(task));
+}
+
+void SerialExecutor::submitToWaiter(std::function<void()> &&task)
+{
+    // The waiter runs all tasks
+    submit(std::move(task));
+}
+
+void SerialExecutor::wait(std::atomic<uint32_t> &counter)
+{
+    while (counter.load(std::memory_order_relaxed) > 0)
+    {
+        assert(!m_tasks.empty() && "Waiting on tasks that weren't submitted");
+
+        std::function<void()> const task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+        task();
+    }
+}
+
+void SerialExecutor::decrement(std::atomic<uint32_t> &counter)
+{
+    assert(counter.load(std::memory_order_relaxed) > 0);
+    counter.fetch_sub(1, std::memory_order_relaxed);
+}
+
+PoolExecutor::PoolExecutor(ThreadPool &pool)
+: m_pool{pool}
+{
+}
+
+void PoolExecutor::submit(std::function<void()> &&task)
+{
+    m_pool.submit(std::move(task));
+}
+
+void PoolExecutor::submitTo(uint32_t worker, std::function<void()> &&task)
+{
+    m_pool.submit(worker, std::move(task));
+}
+
+void PoolExecutor::submitToWaiter(std::function<void()> &&task)
+{
+    assert(task);
+    {
+        std::lock_guard const lock{m_mutex};
+        m_waiter_tasks.push_back(std::move(task));
+    }
+    m_changed.notify_all();
+}
+
+void PoolExecutor::wait(std::atomic<uint32_t> &counter)
+{
+    std::unique_lock lock{m_mutex};
+    while (true)
+    {
+        m_changed.wait(
+            lock,
+            [&]
+            {
+                return counter.load(std::memory_order_acquire) == 0 ||
+                       !m_waiter_tasks.empty();
+            });
+        if (m_waiter_tasks.empty())
+            return;
+
+        std::function<void()> const task = std::move(m_waiter_tasks.front());
+        m_waiter_tasks.pop_front();
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
+
+void PoolExecutor::decrement(std::atomic<uint32_t> &counter)
+{
+    // Decrement under the lock so that the waiter can only see 0 after this
+    // has released it
+    std::lock_guard const lock{m_mutex};
+    uint32_t const previous = counter.fetch_sub(1, std::memory_order_acq_rel);
+    assert(previous > 0);
+    if (previous == 1)
+        m_changed.notify_all();
+}
+
+uint32_t PoolExecutor::currentThread() const
+{
+    return ThreadPool::currentWorkerIndex();
+}
+
+} // namespace recs
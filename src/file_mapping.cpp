@@ -0,0 +1,116 @@
+#include "recs/file_mapping.hpp"
+
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else // !_WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _WIN32
+
+namespace recs
+{
+
+FileMapping::~FileMapping() { close(); }
+
+FileMapping::FileMapping(FileMapping &&other) noexcept
+: m_data{std::exchange(other.m_data, nullptr)}
+, m_size{std::exchange(other.m_size, 0)}
+{
+}
+
+FileMapping &FileMapping::operator=(FileMapping &&other) noexcept
+{
+    if (this != &other)
+    {
+        close();
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+    }
+    return *this;
+}
+
+bool FileMapping::open(std::filesystem::path const &path)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE const file = CreateFileW(
+        path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE const mapping =
+        CreateFileMappingW(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (mapping == nullptr)
+        return false;
+
+    void *const data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    // The view keeps the mapping alive
+    CloseHandle(mapping);
+    if (data == nullptr)
+        return false;
+
+    m_data = static_cast<uint8_t *>(data);
+    m_size = static_cast<size_t>(size.QuadPart);
+#else  // !_WIN32
+    int const fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    size_t const size = static_cast<size_t>(st.st_size);
+    void *const data =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    // The mapping keeps the file alive
+    ::close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    m_data = static_cast<uint8_t *>(data);
+    m_size = size;
+#endif // _WIN32
+
+    return true;
+}
+
+void FileMapping::close()
+{
+    if (m_data == nullptr)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(m_data);
+#else  // !_WIN32
+    munmap(m_data, m_size);
+#endif // _WIN32
+
+    m_data = nullptr;
+    m_size = 0;
+}
+
+uint8_t *FileMapping::data() const { return m_data; }
+
+size_t FileMapping::size() const { return m_size; }
+
+} // namespace recs
@@ -0,0 +1,98 @@
+#include "recs/hierarchical_bitset.hpp"
+
+namespace recs
+{
+
+void HierarchicalBitset::set(uint64_t index)
+{
+    uint64_t const word = index / 64;
+    if (m_words.size() <= word)
+    {
+        m_words.resize(word + 1, 0);
+        m_summary.resize(word / 64 + 1, 0);
+    }
+
+    m_words[word] |= 1ull << (index % 64);
+    m_summary[word / 64] |= 1ull << (word % 64);
+}
+
+void HierarchicalBitset::reset(uint64_t index)
+{
+    uint64_t const word = index / 64;
+    if (m_words.size() <= word)
+        return;
+
+    m_words[word] &= ~(1ull << (index % 64));
+    if (m_words[word] == 0)
+        m_summary[word / 64] &= ~(1ull << (word % 64));
+}
+
+bool HierarchicalBitset::test(uint64_t index) const
+{
+    uint64_t const word = index / 64;
+    if (m_words.size() <= word)
+        return false;
+
+    return (m_words[word] & (1ull << (index % 64))) != 0;
+}
+
+void HierarchicalBitset::clear()
+{
+    m_words.clear();
+    m_summary.clear();
+}
+
+void HierarchicalBitset::truncate(uint64_t index)
+{
+    uint64_t const word = index / 64;
+    if (m_words.size() <= word)
+        return;
+
+    uint64_t const bit = index % 64;
+    if (bit != 0)
+    {
+        m_words[word] &= (1ull << bit) - 1;
+        if (m_words[word] == 0)
+            m_summary[word / 64] &= ~(1ull << (word % 64));
+    }
+    m_words.resize(bit != 0 ? word + 1 : word);
+
+    // Drop trailing empty words so that the sizes stay minimal
+    while (!m_words.empty() && m_words.back() == 0)
+        m_words.pop_back();
+
+    uint64_t const word_count = m_words.size();
+    m_summary.resize((word_count + 63) / 64);
+    if (word_count % 64 != 0)
+        m_summary.back() &= (1ull << (word_count % 64)) - 1;
+}
+
+void HierarchicalBitset::reserve(uint64_t count)
+{
+    uint64_t const word_count = (count + 63) / 64;
+    m_words.reserve(word_count);
+    m_summary.reserve((word_count + 63) / 64);
+}
+
+void HierarchicalBitset::shrinkToFit()
+{
+    m_words.shrink_to_fit();
+    m_summary.shrink_to_fit();
+}
+
+std::span<uint64_t const> HierarchicalBitset::words() const
+{
+    return m_words;
+}
+
+std::span<uint64_t const> HierarchicalBitset::summary() const
+{
+    return m_summary;
+}
+
+uint64_t HierarchicalBitset::allocatedBytes() const
+{
+    return (m_words.capacity() + m_summary.capacity()) * sizeof(uint64_t);
+}
+
+} // namespace recs
@@ -0,0 +1,171 @@
+#include "recs/profiler.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+namespace recs
+{
+
+namespace
+{
+
+void writeJsonString(std::ostream &out, std::string const &str)
+{
+    out << '"';
+    for (char const c : str)
+    {
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20)
+            out << ' ';
+        else
+            out << c;
+    }
+    out << '"';
+}
+
+// Trace timestamps are in microseconds. Written with a fixed nanosecond
+// fraction as the default stream precision would round whole timestamps.
+std::string toUs(uint64_t ns)
+{
+    char buffer[32];
+    (void)std::snprintf(
+        buffer, sizeof(buffer), "%llu.%03llu",
+        static_cast<unsigned long long>(ns / 1000),
+        static_cast<unsigned long long>(ns % 1000));
+    return buffer;
+}
+
+uint32_t traceThreadId(uint32_t thread)
+{
+    return thread == Profiler::s_calling_thread ? 0 : thread + 1;
+}
+
+} // namespace
+
+Profiler::Profiler(size_t frame_capacity)
+: m_frames(frame_capacity)
+{
+    assert(frame_capacity > 0);
+}
+
+void Profiler::setEnabled(bool enabled) { m_enabled = enabled; }
+
+bool Profiler::enabled() const { return m_enabled; }
+
+size_t Profiler::frameCount() const { return m_frame_count; }
+
+Profiler::FrameSample const &Profiler::frame(size_t index) const
+{
+    assert(index < m_frame_count);
+    return m_frames[(m_first_frame + index) % m_frames.size()];
+}
+
+void Profiler::clear()
+{
+    m_first_frame = 0;
+    m_frame_count = 0;
+}
+
+void Profiler::writeChromeTrace(std::ostream &out) const
+{
+    out << "{\"traceEvents\":[\n";
+
+    bool first = true;
+    auto const separate = [&]
+    {
+        if (!first)
+            out << ",\n";
+        first = false;
+    };
+
+    separate();
+    out << R"({"name":"thread_name","ph":"M","pid":0,"tid":0,)"
+        << R"("args":{"name":"Calling thread"}})";
+    uint32_t max_thread = 0;
+    for (size_t i = 0; i < m_frame_count; ++i)
+    {
+        for (SystemSample const &system : frame(i).systems)
+            max_thread = std::max(max_thread, traceThreadId(system.thread));
+    }
+    for (uint32_t tid = 1; tid <= max_thread; ++tid)
+    {
+        separate();
+        out << R"({"name":"thread_name","ph":"M","pid":0,"tid":)" << tid
+            << R"(,"args":{"name":"Worker )" << tid - 1 << "\"}}";
+    }
+
+    for (size_t i = 0; i < m_frame_count; ++i)
+    {
+        FrameSample const &frame_sample = frame(i);
+
+        separate();
+        out << R"({"name":"Frame )" << frame_sample.frame
+            << R"(","cat":"frame","ph":"X","pid":0,"tid":0,"ts":)"
+            << toUs(frame_sample.start_ns)
+            << ",\"dur\":" << toUs(frame_sample.end_ns - frame_sample.start_ns)
+            << "}";
+
+        for (SystemSample const &system : frame_sample.systems)
+        {
+            separate();
+            out << "{\"name\":";
+            writeJsonString(out, system.name);
+            out << R"(,"cat":"system","ph":"X","pid":0,"tid":)"
+                << traceThreadId(system.thread)
+                << ",\"ts\":" << toUs(system.start_ns)
+                << ",\"dur\":" << toUs(system.end_ns - system.start_ns)
+                << R"(,"args":{"frame":)" << frame_sample.frame
+                << R"(,"entities":)" << system.entity_count
+                << R"(,"queue_wait_us":)" << toUs(system.queue_wait_ns)
+                << "}}";
+        }
+    }
+
+    out << "\n]}\n";
+}
+
+bool Profiler::exportChromeTrace(std::filesystem::path const &path) const
+{
+    std::ofstream file{path, std::ios::binary};
+    if (!file.is_open())
+        return false;
+
+    writeChromeTrace(file);
+    return file.good();
+}
+
+uint64_t Profiler::now()
+{
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+}
+
+Profiler::FrameSample &Profiler::beginFrame(size_t system_count)
+{
+    size_t slot = 0;
+    if (m_frame_count < m_frames.size())
+        slot = (m_first_frame + m_frame_count++) % m_frames.size();
+    else
+    {
+        slot = m_first_frame;
+        m_first_frame = (m_first_frame + 1) % m_frames.size();
+    }
+
+    // Reuses the name strings of previous frames so this doesn't allocate
+    // once the buffer has wrapped around with the same schedule
+    FrameSample &frame_sample = m_frames[slot];
+    frame_sample.frame = m_next_frame++;
+    frame_sample.start_ns = now();
+    frame_sample.end_ns = frame_sample.start_ns;
+    frame_sample.systems.resize(system_count);
+
+    return frame_sample;
+}
+
+} // namespace recs
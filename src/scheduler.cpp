@@ -1,5 +1,15 @@
 #include "recs/scheduler.hpp"
 
+#include "recs/executor.hpp"
+#include "recs/profiler.hpp"
+#include "recs/thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+
 namespace recs
 {
 
@@ -31,6 +41,93 @@ SystemRef const &SystemRef::executeAfter(SystemRef dependency) const
     return *this;
 }
 
+SystemRef const &SystemRef::setCost(uint64_t cost_ns) const
+{
+    assert(m_scheduler != nullptr);
+    assert(m_index < m_scheduler->m_systems.size());
+
+    m_scheduler->m_systems[m_index].cost_ns = cost_ns;
+
+    return *this;
+}
+
+SystemRef const &SystemRef::runIf(std::function<bool()> condition) const
+{
+    assert(m_scheduler != nullptr);
+    assert(m_index < m_scheduler->m_systems.size());
+
+    m_scheduler->m_systems[m_index].condition = std::move(condition);
+
+    return *this;
+}
+
+SystemRef const &SystemRef::runIfMatches() const
+{
+    assert(m_scheduler != nullptr);
+    assert(m_index < m_scheduler->m_systems.size());
+
+    m_scheduler->m_systems[m_index].require_matches = true;
+
+    return *this;
+}
+
+SystemRef const &SystemRef::pipeline() const
+{
+    assert(m_scheduler != nullptr);
+    assert(m_index < m_scheduler->m_systems.size());
+
+    m_scheduler->m_systems[m_index].pipelined = true;
+
+    return *this;
+}
+
+SystemRef const &SystemRef::setPriority(SystemPriority priority) const
+{
+    assert(m_scheduler != nullptr);
+    assert(m_index < m_scheduler->m_systems.size());
+
+    m_scheduler->m_systems[m_index].priority_class = priority;
+
+    return *this;
+}
+
+SystemRef const &SystemRef::runOnMainThread() const
+{
+    assert(m_scheduler != nullptr);
+    assert(m_index < m_scheduler->m_systems.size());
+    assert(!m_scheduler->m_systems[m_index].worker.has_value());
+
+    m_scheduler->m_systems[m_index].main_thread = true;
+
+    return *this;
+}
+
+SystemRef const &SystemRef::pinToWorker(uint32_t worker) const
+{
+    assert(m_scheduler != nullptr);
+    assert(m_index < m_scheduler->m_systems.size());
+    assert(!m_scheduler->m_systems[m_index].main_thread);
+
+    m_scheduler->m_systems[m_index].worker = worker;
+
+    return *this;
+}
+
+SystemRef const &SystemRef::timeSlice(
+    size_t max_entities, std::chrono::microseconds max_time) const
+{
+    assert(m_scheduler != nullptr);
+    assert(m_index < m_scheduler->m_systems.size());
+    assert(max_entities > 0);
+
+    Scheduler::System &system = m_scheduler->m_systems[m_index];
+    assert(system.slice_func && "Coroutine systems can't be time sliced");
+    system.slice_entities = max_entities;
+    system.slice_time = max_time;
+
+    return *this;
+}
+
 bool SystemRef::operator==(SystemRef other) const
 {
     return m_scheduler == other.m_scheduler && m_index == other.m_index;
@@ -41,15 +138,607 @@ bool SystemRef::operator!=(SystemRef other) const
     return m_scheduler != other.m_scheduler || m_index != other.m_index;
 }
 
-Schedule::Schedule(std::vector<SystemFunc> &&systems)
+Schedule::Schedule(
+    std::vector<System> &&systems, ComponentMask const &double_buffered,
+    std::vector<ComponentMask> &&query_masks,
+    std::vector<size_t> &&system_queries,
+    std::vector<size_t> &&schedule_indices)
 : m_systems{std::move(systems)}
+, m_double_buffered{double_buffered}
+, m_query_masks{std::move(query_masks)}
+, m_system_queries{std::move(system_queries)}
+, m_schedule_indices{std::move(schedule_indices)}
+{
+    for (size_t i = 0; i < m_systems.size(); ++i)
+    {
+        if (m_systems[i].dependency_count == 0)
+            m_roots.push_back(i);
+    }
+    updatePriorities();
+}
+
+Schedule::~Schedule()
+{
+    assert(m_pipelined_frame == nullptr && "Pipelined frame in flight");
+}
+
+Schedule::Schedule(Schedule &&) = default;
+
+Schedule &Schedule::operator=(Schedule &&) = default;
+
+size_t Schedule::queryCount() const { return m_query_masks.size(); }
+
+void Schedule::setEnabled(SystemRef system, bool enabled)
+{
+    assert(system.m_index < m_schedule_indices.size());
+    m_systems[m_schedule_indices[system.m_index]].enabled = enabled;
+}
+
+bool Schedule::enabled(SystemRef system) const
+{
+    assert(system.m_index < m_schedule_indices.size());
+    return m_systems[m_schedule_indices[system.m_index]].enabled;
+}
+
+void Schedule::updateCosts(Profiler const &profiler)
 {
+    size_t const system_count = m_systems.size();
+    std::vector<uint64_t> totals(system_count, 0);
+    uint64_t frame_count = 0;
+    for (size_t f = 0; f < profiler.frameCount(); ++f)
+    {
+        Profiler::FrameSample const &frame = profiler.frame(f);
+        if (frame.systems.size() != system_count)
+            continue;
+
+        bool matches = true;
+        for (size_t i = 0; i < system_count; ++i)
+            matches = matches && frame.systems[i].name == m_systems[i].name;
+        if (!matches)
+            continue;
+
+        for (size_t i = 0; i < system_count; ++i)
+        {
+            Profiler::SystemSample const &sample = frame.systems[i];
+            totals[i] += sample.end_ns - sample.start_ns;
+        }
+        frame_count++;
+    }
+
+    if (frame_count == 0)
+        return;
+
+    for (size_t i = 0; i < system_count; ++i)
+        m_systems[i].cost_ns = totals[i] / frame_count;
+    updatePriorities();
 }
 
-void Schedule::execute(ComponentStorage const &cs) const
+uint64_t Schedule::criticalPathNs() const
 {
-    for (SystemFunc const &fn : m_systems)
-        fn(cs);
+    uint64_t path = 0;
+    for (size_t const root : m_roots)
+        path = std::max(path, m_systems[root].priority);
+    return path;
+}
+
+uint64_t Schedule::predictedMakespanNs(uint32_t thread_count) const
+{
+    assert(thread_count > 0);
+
+    size_t const system_count = m_systems.size();
+    std::vector<uint32_t> remaining_dependencies(system_count);
+    for (size_t i = 0; i < system_count; ++i)
+        remaining_dependencies[i] = m_systems[i].dependency_count;
+
+    auto const lower = std::bind_front(&Schedule::lowerPriority, this);
+    std::vector<size_t> ready = m_roots;
+    std::make_heap(ready.begin(), ready.end(), lower);
+
+    // Min heap of (end time, system) for the systems being executed
+    using Running = std::pair<uint64_t, size_t>;
+    std::vector<Running> running;
+    uint64_t time = 0;
+    while (!ready.empty() || !running.empty())
+    {
+        while (!ready.empty() && running.size() < thread_count)
+        {
+            std::pop_heap(ready.begin(), ready.end(), lower);
+            size_t const index = ready.back();
+            ready.pop_back();
+
+            running.emplace_back(time + m_systems[index].cost_ns, index);
+            std::push_heap(running.begin(), running.end(), std::greater{});
+        }
+
+        std::pop_heap(running.begin(), running.end(), std::greater{});
+        auto const [end_ns, index] = running.back();
+        running.pop_back();
+        time = end_ns;
+
+        for (size_t const dependent : m_systems[index].dependents)
+        {
+            if (--remaining_dependencies[dependent] == 0)
+            {
+                ready.push_back(dependent);
+                std::push_heap(ready.begin(), ready.end(), lower);
+            }
+        }
+    }
+
+    return time;
+}
+
+std::vector<bool> Schedule::activeSystems() const
+{
+    std::vector<bool> active(m_systems.size());
+    for (size_t i = 0; i < m_systems.size(); ++i)
+    {
+        System const &system = m_systems[i];
+        active[i] = system.enabled &&
+                    (system.condition == nullptr || system.condition());
+    }
+    return active;
+}
+
+std::vector<ComponentStorage::Range const *> Schedule::evaluateQueries(
+    ComponentStorage const &cs, ThreadPool *pool,
+    std::vector<bool> const &active,
+    std::vector<ComponentStorage::Range> &results) const
+{
+    std::vector<bool> used(m_query_masks.size(), false);
+    for (size_t i = 0; i < m_systems.size(); ++i)
+    {
+        if (!active[i])
+            continue;
+        System const &system = m_systems[i];
+        for (size_t q = 0; q < system.query_count; ++q)
+            used[m_system_queries[system.query_offset + q]] = true;
+    }
+
+    results.reserve(m_query_masks.size());
+    for (size_t q = 0; q < m_query_masks.size(); ++q)
+    {
+        ComponentMask const &mask = m_query_masks[q];
+        if (!used[q])
+            results.emplace_back(cs, std::vector<EntityId>{});
+        else if (pool != nullptr)
+            results.push_back(cs.getEntities(mask, *pool));
+        else
+            results.push_back(cs.getEntities(mask));
+    }
+
+    std::vector<ComponentStorage::Range const *> queries;
+    queries.reserve(m_system_queries.size());
+    for (size_t const query : m_system_queries)
+        queries.push_back(&results[query]);
+
+    return queries;
+}
+
+uint64_t Schedule::runSystem(
+    System const &system,
+    std::vector<ComponentStorage::Range const *> const &queries)
+{
+    std::span<ComponentStorage::Range const *const> const system_queries =
+        std::span{queries}.subspan(system.query_offset, system.query_count);
+    if (system.require_matches)
+    {
+        for (ComponentStorage::Range const *query : system_queries)
+        {
+            if (query->size() == 0)
+                return 0;
+        }
+    }
+    return system.func(system_queries);
+}
+
+void Schedule::updatePriorities()
+{
+    // Dependents are always later in the schedule. Unknown costs count as 1ns
+    // so that longer chains are still preferred.
+    for (size_t i = m_systems.size(); i > 0; --i)
+    {
+        System &system = m_systems[i - 1];
+        uint64_t dependents_priority = 0;
+        for (size_t const dependent : system.dependents)
+            dependents_priority =
+                std::max(dependents_priority, m_systems[dependent].priority);
+        system.priority =
+            std::max(system.cost_ns, uint64_t{1}) + dependents_priority;
+    }
+}
+
+bool Schedule::lowerPriority(size_t a, size_t b) const
+{
+    SystemPriority const a_class = m_systems[a].priority_class;
+    SystemPriority const b_class = m_systems[b].priority_class;
+    if (a_class != b_class)
+        return a_class < b_class;
+
+    uint64_t const a_priority = m_systems[a].priority;
+    uint64_t const b_priority = m_systems[b].priority;
+    return a_priority < b_priority || (a_priority == b_priority && a > b);
+}
+
+void Schedule::execute(ComponentStorage &cs, Profiler *profiler) const
+{
+    cs.flushObservers();
+    cs.commitDoubleBuffers(m_double_buffered);
+
+    Profiler::FrameSample *frame = nullptr;
+    if (profiler != nullptr && profiler->enabled())
+        frame = &profiler->beginFrame(m_systems.size());
+
+    std::vector<bool> const active = activeSystems();
+    std::vector<ComponentStorage::Range> results;
+    std::vector<ComponentStorage::Range const *> const queries =
+        evaluateQueries(cs, nullptr, active, results);
+
+    if (frame == nullptr)
+    {
+        for (size_t i = 0; i < m_systems.size(); ++i)
+        {
+            if (active[i])
+                (void)runSystem(m_systems[i], queries);
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < m_systems.size(); ++i)
+    {
+        System const &system = m_systems[i];
+        Profiler::SystemSample &sample = frame->systems[i];
+
+        sample.name = system.name;
+        sample.queue_wait_ns = 0;
+        sample.thread = Profiler::s_calling_thread;
+        sample.start_ns = Profiler::now();
+        sample.entity_count = active[i] ? runSystem(system, queries) : 0;
+        sample.end_ns = active[i] ? Profiler::now() : sample.start_ns;
+    }
+    frame->end_ns = Profiler::now();
+}
+
+void Schedule::execute(
+    ComponentStorage &cs, ThreadPool &pool, Profiler *profiler) const
+{
+    PoolExecutor executor{pool};
+    executeParallel(cs, executor, &pool, profiler);
+}
+
+void Schedule::execute(
+    ComponentStorage &cs, Executor &executor, Profiler *profiler) const
+{
+    executeParallel(cs, executor, nullptr, profiler);
+}
+
+// State of an execution on an Executor, shared by its tasks. Systems are
+// made ready by their last finishing dependency, which also submits a task
+// that runs the highest priority ready system. Inactive systems finish right
+// away on the thread that made them ready instead. Each system only touches
+// its own sample and the ready time it stores in queue_wait_ns is published to
+// it through the ready heap's mutex.
+struct Schedule::Frame
+{
+    Frame(
+        Schedule const &schedule, Executor &executor,
+        Profiler::FrameSample *sample, bool pipelined);
+
+    // Starts the systems that don't wait for other systems of this frame or,
+    // if it's not null, of the previous pipelined frame
+    void start(Frame *previous);
+    void makeReady(size_t index);
+    // Submits index to its thread if it has an affinity, returns false
+    // otherwise
+    [[nodiscard]] bool submitWithAffinity(size_t index);
+    // Decrements the remaining dependencies of index, making it ready if this
+    // was the last one
+    void release(size_t index);
+    // Runs the highest priority ready system
+    void runNext();
+    void run(size_t index);
+    void finish(size_t index);
+    void wait();
+
+    Schedule const &schedule;
+    Executor &executor;
+    Profiler::FrameSample *sample{nullptr};
+    bool pipelined{false};
+    std::vector<bool> active;
+    std::vector<ComponentStorage::Range> results;
+    std::vector<ComponentStorage::Range const *> queries;
+    std::unique_ptr<std::atomic<uint32_t>[]> remaining_dependencies;
+    std::atomic<uint32_t> unfinished_count{0};
+    // Guards the members after it
+    std::mutex mutex;
+    // Max heap of the systems whose dependencies have finished
+    std::vector<size_t> ready;
+    // Only tracked for pipelined frames
+    std::vector<bool> finished;
+    // Systems of next waiting for each system of this frame
+    std::vector<std::vector<size_t>> next_waiters;
+    Frame *next{nullptr};
+};
+
+Schedule::Frame::Frame(
+    Schedule const &schedule, Executor &executor,
+    Profiler::FrameSample *sample, bool pipelined)
+: schedule{schedule}
+, executor{executor}
+, sample{sample}
+, pipelined{pipelined}
+, remaining_dependencies{new std::atomic<uint32_t>[schedule.m_systems.size()]}
+, unfinished_count{static_cast<uint32_t>(schedule.m_systems.size())}
+{
+    size_t const system_count = schedule.m_systems.size();
+    ready.reserve(system_count);
+    if (pipelined)
+    {
+        finished.resize(system_count, false);
+        next_waiters.resize(system_count);
+    }
+}
+
+void Schedule::Frame::start(Frame *previous)
+{
+    std::vector<System> const &systems = schedule.m_systems;
+    size_t const system_count = systems.size();
+
+    // Guard against systems getting ready before all waits are registered
+    for (size_t i = 0; i < system_count; ++i)
+        remaining_dependencies[i].store(
+            systems[i].dependency_count + 1, std::memory_order_relaxed);
+
+    if (previous != nullptr)
+    {
+        assert(previous->pipelined);
+        assert(&previous->executor == &executor);
+
+        std::lock_guard const lock{previous->mutex};
+        previous->next = this;
+        auto const wait_for = [&](size_t system, size_t blocker)
+        {
+            if (previous->finished[blocker])
+                return;
+            previous->next_waiters[blocker].push_back(system);
+            remaining_dependencies[system].fetch_add(
+                1, std::memory_order_relaxed);
+        };
+        for (size_t i = 0; i < system_count; ++i)
+        {
+            if (!active[i])
+                continue;
+            if (systems[i].pipelined)
+            {
+                for (size_t const blocker : systems[i].frame_blockers)
+                    wait_for(i, blocker);
+            }
+            else
+            {
+                for (size_t j = 0; j < system_count; ++j)
+                    wait_for(i, j);
+            }
+        }
+    }
+
+    std::vector<size_t> startable;
+    for (size_t i = 0; i < system_count; ++i)
+    {
+        if (remaining_dependencies[i].fetch_sub(
+                1, std::memory_order_acq_rel) == 1)
+            startable.push_back(i);
+    }
+
+    // Queue all active systems before any runs so the first picks see all of
+    // them
+    auto const lower = std::bind_front(&Schedule::lowerPriority, &schedule);
+    size_t queued_count = 0;
+    std::vector<size_t> with_affinity;
+    {
+        std::lock_guard const lock{mutex};
+        for (size_t const index : startable)
+        {
+            if (!active[index])
+                continue;
+            if (sample != nullptr)
+                sample->systems[index].queue_wait_ns = Profiler::now();
+            if (systems[index].main_thread || systems[index].worker)
+            {
+                with_affinity.push_back(index);
+                continue;
+            }
+            ready.push_back(index);
+            std::push_heap(ready.begin(), ready.end(), lower);
+            queued_count++;
+        }
+    }
+    for (size_t i = 0; i < queued_count; ++i)
+        executor.submit([this] { runNext(); });
+    for (size_t const index : with_affinity)
+        (void)submitWithAffinity(index);
+    for (size_t const index : startable)
+    {
+        if (!active[index])
+            finish(index);
+    }
+}
+
+void Schedule::Frame::makeReady(size_t index)
+{
+    if (!active[index])
+    {
+        finish(index);
+        return;
+    }
+
+    if (sample != nullptr)
+        sample->systems[index].queue_wait_ns = Profiler::now();
+    if (submitWithAffinity(index))
+        return;
+
+    {
+        std::lock_guard const lock{mutex};
+        ready.push_back(index);
+        std::push_heap(
+            ready.begin(), ready.end(),
+            std::bind_front(&Schedule::lowerPriority, &schedule));
+    }
+    executor.submit([this] { runNext(); });
+}
+
+bool Schedule::Frame::submitWithAffinity(size_t index)
+{
+    System const &system = schedule.m_systems[index];
+    if (system.main_thread)
+        executor.submitToWaiter([this, index] { run(index); });
+    else if (system.worker)
+        executor.submitTo(*system.worker, [this, index] { run(index); });
+    else
+        return false;
+    return true;
+}
+
+void Schedule::Frame::release(size_t index)
+{
+    if (remaining_dependencies[index].fetch_sub(
+            1, std::memory_order_acq_rel) == 1)
+        makeReady(index);
+}
+
+void Schedule::Frame::runNext()
+{
+    size_t index = 0;
+    {
+        std::lock_guard const lock{mutex};
+        assert(!ready.empty());
+        std::pop_heap(
+            ready.begin(), ready.end(),
+            std::bind_front(&Schedule::lowerPriority, &schedule));
+        index = ready.back();
+        ready.pop_back();
+    }
+
+    run(index);
+}
+
+void Schedule::Frame::run(size_t index)
+{
+    System const &system = schedule.m_systems[index];
+    if (sample == nullptr)
+        (void)runSystem(system, queries);
+    else
+    {
+        Profiler::SystemSample &system_sample = sample->systems[index];
+        system_sample.name = system.name;
+        system_sample.thread = executor.currentThread();
+        system_sample.start_ns = Profiler::now();
+        system_sample.queue_wait_ns =
+            system_sample.start_ns - system_sample.queue_wait_ns;
+        system_sample.entity_count = runSystem(system, queries);
+        system_sample.end_ns = Profiler::now();
+    }
+
+    finish(index);
+}
+
+void Schedule::Frame::finish(size_t index)
+{
+    System const &system = schedule.m_systems[index];
+    if (sample != nullptr && !active[index])
+    {
+        Profiler::SystemSample &system_sample = sample->systems[index];
+        system_sample.name = system.name;
+        system_sample.thread = executor.currentThread();
+        system_sample.start_ns = Profiler::now();
+        system_sample.end_ns = system_sample.start_ns;
+        system_sample.queue_wait_ns = 0;
+        system_sample.entity_count = 0;
+    }
+
+    for (size_t const dependent : system.dependents)
+        release(dependent);
+
+    if (pipelined)
+    {
+        std::vector<size_t> waiters;
+        Frame *waiting_frame = nullptr;
+        {
+            std::lock_guard const lock{mutex};
+            finished[index] = true;
+            waiters.swap(next_waiters[index]);
+            waiting_frame = next;
+        }
+        for (size_t const waiter : waiters)
+            waiting_frame->release(waiter);
+    }
+
+    // The frame can be destroyed as soon as this reaches 0
+    executor.decrement(unfinished_count);
+}
+
+void Schedule::Frame::wait()
+{
+    executor.wait(unfinished_count);
+    if (sample != nullptr)
+        sample->end_ns = Profiler::now();
+}
+
+std::unique_ptr<Schedule::Frame> Schedule::startFrame(
+    ComponentStorage &cs, Executor &executor, ThreadPool *query_pool,
+    Profiler *profiler, bool pipelined, Frame *previous) const
+{
+    if (!pipelined)
+        cs.flushObservers();
+    cs.commitDoubleBuffers(m_double_buffered);
+
+    Profiler::FrameSample *sample = nullptr;
+    if (profiler != nullptr && profiler->enabled())
+        sample = &profiler->beginFrame(m_systems.size());
+
+    std::unique_ptr<Frame> frame =
+        std::make_unique<Frame>(*this, executor, sample, pipelined);
+    frame->active = activeSystems();
+    frame->queries =
+        evaluateQueries(cs, query_pool, frame->active, frame->results);
+    frame->start(previous);
+
+    return frame;
+}
+
+void Schedule::executeParallel(
+    ComponentStorage &cs, Executor &executor, ThreadPool *query_pool,
+    Profiler *profiler) const
+{
+    assert(m_pipelined_frame == nullptr && "Pipelined frame in flight");
+
+    std::unique_ptr<Frame> const frame =
+        startFrame(cs, executor, query_pool, profiler, false, nullptr);
+    frame->wait();
+}
+
+void Schedule::executePipelined(ComponentStorage &cs, Executor &executor)
+{
+    std::unique_ptr<Frame> previous = std::move(m_pipelined_frame);
+    // Committing the double buffers has to wait for the previous frame
+    if (previous != nullptr && m_double_buffered.any())
+    {
+        previous->wait();
+        previous.reset();
+    }
+
+    m_pipelined_frame =
+        startFrame(cs, executor, nullptr, nullptr, true, previous.get());
+    if (previous != nullptr)
+        previous->wait();
+}
+
+void Schedule::finishPipelined()
+{
+    if (m_pipelined_frame != nullptr)
+    {
+        m_pipelined_frame->wait();
+        m_pipelined_frame.reset();
+    }
 }
 
 Schedule Scheduler::buildSchedule()
@@ -62,6 +751,8 @@ Schedule Scheduler::buildSchedule()
     sorted_systems.reserve(system_count);
     std::vector<size_t> traversal_stack;
     std::unordered_set<size_t> seen_systems;
+    // Systems that are already in the sorted vector
+    std::unordered_set<size_t> sorted_set;
     for (size_t root_i : m_roots)
     {
         assert(!seen_systems.contains(root_i));
@@ -74,9 +765,16 @@ Schedule Scheduler::buildSchedule()
         while (!traversal_stack.empty())
         {
             size_t i = traversal_stack.back();
+            if (sorted_set.contains(i))
+            {
+                // Pushed again through another path before it was visited
+                traversal_stack.pop_back();
+                continue;
+            }
             if (seen_systems.contains(i))
             {
                 sorted_systems.push_back(i);
+                sorted_set.insert(i);
                 traversal_stack.pop_back();
                 continue;
             }
@@ -95,23 +793,156 @@ Schedule Scheduler::buildSchedule()
         }
     }
 
-    std::vector<SystemFunc> systems;
-    systems.reserve(system_count);
+    assert(sorted_systems.size() == system_count);
+
     // Our sorted list is in reverse execution order
-    for (size_t i = system_count - 1; i > 0; --i)
+    std::reverse(sorted_systems.begin(), sorted_systems.end());
+    std::vector<size_t> schedule_indices(system_count);
+    for (size_t i = 0; i < system_count; ++i)
+        schedule_indices[sorted_systems[i]] = i;
+
+    // Explicit dependencies and conflicting accesses both order systems. A
+    // conflicting pair keeps the order it has in the sorted list.
+    std::vector<bool> edges(system_count * system_count, false);
+    for (size_t i = 0; i < system_count; ++i)
     {
-        size_t sys_i = sorted_systems[i];
-        System const &sys = m_systems[sys_i];
-        systems.push_back(sys.func);
+        System const &sys = m_systems[sorted_systems[i]];
+        for (SystemRef dependent : sys.dependents)
+        {
+            size_t const j = schedule_indices[dependent.m_index];
+            assert(j > i && "Dependents have to be later in the schedule");
+            edges[i * system_count + j] = true;
+        }
+
+        for (size_t j = i + 1; j < system_count; ++j)
+        {
+            if (conflicts(sys, m_systems[sorted_systems[j]]))
+                edges[i * system_count + j] = true;
+        }
+    }
+
+    std::vector<Schedule::System> systems(system_count);
+    ComponentMask double_buffered;
+    // Systems with identical queries share the evaluated results
+    std::vector<ComponentMask> query_masks;
+    std::vector<size_t> system_queries;
+    for (size_t i = 0; i < system_count; ++i)
+    {
+        System const &sys = m_systems[sorted_systems[i]];
+        if (sys.slice_entities > 0)
+            systems[i].func = makeSlicedFunc(sys, m_deterministic);
+        else if (sys.make_func)
+            systems[i].func = sys.make_func(m_deterministic);
+        else
+            systems[i].func = sys.func;
+        systems[i].cost_ns = sys.cost_ns;
+        systems[i].condition = sys.condition;
+        systems[i].require_matches = sys.require_matches;
+        systems[i].pipelined = sys.pipelined;
+        systems[i].priority_class = sys.priority_class;
+        systems[i].main_thread = sys.main_thread;
+        systems[i].worker = sys.worker;
+        if (sys.pipelined)
+        {
+            // The previous frame's instance of the system and the ones it
+            // conflicts with
+            for (size_t j = 0; j < system_count; ++j)
+            {
+                if (j == i || conflicts(sys, m_systems[sorted_systems[j]]))
+                    systems[i].frame_blockers.push_back(j);
+            }
+        }
+        systems[i].name = sys.name.empty()
+                              ? "System " + std::to_string(sorted_systems[i])
+                              : sys.name;
+        double_buffered |= sys.double_buffered_read_mask;
+
+        systems[i].query_offset = system_queries.size();
+        systems[i].query_count = sys.query_masks.size();
+        for (ComponentMask const &mask : sys.query_masks)
+        {
+            auto const query =
+                std::find(query_masks.begin(), query_masks.end(), mask);
+            system_queries.push_back(query - query_masks.begin());
+            if (query == query_masks.end())
+                query_masks.push_back(mask);
+        }
+
+        for (size_t j = i + 1; j < system_count; ++j)
+        {
+            if (edges[i * system_count + j])
+            {
+                systems[i].dependents.push_back(j);
+                systems[j].dependency_count++;
+            }
+        }
     }
-    size_t last_sys = sorted_systems[0];
-    systems.push_back(m_systems[last_sys].func);
 
-    Schedule s(std::move(systems));
+    Schedule s(
+        std::move(systems), double_buffered, std::move(query_masks),
+        std::move(system_queries), std::move(schedule_indices));
 
     return s;
 }
 
+void Scheduler::setDeterministic(bool deterministic)
+{
+    m_deterministic = deterministic;
+}
+
+SystemFunc Scheduler::makeSlicedFunc(System const &system, bool deterministic)
+{
+    // Last processed entity, shared by the copies of the returned func
+    std::shared_ptr<std::optional<EntityId>> const cursor =
+        std::make_shared<std::optional<EntityId>>();
+    bool const timed = !deterministic &&
+                       system.slice_time != std::chrono::microseconds::max();
+
+    return [slice_func = system.slice_func,
+            max_entities = system.slice_entities,
+            max_time = system.slice_time, timed,
+            cursor](std::span<ComponentStorage::Range const *const> queries)
+    {
+        ComponentStorage::Range const &range = *queries[0];
+        size_t const size = range.size();
+        if (size == 0)
+            return uint64_t{0};
+
+        auto const deadline = timed ? deadlineAfter(max_time)
+                                    : std::chrono::steady_clock::time_point{};
+        size_t const count = std::min(max_entities, size);
+        size_t const batch_size = timed ? s_slice_batch_size : count;
+
+        size_t pos = cursor->has_value() ? range.upperBound(**cursor) : 0;
+        if (pos == size)
+            pos = 0;
+
+        // Wraps around at the end of the matches but stops before visiting
+        // any entity twice
+        size_t processed = 0;
+        while (processed < count)
+        {
+            size_t const end =
+                std::min({pos + batch_size, size, pos + count - processed});
+            slice_func(queries, pos, end);
+            processed += end - pos;
+            pos = end == size ? 0 : end;
+
+            if (timed && std::chrono::steady_clock::now() >= deadline)
+                break;
+        }
+        *cursor = range.getId((pos + size - 1) % size);
+
+        return static_cast<uint64_t>(processed);
+    };
+}
+
+bool Scheduler::conflicts(System const &a, System const &b)
+{
+    return (a.write_mask & (b.read_mask | b.write_mask)).any() ||
+           (b.write_mask & a.read_mask).any();
+}
+
 bool Scheduler::dependsOn(SystemRef dependent, SystemRef dependency) const
 {
     assert(dependent.m_scheduler == this);
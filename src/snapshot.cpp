@@ -0,0 +1,241 @@
+#include "recs/snapshot.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace recs
+{
+
+uint32_t Snapshot::tick() const { return m_tick; }
+
+uint64_t Snapshot::copiedBytes() const { return m_copied_bytes; }
+
+Snapshot ComponentStorage::captureSnapshot(Snapshot const *previous)
+{
+    assert(previous == nullptr || previous->m_storage == this);
+    assert(m_change_tick < std::numeric_limits<uint32_t>::max());
+
+    Snapshot s;
+    s.m_storage = this;
+    s.m_tick = m_change_tick;
+    s.m_entity_count = m_entity_generations.size();
+
+    uint64_t const block_count =
+        (s.m_entity_count + s_chunk_size - 1) / s_chunk_size;
+    assert(m_entity_block_ticks.size() >= block_count);
+    s.m_entity_blocks.reserve(block_count);
+    for (uint64_t b = 0; b < block_count; ++b)
+    {
+        uint32_t const tick = m_entity_block_ticks[b];
+        if (previous != nullptr && b < previous->m_entity_blocks.size() &&
+            previous->m_entity_blocks[b]->changed_tick == tick)
+        {
+            s.m_entity_blocks.push_back(previous->m_entity_blocks[b]);
+            continue;
+        }
+
+        uint64_t const begin = b * s_chunk_size;
+        uint64_t const end =
+            std::min<uint64_t>(begin + s_chunk_size, s.m_entity_count);
+
+        auto block = std::make_shared<Snapshot::EntityBlock>();
+        block->generations.assign(
+            m_entity_generations.begin() + begin,
+            m_entity_generations.begin() + end);
+        block->alive.assign(
+            m_entity_alive.begin() + begin, m_entity_alive.begin() + end);
+        block->masks.assign(
+            m_entity_component_masks.begin() + begin,
+            m_entity_component_masks.begin() + end);
+        block->changed_tick = tick;
+
+        s.m_copied_bytes += (end - begin) * (sizeof(uint16_t) + sizeof(bool) +
+                                             sizeof(ComponentMask));
+        s.m_entity_blocks.push_back(std::move(block));
+    }
+
+    s.m_entity_freelist.assign(
+        m_entity_freelist.begin(), m_entity_freelist.end());
+
+    if (previous != nullptr && previous->m_hierarchy != nullptr &&
+        previous->m_hierarchy->changed_tick == m_hierarchy_changed_tick)
+        s.m_hierarchy = previous->m_hierarchy;
+    else
+    {
+        s.m_hierarchy = std::make_shared<Snapshot::Hierarchy>(
+            Snapshot::Hierarchy{
+                .nodes = m_hierarchy_nodes,
+                .changed_tick = m_hierarchy_changed_tick,
+            });
+        s.m_copied_bytes += m_hierarchy_nodes.size() * sizeof(HierarchyNode);
+    }
+
+    s.m_pools.resize(m_component_pools.size());
+    for (size_t type_id = 0; type_id < m_component_pools.size(); ++type_id)
+    {
+        ComponentPool const &pool = m_component_pools[type_id];
+        Snapshot::Pool &snapshot_pool = s.m_pools[type_id];
+        snapshot_pool.component_size = pool.component_size;
+        snapshot_pool.component_alignment = pool.component_alignment;
+        snapshot_pool.count = pool.count;
+        snapshot_pool.chunks.resize(pool.chunks.size());
+
+        Snapshot::Pool const *previous_pool =
+            previous != nullptr && type_id < previous->m_pools.size()
+                ? &previous->m_pools[type_id]
+                : nullptr;
+
+        uint64_t const chunk_bytes = s_chunk_size * pool.component_size;
+        for (size_t i = 0; i < pool.chunks.size(); ++i)
+        {
+            ComponentChunk const &chunk = pool.chunks[i];
+            if (chunk.count == 0)
+                continue;
+
+            if (previous_pool != nullptr && i < previous_pool->chunks.size())
+            {
+                std::shared_ptr<Snapshot::Chunk const> const &previous_chunk =
+                    previous_pool->chunks[i];
+                if (previous_chunk != nullptr &&
+                    previous_chunk->changed_tick == chunk.changed_tick)
+                {
+                    snapshot_pool.chunks[i] = previous_chunk;
+                    continue;
+                }
+            }
+
+            auto snapshot_chunk = std::make_shared<Snapshot::Chunk>();
+            snapshot_chunk->data = std::make_unique<uint8_t[]>(chunk_bytes);
+            std::memcpy(snapshot_chunk->data.get(), chunk.data, chunk_bytes);
+            snapshot_chunk->count = chunk.count;
+            snapshot_chunk->changed_tick = chunk.changed_tick;
+
+            s.m_copied_bytes += chunk_bytes;
+            snapshot_pool.chunks[i] = std::move(snapshot_chunk);
+        }
+    }
+
+    // Changes after this are stamped with a tick that the snapshot hasn't seen
+    m_change_tick++;
+
+    return s;
+}
+
+void ComponentStorage::restoreSnapshot(Snapshot const &snapshot)
+{
+    assert(snapshot.m_storage == this);
+    assert(m_change_tick < std::numeric_limits<uint32_t>::max());
+
+    // Emptied chunks and following changes get a tick that no snapshot has
+    // seen
+    m_change_tick++;
+
+    uint64_t const entity_count = snapshot.m_entity_count;
+    m_entity_generations.resize(entity_count);
+    m_entity_alive.resize(entity_count);
+    m_entity_component_masks.resize(entity_count);
+    m_entity_block_ticks.resize(snapshot.m_entity_blocks.size(), 0);
+    m_entity_changed_ticks.resize(entity_count, m_change_tick);
+    std::vector<size_t> restored_blocks;
+    for (size_t b = 0; b < snapshot.m_entity_blocks.size(); ++b)
+    {
+        Snapshot::EntityBlock const &block = *snapshot.m_entity_blocks[b];
+        // Matching ticks mean the contents match as well
+        if (m_entity_block_ticks[b] == block.changed_tick)
+            continue;
+
+        uint64_t const begin = b * s_chunk_size;
+        std::copy(
+            block.generations.begin(), block.generations.end(),
+            m_entity_generations.begin() + begin);
+        std::copy(
+            block.alive.begin(), block.alive.end(),
+            m_entity_alive.begin() + begin);
+        std::copy(
+            block.masks.begin(), block.masks.end(),
+            m_entity_component_masks.begin() + begin);
+        m_entity_block_ticks[b] = block.changed_tick;
+        restored_blocks.push_back(b);
+        // The restored state is a change for deltas
+        std::fill_n(
+            m_entity_changed_ticks.begin() + begin, block.generations.size(),
+            m_change_tick);
+    }
+
+    m_entity_freelist.assign(
+        snapshot.m_entity_freelist.begin(), snapshot.m_entity_freelist.end());
+    m_freelist_changed_tick = m_change_tick;
+
+    assert(snapshot.m_hierarchy != nullptr);
+    if (m_hierarchy_changed_tick != snapshot.m_hierarchy->changed_tick)
+    {
+        m_hierarchy_nodes = snapshot.m_hierarchy->nodes;
+        m_hierarchy_changed_tick = snapshot.m_hierarchy->changed_tick;
+    }
+    // Levels are cheap to rebuild compared to checking if they're still valid
+    m_hierarchy_dirty = true;
+
+    if (m_component_pools.size() < snapshot.m_pools.size())
+        m_component_pools.resize(snapshot.m_pools.size());
+    for (size_t type_id = 0; type_id < m_component_pools.size(); ++type_id)
+    {
+        ComponentPool &pool = m_component_pools[type_id];
+        Snapshot::Pool const *snapshot_pool =
+            type_id < snapshot.m_pools.size() ? &snapshot.m_pools[type_id]
+                                              : nullptr;
+        if (snapshot_pool != nullptr && snapshot_pool->component_size != 0)
+        {
+            (void)getPool(
+                type_id, snapshot_pool->component_size,
+                snapshot_pool->component_alignment);
+            if (pool.chunks.size() < snapshot_pool->chunks.size())
+                pool.chunks.resize(snapshot_pool->chunks.size());
+        }
+        pool.count = snapshot_pool != nullptr ? snapshot_pool->count : 0;
+
+        uint64_t const chunk_bytes = s_chunk_size * pool.component_size;
+        for (size_t i = 0; i < pool.chunks.size(); ++i)
+        {
+            ComponentChunk &chunk = pool.chunks[i];
+            Snapshot::Chunk const *snapshot_chunk =
+                snapshot_pool != nullptr && i < snapshot_pool->chunks.size()
+                    ? snapshot_pool->chunks[i].get()
+                    : nullptr;
+
+            if (snapshot_chunk == nullptr)
+            {
+                if (chunk.data != nullptr)
+                {
+                    chunk.count = 0;
+                    chunk.changed_tick = m_change_tick;
+                }
+                continue;
+            }
+
+            if (chunk.data == nullptr)
+                allocateChunk(pool, chunk);
+            else if (chunk.changed_tick == snapshot_chunk->changed_tick)
+            {
+                assert(chunk.count == snapshot_chunk->count);
+                continue;
+            }
+
+            std::memcpy(chunk.data, snapshot_chunk->data.get(), chunk_bytes);
+            chunk.count = snapshot_chunk->count;
+            chunk.changed_tick = snapshot_chunk->changed_tick;
+            std::fill_n(chunk.changed_ticks, s_chunk_size, m_change_tick);
+        }
+
+        pool.presence.truncate(entity_count);
+    }
+
+    // After the pools so that pools the snapshot created get their bits too
+    for (size_t const b : restored_blocks)
+    {
+        uint64_t const begin = b * s_chunk_size;
+        updatePresence(
+            begin, begin + snapshot.m_entity_blocks[b]->generations.size());
+    }
+}
+
+} // namespace recs
@@ -0,0 +1,71 @@
+#include "recs/system_task.hpp"
+
+#include <exception>
+#include <utility>
+
+namespace recs
+{
+
+SystemTask SystemTask::promise_type::get_return_object()
+{
+    return SystemTask{
+        std::coroutine_handle<promise_type>::from_promise(*this)};
+}
+
+std::suspend_always SystemTask::promise_type::initial_suspend() noexcept
+{
+    return {};
+}
+
+std::suspend_always SystemTask::promise_type::final_suspend() noexcept
+{
+    return {};
+}
+
+void SystemTask::promise_type::return_void() { }
+
+void SystemTask::promise_type::unhandled_exception() { std::terminate(); }
+
+SystemTask::SystemTask(std::coroutine_handle<promise_type> handle)
+: m_handle{handle}
+{
+}
+
+SystemTask::~SystemTask()
+{
+    if (m_handle)
+        m_handle.destroy();
+}
+
+SystemTask::SystemTask(SystemTask &&other) noexcept
+: m_handle{std::exchange(other.m_handle, nullptr)}
+{
+}
+
+SystemTask &SystemTask::operator=(SystemTask &&other) noexcept
+{
+    if (this != &other)
+    {
+        if (m_handle)
+            m_handle.destroy();
+        m_handle = std::exchange(other.m_handle, nullptr);
+    }
+    return *this;
+}
+
+bool SystemTask::valid() const { return static_cast<bool>(m_handle); }
+
+bool SystemTask::done() const
+{
+    assert(m_handle);
+    return m_handle.done();
+}
+
+void SystemTask::resume() const
+{
+    assert(m_handle);
+    assert(!m_handle.done());
+    m_handle.resume();
+}
+
+} // namespace recs
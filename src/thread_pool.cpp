@@ -0,0 +1,104 @@
+#include "recs/thread_pool.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace recs
+{
+
+namespace
+{
+
+thread_local uint32_t t_worker_index = ThreadPool::s_not_a_worker;
+
+} // namespace
+
+ThreadPool::ThreadPool(uint32_t thread_count)
+{
+    if (thread_count == 0)
+        thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+
+    m_worker_tasks.resize(thread_count);
+    m_threads.reserve(thread_count);
+    for (uint32_t i = 0; i < thread_count; ++i)
+        m_threads.emplace_back([this, i] { workerLoop(i); });
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard const lock{m_mutex};
+        m_stopping = true;
+    }
+    m_task_added.notify_all();
+
+    for (std::thread &thread : m_threads)
+        thread.join();
+}
+
+void ThreadPool::submit(std::function<void()> &&task)
+{
+    assert(task);
+    {
+        std::lock_guard const lock{m_mutex};
+        m_tasks.push_back(std::move(task));
+    }
+    m_task_added.notify_one();
+}
+
+void ThreadPool::submit(uint32_t worker, std::function<void()> &&task)
+{
+    assert(task);
+    if (worker >= m_worker_tasks.size())
+    {
+        submit(std::move(task));
+        return;
+    }
+
+    {
+        std::lock_guard const lock{m_mutex};
+        m_worker_tasks[worker].push_back(std::move(task));
+    }
+    // The woken worker could be any of them
+    m_task_added.notify_all();
+}
+
+uint32_t ThreadPool::threadCount() const
+{
+    return static_cast<uint32_t>(m_threads.size());
+}
+
+uint32_t ThreadPool::currentWorkerIndex() { return t_worker_index; }
+
+void ThreadPool::workerLoop(uint32_t worker_index)
+{
+    t_worker_index = worker_index;
+
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::deque<std::function<void()>> &pinned =
+                m_worker_tasks[worker_index];
+            std::unique_lock lock{m_mutex};
+            m_task_added.wait(
+                lock,
+                [&]
+                {
+                    return m_stopping || !pinned.empty() || !m_tasks.empty();
+                });
+            // Drain the queues before stopping
+            std::deque<std::function<void()>> &tasks =
+                pinned.empty() ? m_tasks : pinned;
+            if (tasks.empty())
+                return;
+
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+
+        task();
+    }
+}
+
+} // namespace recs
@@ -0,0 +1,432 @@
+#include "recs/trace.hpp"
+
+#include "byte_stream.hpp"
+#include <cassert>
+#include <cstring>
+#include <fstream>
+
+namespace recs
+{
+
+namespace
+{
+
+// "RTRC" when read as little endian
+uint32_t const s_trace_magic = 0x4352'5452;
+uint32_t const s_trace_version = 1;
+
+// After the magic and version, the trace is a sequence of operations
+// starting with the op byte, followed by varint arguments
+enum class Op : uint8_t
+{
+    // No arguments
+    Frame,
+    // Trace type index, size, alignment. Defines a new type if the index is
+    // the next one, otherwise sets the layout of a type that was defined with
+    // a zero size.
+    DefineType,
+    // Entity index
+    AddEntity,
+    // Entity index
+    RemoveEntity,
+    // Entity index, trace type index
+    AddComponent,
+    // Entity index, trace type index
+    RemoveComponent,
+    // Type count, trace type indices
+    Query,
+    // Entity table size after the trim. A compact() pass that completed and
+    // trimmed the entity tables.
+    Compact,
+    Count,
+};
+
+} // namespace
+
+TraceRecorder::TraceRecorder() { clear(); }
+
+void TraceRecorder::markFrame()
+{
+    std::lock_guard const lock{m_mutex};
+    m_data.push_back(static_cast<uint8_t>(Op::Frame));
+}
+
+std::vector<uint8_t> const &TraceRecorder::data() const { return m_data; }
+
+bool TraceRecorder::save(std::filesystem::path const &path) const
+{
+    std::ofstream file{path, std::ios::binary};
+    if (!file.is_open())
+        return false;
+
+    file.write(
+        reinterpret_cast<char const *>(m_data.data()),
+        static_cast<std::streamsize>(m_data.size()));
+    return file.good();
+}
+
+void TraceRecorder::clear()
+{
+    std::lock_guard const lock{m_mutex};
+    m_data.clear();
+    m_types.clear();
+    m_type_count = 0;
+    writeBytes(m_data, &s_trace_magic, sizeof(s_trace_magic));
+    writeBytes(m_data, &s_trace_version, sizeof(s_trace_version));
+}
+
+void TraceRecorder::recordAddEntity(uint64_t index)
+{
+    std::lock_guard const lock{m_mutex};
+    m_data.push_back(static_cast<uint8_t>(Op::AddEntity));
+    writeVarint(m_data, index);
+}
+
+void TraceRecorder::recordRemoveEntity(uint64_t index)
+{
+    std::lock_guard const lock{m_mutex};
+    m_data.push_back(static_cast<uint8_t>(Op::RemoveEntity));
+    writeVarint(m_data, index);
+}
+
+void TraceRecorder::recordAddComponent(
+    uint64_t index, uint64_t type_id, uint32_t size, uint32_t alignment)
+{
+    std::lock_guard const lock{m_mutex};
+    uint64_t const trace_type = traceType(type_id, size, alignment);
+    m_data.push_back(static_cast<uint8_t>(Op::AddComponent));
+    writeVarint(m_data, index);
+    writeVarint(m_data, trace_type);
+}
+
+void TraceRecorder::recordRemoveComponent(uint64_t index, uint64_t type_id)
+{
+    std::lock_guard const lock{m_mutex};
+    // Removed components have been added so the type is already known
+    assert(type_id < m_types.size());
+    assert(m_types[type_id].index != s_unmapped);
+    m_data.push_back(static_cast<uint8_t>(Op::RemoveComponent));
+    writeVarint(m_data, index);
+    writeVarint(m_data, m_types[type_id].index);
+}
+
+void TraceRecorder::recordCompact(uint64_t entity_count)
+{
+    std::lock_guard const lock{m_mutex};
+    m_data.push_back(static_cast<uint8_t>(Op::Compact));
+    writeVarint(m_data, entity_count);
+}
+
+void TraceRecorder::recordQuery(ComponentMask const &mask)
+{
+    std::lock_guard const lock{m_mutex};
+
+    // Types only seen in queries don't need a layout. Defined before the
+    // query op so the definitions don't end up in the middle of it.
+    uint64_t const type_count = mask.count();
+    for (uint64_t type_id = 0, i = 0; i < type_count; ++type_id)
+    {
+        if (mask.test(type_id))
+        {
+            (void)traceType(type_id, 0, 0);
+            i++;
+        }
+    }
+
+    m_data.push_back(static_cast<uint8_t>(Op::Query));
+    writeVarint(m_data, type_count);
+    for (uint64_t type_id = 0, i = 0; i < type_count; ++type_id)
+    {
+        if (mask.test(type_id))
+        {
+            writeVarint(m_data, m_types[type_id].index);
+            i++;
+        }
+    }
+}
+
+uint64_t TraceRecorder::traceType(
+    uint64_t type_id, uint32_t size, uint32_t alignment)
+{
+    if (m_types.size() <= type_id)
+        m_types.resize(type_id + 1);
+
+    TraceType &type = m_types[type_id];
+    bool const new_type = type.index == s_unmapped;
+    if (new_type)
+        type.index = m_type_count++;
+
+    if (new_type || (type.size == 0 && size != 0))
+    {
+        type.size = size;
+        m_data.push_back(static_cast<uint8_t>(Op::DefineType));
+        writeVarint(m_data, type.index);
+        writeVarint(m_data, size);
+        writeVarint(m_data, alignment);
+    }
+
+    return type.index;
+}
+
+bool TraceReplayer::load(std::filesystem::path const &path)
+{
+    std::ifstream file{path, std::ios::binary | std::ios::ate};
+    if (!file.is_open())
+        return false;
+
+    std::streamsize const size = file.tellg();
+    if (size < 0)
+        return false;
+
+    std::vector<uint8_t> trace(static_cast<size_t>(size));
+    file.seekg(0);
+    file.read(reinterpret_cast<char *>(trace.data()), size);
+    if (!file.good())
+        return false;
+
+    return load(std::move(trace));
+}
+
+bool TraceReplayer::load(std::vector<uint8_t> trace)
+{
+    m_trace = std::move(trace);
+    m_position = 0;
+    m_types.clear();
+    m_entities.clear();
+    m_stats = Stats{};
+
+    ByteReader reader{m_trace};
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    if (!reader.readBytes(&magic, sizeof(magic)) ||
+        !reader.readBytes(&version, sizeof(version)) ||
+        magic != s_trace_magic || version != s_trace_version)
+    {
+        m_trace.clear();
+        return false;
+    }
+    m_position = reader.position();
+
+    return true;
+}
+
+TraceReplayer::Result TraceReplayer::replayFrame(ComponentStorage &cs)
+{
+    ByteReader reader{m_trace, m_position};
+    Result const result = replayOps(cs, reader);
+    // Continue from where the frame ended, even on errors
+    m_position = reader.position();
+
+    return result;
+}
+
+TraceReplayer::Result TraceReplayer::replayOps(
+    ComponentStorage &cs, ByteReader &reader)
+{
+    if (reader.done())
+        return Result::End;
+
+    while (!reader.done())
+    {
+        uint8_t op_byte = 0;
+        if (!reader.readBytes(&op_byte, sizeof(op_byte)) ||
+            op_byte >= static_cast<uint8_t>(Op::Count))
+            return Result::Error;
+
+        switch (static_cast<Op>(op_byte))
+        {
+        case Op::Frame:
+            return Result::Frame;
+        case Op::DefineType:
+        {
+            uint64_t index = 0;
+            uint64_t size = 0;
+            uint64_t alignment = 0;
+            if (!reader.readVarint(index) || !reader.readVarint(size) ||
+                !reader.readVarint(alignment) || index > m_types.size() ||
+                size > UINT32_MAX || alignment > UINT32_MAX ||
+                (size != 0 &&
+                 (alignment == 0 || (alignment & (alignment - 1)) != 0)))
+                break;
+
+            if (index == m_types.size())
+                m_types.emplace_back();
+
+            Type &type = m_types[index];
+            type.size = static_cast<uint32_t>(size);
+            type.alignment = static_cast<uint32_t>(alignment);
+            // Components are only added once the layout is known so the id
+            // can still change when it's set
+            type.type_id = opaqueTypeId(index, type.size, type.alignment);
+            if (type.type_id >= TypeId::s_max_component_type_count)
+                return Result::TypeIdsExhausted;
+            continue;
+        }
+        case Op::AddEntity:
+        {
+            uint64_t index = 0;
+            if (!reader.readVarint(index))
+                break;
+
+            EntityId const id = cs.addEntity();
+            // The replay storage starts empty so ids are allocated the same
+            // way as in the traced one
+            if (id.index() != index)
+                return Result::Error;
+            if (m_entities.size() <= index)
+                m_entities.resize(index + 1);
+            m_entities[index] = id;
+            m_stats.entity_adds++;
+            continue;
+        }
+        case Op::RemoveEntity:
+        {
+            EntityId id;
+            if (!readEntity(cs, reader, id))
+                break;
+
+            cs.removeEntity(id);
+            m_stats.entity_removes++;
+            continue;
+        }
+        case Op::AddComponent:
+        {
+            EntityId id;
+            Type const *type = nullptr;
+            if (!readEntity(cs, reader, id) || !readType(reader, type) ||
+                type->size == 0 ||
+                cs.m_entity_component_masks[id.index()].test(type->type_id))
+                break;
+
+            void *const ptr = cs.allocateComponent(
+                id, type->type_id, type->size, type->alignment);
+            std::memset(ptr, 0, type->size);
+            m_stats.component_adds++;
+            continue;
+        }
+        case Op::RemoveComponent:
+        {
+            EntityId id;
+            Type const *type = nullptr;
+            if (!readEntity(cs, reader, id) || !readType(reader, type) ||
+                !cs.m_entity_component_masks[id.index()].test(type->type_id))
+                break;
+
+            cs.releaseComponent(id, type->type_id);
+            m_stats.component_removes++;
+            continue;
+        }
+        case Op::Query:
+        {
+            uint64_t type_count = 0;
+            if (!reader.readVarint(type_count) ||
+                type_count > m_types.size())
+                break;
+
+            ComponentMask mask;
+            bool valid = true;
+            for (uint64_t i = 0; i < type_count && valid; ++i)
+            {
+                Type const *type = nullptr;
+                valid = readType(reader, type);
+                if (valid)
+                    mask.set(type->type_id);
+            }
+            if (!valid)
+                break;
+
+            m_stats.query_results += cs.getEntities(mask).size();
+            m_stats.queries++;
+            continue;
+        }
+        case Op::Compact:
+        {
+            // The traced pass might have been spread over multiple budgeted
+            // calls so the chunks are freed in one go here. The tables are
+            // trimmed to the traced size so that new entities get the same
+            // indices.
+            uint64_t entity_count = 0;
+            if (!reader.readVarint(entity_count) ||
+                entity_count > cs.m_entity_generations.size())
+                break;
+
+            (void)cs.freeEmptyChunks(std::chrono::nanoseconds::max());
+            cs.trimEntityTables(entity_count);
+            // Only dead slots are trimmed
+            if (cs.m_entity_generations.size() != entity_count)
+                break;
+            m_stats.compactions++;
+            continue;
+        }
+        case Op::Count:
+            break;
+        }
+
+        return Result::Error;
+    }
+
+    return Result::Frame;
+}
+
+TraceReplayer::Stats const &TraceReplayer::stats() const { return m_stats; }
+
+bool TraceReplayer::readEntity(
+    ComponentStorage const &cs, ByteReader &reader, EntityId &id)
+{
+    uint64_t index = 0;
+    if (!reader.readVarint(index) || index >= m_entities.size())
+        return false;
+
+    id = m_entities[index];
+    return cs.isValid(id);
+}
+
+uint64_t TraceReplayer::opaqueTypeId(
+    uint64_t index, uint32_t size, uint32_t alignment)
+{
+    assert(index <= m_opaque_types.size());
+    if (index < m_opaque_types.size())
+    {
+        // A storage that has seen the id keeps its pool layout, so an id can
+        // only be reused for the same layout or if either one is not known
+        Type &opaque = m_opaque_types[index];
+        if (size == 0 || opaque.size == 0 ||
+            (opaque.size == size && opaque.alignment == alignment))
+        {
+            if (size != 0)
+            {
+                opaque.size = size;
+                opaque.alignment = alignment;
+            }
+            return opaque.type_id;
+        }
+    }
+
+    uint64_t const type_id = TypeId::allocate();
+    if (type_id >= TypeId::s_max_component_type_count)
+        return type_id;
+
+    Type const opaque{
+        .type_id = type_id,
+        .size = size,
+        .alignment = alignment,
+    };
+    if (index < m_opaque_types.size())
+        m_opaque_types[index] = opaque;
+    else
+        m_opaque_types.push_back(opaque);
+
+    return type_id;
+}
+
+bool TraceReplayer::readType(ByteReader &reader, Type const *&type)
+{
+    uint64_t index = 0;
+    if (!reader.readVarint(index) || index >= m_types.size())
+        return false;
+
+    type = &m_types[index];
+    return true;
+}
+
+} // namespace recs
@@ -1,21 +1,50 @@
 #include "recs/type_id.hpp"
 
-#include <atomic>
 #include <cassert>
+#include <mutex>
 
 namespace recs
 {
 
-uint64_t TypeId::runningTypeId()
+namespace
 {
-    // TODO:
-    // This should be ok even if used in a DLL but potentially not if the DLL is
-    // shared between processes?
-    static std::atomic<uint64_t> id = 0;
-    // Static init is thread safe but multiple threads might be initializing
-    // type ids for different types.
-    uint64_t ret = id.fetch_add(1);
-    assert(ret <= s_max_component_type_count);
+
+// TODO:
+// This should be ok even if used in a DLL but potentially not if the DLL is
+// shared between processes?
+std::mutex s_running_id_mutex;
+uint64_t s_running_id = 0;
+
+} // namespace
+
+uint64_t TypeId::count()
+{
+    std::lock_guard const lock{s_running_id_mutex};
+    return s_running_id;
+}
+
+uint64_t TypeId::allocate()
+{
+    std::lock_guard const lock{s_running_id_mutex};
+    if (s_running_id >= s_max_component_type_count)
+        return s_max_component_type_count;
+    return s_running_id++;
+}
+
+uint64_t TypeId::assign(std::atomic<uint64_t> &id)
+{
+    // Multiple threads might be initializing the same type. A lock instead of
+    // a CAS on the id keeps the ids dense as losers don't burn a running id.
+    std::lock_guard const lock{s_running_id_mutex};
+
+    uint64_t const current = id.load(std::memory_order_relaxed);
+    if (current != s_unassigned_id)
+        return current;
+
+    uint64_t const ret = s_running_id++;
+    assert(ret < s_max_component_type_count);
+    id.store(ret, std::memory_order_relaxed);
+
     return ret;
 }
 
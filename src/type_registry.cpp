@@ -0,0 +1,104 @@
+#include "recs/type_registry.hpp"
+
+#include <cassert>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace recs
+{
+
+namespace
+{
+
+struct Registry
+{
+    std::mutex mutex;
+    // Deque to keep the infos stable as more types are registered
+    std::deque<TypeRegistry::TypeInfo> infos;
+    // Indexed by type id, nullptr for unregistered types
+    std::vector<TypeRegistry::TypeInfo const *> infos_by_type_id;
+    std::unordered_map<uint64_t, uint64_t> type_ids;
+};
+
+Registry &registry()
+{
+    static Registry r;
+    return r;
+}
+
+} // namespace
+
+TypeRegistry::TypeInfo const *TypeRegistry::info(uint64_t type_id)
+{
+    Registry &r = registry();
+    std::lock_guard const lock{r.mutex};
+
+    if (type_id >= r.infos_by_type_id.size())
+        return nullptr;
+    return r.infos_by_type_id[type_id];
+}
+
+uint64_t TypeRegistry::stableId(uint64_t type_id)
+{
+    TypeInfo const *type_info = info(type_id);
+    if (type_info == nullptr)
+        return s_invalid_id;
+    return type_info->stable_id;
+}
+
+uint64_t TypeRegistry::typeId(uint64_t stable_id)
+{
+    Registry &r = registry();
+    std::lock_guard const lock{r.mutex};
+
+    auto const iter = r.type_ids.find(stable_id);
+    if (iter == r.type_ids.end())
+        return s_invalid_id;
+    return iter->second;
+}
+
+uint64_t TypeRegistry::hashName(std::string_view name)
+{
+    // 64bit FNV-1a, good enough for a few thousand names
+    uint64_t hash = 0xcbf2'9ce4'8422'2325;
+    for (char const c : name)
+    {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 0x100'0000'01b3;
+    }
+    return hash;
+}
+
+void TypeRegistry::registerType(
+    uint64_t type_id, std::string_view name, uint32_t size, uint32_t alignment)
+{
+    uint64_t const stable_id = hashName(name);
+    assert(stable_id != s_invalid_id);
+
+    Registry &r = registry();
+    std::lock_guard const lock{r.mutex};
+
+    if (r.infos_by_type_id.size() <= type_id)
+        r.infos_by_type_id.resize(type_id + 1, nullptr);
+
+    TypeInfo const *&type_info = r.infos_by_type_id[type_id];
+    if (type_info != nullptr)
+    {
+        assert(type_info->stable_id == stable_id && "Type registered twice");
+        return;
+    }
+
+    assert(!r.type_ids.contains(stable_id) && "Name collision between types");
+
+    type_info = &r.infos.emplace_back(TypeInfo{
+        .name = std::string{name},
+        .stable_id = stable_id,
+        .size = size,
+        .alignment = alignment,
+    });
+    r.type_ids.emplace(stable_id, type_id);
+}
+
+} // namespace recs
@@ -0,0 +1,535 @@
+#include "recs/component_storage.hpp"
+
+#include "recs/type_registry.hpp"
+#include <algorithm>
+#include <bit>
+#include <fstream>
+
+namespace recs
+{
+
+namespace
+{
+
+// "RECS" when read as little endian
+uint32_t const s_magic = 0x5343'4552;
+uint32_t const s_version = 2;
+// Component data is aligned to at least a cache line
+uint64_t const s_min_data_alignment = 64;
+
+// All offsets are from the beginning of the file. Sections are stored in the
+// order they are listed.
+struct FileHeader
+{
+    uint32_t magic{s_magic};
+    uint32_t version{s_version};
+    uint64_t file_size{0};
+    uint64_t chunk_size{0};
+    uint64_t entity_count{0};
+    uint64_t freelist_count{0};
+    uint64_t hierarchy_node_count{0};
+    // Generation of new entity slots
+    uint64_t generation_floor{0};
+    uint64_t type_count{0};
+    // Bit i in the stored masks is the ith type in the type table
+    uint64_t mask_word_count{0};
+    uint64_t generations_offset{0};
+    uint64_t alive_offset{0};
+    uint64_t freelist_offset{0};
+    uint64_t hierarchy_offset{0};
+    uint64_t masks_offset{0};
+    uint64_t types_offset{0};
+};
+
+struct FileType
+{
+    uint64_t stable_id{0};
+    uint32_t component_size{0};
+    uint32_t component_alignment{0};
+    uint64_t count{0};
+    uint64_t chunk_count{0};
+    uint64_t chunks_offset{0};
+};
+
+struct FileChunk
+{
+    // 0 if the chunk isn't allocated
+    uint64_t data_offset{0};
+    uint64_t count{0};
+};
+
+uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+bool inBounds(uint64_t offset, uint64_t count, uint64_t size, uint64_t bound)
+{
+    if (size != 0 && count > (bound - offset) / size)
+        return false;
+    return offset <= bound && offset + count * size <= bound;
+}
+
+class FileWriter
+{
+  public:
+    FileWriter(std::filesystem::path const &path)
+    : m_file{path, std::ios::binary | std::ios::trunc}
+    {
+    }
+
+    [[nodiscard]] bool good() const { return m_file.good(); }
+
+    void write(void const *data, uint64_t size)
+    {
+        m_file.write(static_cast<char const *>(data), (std::streamsize)size);
+        m_offset += size;
+    }
+
+    void padTo(uint64_t offset)
+    {
+        assert(offset >= m_offset);
+        char const zeros[64]{};
+        while (m_offset < offset)
+        {
+            uint64_t const size =
+                std::min<uint64_t>(offset - m_offset, sizeof(zeros));
+            write(zeros, size);
+        }
+    }
+
+  private:
+    std::ofstream m_file;
+    uint64_t m_offset{0};
+};
+
+} // namespace
+
+bool ComponentStorage::saveToFile(std::filesystem::path const &path) const
+{
+    std::vector<uint64_t> type_ids;
+    for (uint64_t type_id = 0; type_id < m_component_pools.size(); ++type_id)
+    {
+        if (m_component_pools[type_id].count > 0)
+            type_ids.push_back(type_id);
+    }
+
+    FileHeader header{
+        .chunk_size = s_chunk_size,
+        .entity_count = m_entity_generations.size(),
+        .freelist_count = m_entity_freelist.size(),
+        .hierarchy_node_count = m_hierarchy_nodes.size(),
+        .generation_floor = m_generation_floor,
+        .type_count = type_ids.size(),
+        .mask_word_count = (type_ids.size() + 63) / 64,
+    };
+
+    uint64_t offset = sizeof(FileHeader);
+    header.generations_offset = offset;
+    offset = alignUp(offset + header.entity_count * sizeof(uint16_t), 8);
+    header.alive_offset = offset;
+    offset = alignUp(offset + header.entity_count, 8);
+    header.freelist_offset = offset;
+    offset += header.freelist_count * sizeof(uint64_t);
+    header.hierarchy_offset = offset;
+    offset += header.hierarchy_node_count * sizeof(HierarchyNode);
+    header.masks_offset = offset;
+    offset +=
+        header.entity_count * header.mask_word_count * sizeof(uint64_t);
+    header.types_offset = offset;
+    offset += header.type_count * sizeof(FileType);
+
+    std::vector<FileType> types;
+    types.reserve(type_ids.size());
+    for (uint64_t type_id : type_ids)
+    {
+        ComponentPool const &pool = m_component_pools[type_id];
+        uint64_t const stable_id = TypeRegistry::stableId(type_id);
+        if (stable_id == TypeRegistry::s_invalid_id)
+            return false;
+
+        types.push_back(FileType{
+            .stable_id = stable_id,
+            .component_size = pool.component_size,
+            .component_alignment = pool.component_alignment,
+            .count = pool.count,
+            .chunk_count = pool.chunks.size(),
+            .chunks_offset = offset,
+        });
+        offset += pool.chunks.size() * sizeof(FileChunk);
+    }
+
+    std::vector<std::vector<FileChunk>> chunk_tables;
+    chunk_tables.reserve(type_ids.size());
+    for (uint64_t type_id : type_ids)
+    {
+        ComponentPool const &pool = m_component_pools[type_id];
+        uint64_t const alignment = std::max<uint64_t>(
+            pool.component_alignment, s_min_data_alignment);
+        uint64_t const chunk_bytes = s_chunk_size * pool.component_size;
+
+        std::vector<FileChunk> &table = chunk_tables.emplace_back();
+        table.reserve(pool.chunks.size());
+        for (ComponentChunk const &chunk : pool.chunks)
+        {
+            // Empty chunks aren't worth storing
+            if (chunk.count == 0)
+            {
+                table.emplace_back();
+                continue;
+            }
+
+            offset = alignUp(offset, alignment);
+            table.push_back(FileChunk{
+                .data_offset = offset,
+                .count = chunk.count,
+            });
+            offset += chunk_bytes;
+        }
+    }
+    header.file_size = offset;
+
+    FileWriter writer{path};
+    if (!writer.good())
+        return false;
+
+    writer.write(&header, sizeof(header));
+
+    writer.write(
+        m_entity_generations.data(),
+        m_entity_generations.size() * sizeof(uint16_t));
+    writer.padTo(header.alive_offset);
+
+    for (bool const alive : m_entity_alive)
+    {
+        uint8_t const byte = alive ? 1 : 0;
+        writer.write(&byte, 1);
+    }
+    writer.padTo(header.freelist_offset);
+
+    for (uint64_t const index : m_entity_freelist)
+        writer.write(&index, sizeof(index));
+
+    writer.write(
+        m_hierarchy_nodes.data(),
+        m_hierarchy_nodes.size() * sizeof(HierarchyNode));
+
+    std::vector<uint64_t> mask_words(header.mask_word_count);
+    for (ComponentMask const &mask : m_entity_component_masks)
+    {
+        std::fill(mask_words.begin(), mask_words.end(), 0);
+        for (size_t i = 0; i < type_ids.size(); ++i)
+        {
+            if (mask.test(type_ids[i]))
+                mask_words[i / 64] |= 1ull << (i % 64);
+        }
+        writer.write(mask_words.data(), mask_words.size() * sizeof(uint64_t));
+    }
+
+    writer.write(types.data(), types.size() * sizeof(FileType));
+    for (std::vector<FileChunk> const &table : chunk_tables)
+        writer.write(table.data(), table.size() * sizeof(FileChunk));
+
+    for (size_t i = 0; i < type_ids.size(); ++i)
+    {
+        ComponentPool const &pool = m_component_pools[type_ids[i]];
+        uint64_t const chunk_bytes = s_chunk_size * pool.component_size;
+        std::vector<FileChunk> const &table = chunk_tables[i];
+        for (size_t j = 0; j < table.size(); ++j)
+        {
+            if (table[j].data_offset == 0)
+                continue;
+            writer.padTo(table[j].data_offset);
+            writer.write(pool.chunks[j].data, chunk_bytes);
+        }
+    }
+
+    return writer.good();
+}
+
+bool ComponentStorage::validHierarchy(
+    std::vector<HierarchyNode> const &nodes, std::vector<bool> const &alive)
+{
+    uint64_t const node_count = nodes.size();
+    uint64_t const null = HierarchyNode::s_null;
+    auto const validLink = [&](uint64_t link)
+    { return link == null || (link < node_count && alive[link]); };
+
+    uint64_t child_count = 0;
+    for (uint64_t i = 0; i < node_count; ++i)
+    {
+        HierarchyNode const &node = nodes[i];
+        if (!validLink(node.parent) || !validLink(node.first_child) ||
+            !validLink(node.next_sibling) || !validLink(node.prev_sibling))
+            return false;
+        if (!alive[i] && (node.parent != null || node.first_child != null))
+            return false;
+
+        // Links have to agree in both directions
+        if (node.parent == null)
+        {
+            if (node.next_sibling != null || node.prev_sibling != null)
+                return false;
+        }
+        else
+        {
+            child_count++;
+            if (node.prev_sibling == null &&
+                nodes[node.parent].first_child != i)
+                return false;
+        }
+        if (node.first_child != null &&
+            (nodes[node.first_child].parent != i ||
+             nodes[node.first_child].prev_sibling != null))
+            return false;
+        if (node.next_sibling != null &&
+            (nodes[node.next_sibling].prev_sibling != i ||
+             nodes[node.next_sibling].parent != node.parent))
+            return false;
+        if (node.prev_sibling != null &&
+            nodes[node.prev_sibling].next_sibling != i)
+            return false;
+    }
+
+    // Children in parent cycles aren't reachable from the roots
+    uint64_t reached_count = 0;
+    std::vector<uint64_t> stack;
+    for (uint64_t i = 0; i < node_count; ++i)
+    {
+        if (nodes[i].parent == null)
+            stack.push_back(i);
+        while (!stack.empty())
+        {
+            uint64_t child = nodes[stack.back()].first_child;
+            stack.pop_back();
+            while (child != null)
+            {
+                if (++reached_count > child_count)
+                    return false;
+                stack.push_back(child);
+                child = nodes[child].next_sibling;
+            }
+        }
+    }
+
+    return reached_count == child_count;
+}
+
+bool ComponentStorage::loadFromFile(std::filesystem::path const &path)
+{
+    clear();
+
+    FileMapping mapping;
+    if (!mapping.open(path))
+        return false;
+
+    uint8_t *const data = mapping.data();
+    uint64_t const size = mapping.size();
+
+    FileHeader header;
+    if (size < sizeof(header))
+        return false;
+    std::memcpy(&header, data, sizeof(header));
+
+    if (header.magic != s_magic || header.version != s_version ||
+        header.file_size != size || header.chunk_size != s_chunk_size ||
+        header.entity_count > EntityId::s_max_index + 1 ||
+        header.generation_floor > EntityId::s_max_generation ||
+        header.mask_word_count != (header.type_count + 63) / 64)
+        return false;
+
+    uint64_t const entity_count = header.entity_count;
+    uint64_t const max_chunk_count =
+        (entity_count + s_chunk_size - 1) / s_chunk_size;
+    if (!inBounds(
+            header.generations_offset, entity_count, sizeof(uint16_t), size) ||
+        !inBounds(header.alive_offset, entity_count, 1, size) ||
+        !inBounds(
+            header.freelist_offset, header.freelist_count, sizeof(uint64_t),
+            size) ||
+        !inBounds(
+            header.hierarchy_offset, header.hierarchy_node_count,
+            sizeof(HierarchyNode), size) ||
+        !inBounds(
+            header.masks_offset, entity_count * header.mask_word_count,
+            sizeof(uint64_t), size) ||
+        !inBounds(
+            header.types_offset, header.type_count, sizeof(FileType), size))
+        return false;
+
+    // Validate everything before touching the storage so that a bad file
+    // leaves it empty instead of half loaded
+    std::vector<FileType> types(header.type_count);
+    std::memcpy(
+        types.data(), data + header.types_offset,
+        types.size() * sizeof(FileType));
+    std::vector<uint64_t> type_ids;
+    type_ids.reserve(types.size());
+    std::vector<std::vector<FileChunk>> chunk_tables;
+    chunk_tables.reserve(types.size());
+    for (FileType const &type : types)
+    {
+        // Layout has to match the type registered in this process
+        uint64_t const type_id = TypeRegistry::typeId(type.stable_id);
+        TypeRegistry::TypeInfo const *type_info = TypeRegistry::info(type_id);
+        // Each type has a single pool so it can only be listed once
+        if (type_info == nullptr ||
+            std::find(type_ids.begin(), type_ids.end(), type_id) !=
+                type_ids.end() ||
+            type_info->size != type.component_size ||
+            type_info->alignment != type.component_alignment ||
+            type.chunk_count > max_chunk_count ||
+            !inBounds(
+                type.chunks_offset, type.chunk_count, sizeof(FileChunk), size))
+            return false;
+
+        uint64_t const chunk_bytes = s_chunk_size * type.component_size;
+        std::vector<FileChunk> &table = chunk_tables.emplace_back(
+            static_cast<size_t>(type.chunk_count));
+        std::memcpy(
+            table.data(), data + type.chunks_offset,
+            table.size() * sizeof(FileChunk));
+        for (FileChunk const &chunk : table)
+        {
+            if (chunk.data_offset != 0 &&
+                (chunk.data_offset % type.component_alignment != 0 ||
+                 !inBounds(chunk.data_offset, chunk_bytes, 1, size)))
+                return false;
+        }
+
+        type_ids.push_back(type_id);
+    }
+
+    std::vector<uint16_t> generations(entity_count);
+    std::memcpy(
+        generations.data(), data + header.generations_offset,
+        entity_count * sizeof(uint16_t));
+
+    std::vector<bool> alive(entity_count);
+    uint8_t const *alive_bytes = data + header.alive_offset;
+    for (uint64_t i = 0; i < entity_count; ++i)
+    {
+        alive[i] = alive_bytes[i] != 0;
+        if (alive[i] && generations[i] > EntityId::s_max_generation)
+            return false;
+    }
+
+    // Free slots have to be dead, reusable and listed once
+    if (header.freelist_count > entity_count)
+        return false;
+    std::deque<uint64_t> freelist;
+    std::vector<bool> listed(entity_count, false);
+    for (uint64_t i = 0; i < header.freelist_count; ++i)
+    {
+        uint64_t index;
+        std::memcpy(
+            &index, data + header.freelist_offset + i * sizeof(uint64_t),
+            sizeof(uint64_t));
+        if (index >= entity_count || alive[index] || listed[index] ||
+            generations[index] > EntityId::s_max_generation)
+            return false;
+        listed[index] = true;
+        freelist.push_back(index);
+    }
+
+    if (header.hierarchy_node_count > entity_count)
+        return false;
+    std::vector<HierarchyNode> hierarchy_nodes(header.hierarchy_node_count);
+    std::memcpy(
+        hierarchy_nodes.data(), data + header.hierarchy_offset,
+        hierarchy_nodes.size() * sizeof(HierarchyNode));
+    if (!validHierarchy(hierarchy_nodes, alive))
+        return false;
+
+    // The stored masks are in the file's type order so they have to be
+    // remapped to this process' type ids. Components have to be on alive
+    // entities, in stored chunks and match the stored counts.
+    std::vector<std::vector<uint64_t>> chunk_counts(types.size());
+    for (size_t i = 0; i < types.size(); ++i)
+        chunk_counts[i].resize(chunk_tables[i].size(), 0);
+    std::vector<ComponentMask> masks(entity_count);
+    uint8_t const *mask_words = data + header.masks_offset;
+    for (uint64_t i = 0; i < entity_count; ++i)
+    {
+        ComponentMask &mask = masks[i];
+        uint64_t const chunk_index = i / s_chunk_size;
+        for (uint64_t w = 0; w < header.mask_word_count; ++w)
+        {
+            uint64_t word;
+            std::memcpy(&word, mask_words, sizeof(word));
+            mask_words += sizeof(word);
+            if (word != 0 && !alive[i])
+                return false;
+            while (word != 0)
+            {
+                int const bit = std::countr_zero(word);
+                word &= word - 1;
+                uint64_t const file_type_index = w * 64 + bit;
+                if (file_type_index >= type_ids.size() ||
+                    chunk_index >= chunk_tables[file_type_index].size() ||
+                    chunk_tables[file_type_index][chunk_index].data_offset ==
+                        0)
+                    return false;
+                mask.set(type_ids[file_type_index]);
+                chunk_counts[file_type_index][chunk_index]++;
+            }
+        }
+    }
+    for (size_t i = 0; i < types.size(); ++i)
+    {
+        uint64_t total = 0;
+        for (size_t j = 0; j < chunk_tables[i].size(); ++j)
+        {
+            if (chunk_tables[i][j].count != chunk_counts[i][j])
+                return false;
+            total += chunk_counts[i][j];
+        }
+        if (types[i].count != total)
+            return false;
+    }
+
+    m_generation_floor = static_cast<uint16_t>(header.generation_floor);
+    m_entity_generations = std::move(generations);
+    m_entity_alive = std::move(alive);
+    m_entity_freelist = std::move(freelist);
+    m_hierarchy_nodes = std::move(hierarchy_nodes);
+    m_hierarchy_dirty = !m_hierarchy_nodes.empty();
+    m_hierarchy_changed_tick = m_change_tick;
+    m_entity_block_ticks.assign(
+        (entity_count + s_chunk_size - 1) / s_chunk_size, m_change_tick);
+    m_entity_changed_ticks.assign(entity_count, m_change_tick);
+    m_freelist_changed_tick = m_change_tick;
+    m_entity_component_masks = std::move(masks);
+
+    for (size_t i = 0; i < types.size(); ++i)
+    {
+        FileType const &type = types[i];
+        ComponentPool &pool = getPool(
+            type_ids[i], type.component_size, type.component_alignment);
+        pool.count = type.count;
+        pool.chunks.resize(type.chunk_count);
+        for (uint64_t j = 0; j < type.chunk_count; ++j)
+        {
+            FileChunk const &file_chunk = chunk_tables[i][j];
+            if (file_chunk.data_offset == 0)
+                continue;
+
+            uint32_t *const changed_ticks = new uint32_t[s_chunk_size];
+            std::fill_n(changed_ticks, s_chunk_size, m_change_tick);
+            pool.chunks[j] = ComponentChunk{
+                .data = data + file_chunk.data_offset,
+                .count = static_cast<uint32_t>(file_chunk.count),
+                .mapped = true,
+                .changed_tick = m_change_tick,
+                .changed_ticks = changed_ticks,
+            };
+        }
+    }
+
+    updatePresence(0, entity_count);
+    m_file_mapping = std::move(mapping);
+
+    return true;
+}
+
+} // namespace recs
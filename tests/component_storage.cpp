@@ -1,6 +1,11 @@
 #include <catch2/catch_test_macros.hpp>
 
 #include "recs/component_storage.hpp"
+#include "recs/thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <span>
+#include <vector>
 
 namespace
 {
@@ -217,4 +222,540 @@ TEST_CASE("getEntities")
             REQUIRE(ents.empty());
         }
     }
+
+    SECTION("Sparse intersections match the entity masks")
+    {
+        std::vector<recs::EntityId> entities;
+        for (uint32_t i = 0; i < 20000; ++i)
+        {
+            recs::EntityId const e = cs.addEntity();
+            entities.push_back(e);
+            if (i % 3 == 0)
+                cs.addComponent(e, DataF{});
+            if (i % 5 == 0)
+                cs.addComponent(e, DataI{});
+            // Clusters with empty ranges in between
+            if (i % 4096 < 100)
+                cs.addComponent(e, 0u);
+        }
+        for (uint32_t i = 0; i < 20000; i += 7)
+            cs.removeEntity(entities[i]);
+        for (uint32_t i = 1; i < 20000; i += 11)
+        {
+            if (cs.isValid(entities[i]) && cs.hasComponent<DataF>(entities[i]))
+                cs.removeComponent<DataF>(entities[i]);
+        }
+
+        recs::ComponentMask const f_mask = [] {
+            recs::ComponentMask m;
+            m.set(recs::TypeId::get<DataF>());
+            return m;
+        }();
+        recs::ComponentMask const fi_mask = [&] {
+            recs::ComponentMask m = f_mask;
+            m.set(recs::TypeId::get<DataI>());
+            return m;
+        }();
+        recs::ComponentMask const fiu_mask = [&] {
+            recs::ComponentMask m = fi_mask;
+            m.set(recs::TypeId::get<uint32_t>());
+            return m;
+        }();
+
+        for (recs::ComponentMask const &mask : {f_mask, fi_mask, fiu_mask})
+        {
+            std::vector<recs::EntityId> expected;
+            for (recs::EntityId const e : entities)
+            {
+                if (cs.isValid(e) &&
+                    (!mask.test(recs::TypeId::get<DataF>()) ||
+                     cs.hasComponent<DataF>(e)) &&
+                    (!mask.test(recs::TypeId::get<DataI>()) ||
+                     cs.hasComponent<DataI>(e)) &&
+                    (!mask.test(recs::TypeId::get<uint32_t>()) ||
+                     cs.hasComponent<uint32_t>(e)))
+                    expected.push_back(e);
+            }
+            REQUIRE(!expected.empty());
+            REQUIRE(
+                std::ranges::equal(cs.getEntities(mask).entities(), expected));
+        }
+    }
+}
+
+TEST_CASE("Hierarchy")
+{
+    recs::ComponentStorage cs;
+
+    //       r0      r1
+    //      /  \     |
+    //     a    b    c
+    //     |
+    //     d
+    recs::EntityId const r0 = cs.addEntity();
+    recs::EntityId const r1 = cs.addEntity();
+    recs::EntityId const a = cs.addEntity();
+    recs::EntityId const b = cs.addEntity();
+    recs::EntityId const c = cs.addEntity();
+    recs::EntityId const d = cs.addEntity();
+    recs::EntityId const loner = cs.addEntity();
+
+    cs.setParent(d, a);
+    cs.setParent(a, r0);
+    cs.setParent(b, r0);
+    cs.setParent(c, r1);
+
+    REQUIRE(cs.getParent(a) == r0);
+    REQUIRE(cs.getParent(d) == a);
+    REQUIRE(!cs.isValid(cs.getParent(r0)));
+    REQUIRE(!cs.isValid(cs.getParent(loner)));
+    REQUIRE(cs.getChildren(r0).size() == 2);
+    REQUIRE(cs.getChildren(loner).empty());
+
+    SECTION("Levels")
+    {
+        for (recs::EntityId const e : {r0, r1, a, b, c, d})
+            cs.addComponent(e, DataF{1.f});
+
+        cs.updateHierarchy();
+        REQUIRE(cs.hierarchyLevelCount() == 3);
+
+        recs::ComponentStorage::HierarchyLevel const level0 =
+            cs.getHierarchyLevel(0);
+        REQUIRE(level0.entities.size() == 2);
+        REQUIRE(level0.entities[0] == r0);
+        REQUIRE(level0.entities[1] == r1);
+        REQUIRE(!cs.isValid(level0.parents[0]));
+
+        recs::ComponentStorage::HierarchyLevel const level1 =
+            cs.getHierarchyLevel(1);
+        REQUIRE(level1.entities.size() == 3);
+        // Children of r0 are grouped before the child of r1
+        REQUIRE(level1.parents[0] == r0);
+        REQUIRE(level1.parents[1] == r0);
+        REQUIRE(level1.parents[2] == r1);
+        REQUIRE(level1.entities[2] == c);
+
+        recs::ComponentStorage::HierarchyLevel const level2 =
+            cs.getHierarchyLevel(2);
+        REQUIRE(level2.entities.size() == 1);
+        REQUIRE(level2.entities[0] == d);
+        REQUIRE(level2.parents[0] == a);
+
+        // Accumulate depth by propagating from parents, one level at a time
+        for (size_t depth = 1; depth < cs.hierarchyLevelCount(); ++depth)
+        {
+            recs::ComponentStorage::HierarchyLevel const level =
+                cs.getHierarchyLevel(depth);
+            for (size_t i = 0; i < level.entities.size(); ++i)
+                cs.getComponent<DataF>(level.entities[i]).f +=
+                    cs.getComponent<DataF>(level.parents[i]).f;
+        }
+        REQUIRE(cs.getComponent<DataF>(r0).f == 1.f);
+        REQUIRE(cs.getComponent<DataF>(b).f == 2.f);
+        REQUIRE(cs.getComponent<DataF>(d).f == 3.f);
+
+        // The same with the values kept by position
+        REQUIRE(cs.hierarchySize() == 6);
+        REQUIRE(level0.offset == 0);
+        REQUIRE(
+            level0.parent_positions[1] ==
+            recs::ComponentStorage::HierarchyLevel::s_no_parent);
+        REQUIRE(level1.offset == 2);
+        REQUIRE(level1.parent_positions[1] == 0);
+        REQUIRE(level1.parent_positions[2] == 1);
+        REQUIRE(level2.offset == 5);
+        REQUIRE(
+            level1.entities[level2.parent_positions[0] - level1.offset] == a);
+
+        std::vector<float> depths(cs.hierarchySize(), 1.f);
+        for (size_t depth = 1; depth < cs.hierarchyLevelCount(); ++depth)
+        {
+            recs::ComponentStorage::HierarchyLevel const level =
+                cs.getHierarchyLevel(depth);
+            for (size_t i = 0; i < level.entities.size(); ++i)
+                depths[level.offset + i] += depths[level.parent_positions[i]];
+        }
+        REQUIRE(depths[1] == 1.f);
+        REQUIRE(depths[4] == 2.f);
+        REQUIRE(depths[5] == 3.f);
+    }
+
+    SECTION("Reparent")
+    {
+        cs.setParent(a, r1);
+        REQUIRE(cs.getParent(a) == r1);
+        REQUIRE(cs.getChildren(r0).size() == 1);
+        REQUIRE(cs.getChildren(r1).size() == 2);
+
+        cs.removeParent(b);
+        REQUIRE(!cs.isValid(cs.getParent(b)));
+
+        cs.updateHierarchy();
+        REQUIRE(cs.hierarchyLevelCount() == 3);
+        REQUIRE(cs.getHierarchyLevel(0).entities.size() == 1);
+        REQUIRE(cs.getHierarchyLevel(1).entities.size() == 2);
+    }
+
+    SECTION("Remove entity detaches children")
+    {
+        cs.removeEntity(a);
+        REQUIRE(cs.isValid(d));
+        REQUIRE(!cs.isValid(cs.getParent(d)));
+        REQUIRE(cs.getChildren(r0).size() == 1);
+        REQUIRE(cs.getChildren(r0)[0] == b);
+    }
+
+    SECTION("Remove entity tree")
+    {
+        cs.removeEntityTree(r0);
+        REQUIRE(!cs.isValid(r0));
+        REQUIRE(!cs.isValid(a));
+        REQUIRE(!cs.isValid(b));
+        REQUIRE(!cs.isValid(d));
+        REQUIRE(cs.isValid(r1));
+        REQUIRE(cs.isValid(c));
+        REQUIRE(cs.isValid(loner));
+
+        cs.updateHierarchy();
+        REQUIRE(cs.hierarchyLevelCount() == 2);
+        REQUIRE(cs.getHierarchyLevel(0).entities[0] == r1);
+
+        // Reused handles shouldn't inherit stale links
+        recs::EntityId const e = cs.addEntity();
+        REQUIRE(!cs.isValid(cs.getParent(e)));
+        REQUIRE(cs.getChildren(e).empty());
+    }
+}
+
+TEST_CASE("Stats")
+{
+    recs::ComponentStorage ecs;
+
+    {
+        recs::ComponentStorage::Stats const stats = ecs.stats();
+        REQUIRE(stats.entity_count == 0);
+        REQUIRE(stats.entity_slot_count == 0);
+        REQUIRE(stats.components.empty());
+    }
+
+    std::vector<recs::EntityId> entities;
+    for (int i = 0; i < 600; ++i)
+    {
+        recs::EntityId const e = ecs.addEntity();
+        entities.push_back(e);
+        ecs.addComponent(e, DataF{});
+        if (i % 2 == 0)
+            ecs.addComponent(e, DataI{});
+    }
+    for (int i = 0; i < 100; ++i)
+        ecs.removeEntity(entities[static_cast<size_t>(i)]);
+
+    recs::ComponentStorage::Stats const stats = ecs.stats();
+    REQUIRE(stats.entity_count == 500);
+    REQUIRE(stats.entity_slot_count == 600);
+    REQUIRE(stats.dead_slot_count == 100);
+    REQUIRE(stats.freelist_length == 100);
+    REQUIRE(stats.mask_table_bytes >= 600 * sizeof(recs::ComponentMask));
+    REQUIRE(stats.components.size() == 2);
+
+    auto const findType =
+        [&](uint64_t type_id) -> recs::ComponentStorage::ComponentStats const &
+    {
+        for (recs::ComponentStorage::ComponentStats const &s : stats.components)
+        {
+            if (s.type_id == type_id)
+                return s;
+        }
+        FAIL("Missing type");
+        return stats.components.front();
+    };
+
+    recs::ComponentStorage::ComponentStats const &f =
+        findType(recs::TypeId::get<DataF>());
+    REQUIRE(f.count == 500);
+    REQUIRE(f.chunk_count == 2);
+    REQUIRE(f.mapped_chunk_count == 0);
+    REQUIRE(f.empty_slot_count == 2 * 512 - 500);
+    REQUIRE(f.payload_bytes == 500 * sizeof(DataF));
+    REQUIRE(f.overhead_bytes >= 524 * sizeof(DataF));
+
+    recs::ComponentStorage::ComponentStats const &i =
+        findType(recs::TypeId::get<DataI>());
+    REQUIRE(i.count == 250);
+    REQUIRE(i.chunk_count == 2);
+    REQUIRE(i.payload_bytes == 250 * sizeof(DataI));
+
+    REQUIRE(
+        stats.component_payload_bytes == f.payload_bytes + i.payload_bytes);
+    REQUIRE(
+        stats.total_bytes >
+        stats.component_payload_bytes + stats.component_overhead_bytes +
+            stats.mask_table_bytes + stats.entity_table_bytes);
+}
+
+TEST_CASE("Compact")
+{
+    recs::ComponentStorage ecs;
+
+    std::vector<recs::EntityId> entities;
+    for (int i = 0; i < 3000; ++i)
+    {
+        recs::EntityId const e = ecs.addEntity();
+        entities.push_back(e);
+        ecs.addComponent(e, DataF{static_cast<float>(i)});
+        if (i >= 1000)
+            ecs.addComponent(e, DataI{i});
+    }
+    ecs.setParent(entities[1], entities[0]);
+
+    // Keep a live entity in the middle so that the slots before it can't be
+    // trimmed
+    for (size_t i = 2; i < 3000; ++i)
+    {
+        if (i != 1500)
+            ecs.removeEntity(entities[i]);
+    }
+
+    REQUIRE(ecs.compact());
+
+    recs::ComponentStorage::Stats const stats = ecs.stats();
+    REQUIRE(stats.entity_count == 3);
+    REQUIRE(stats.entity_slot_count == 1501);
+    REQUIRE(stats.freelist_length == 1498);
+    for (recs::ComponentStorage::ComponentStats const &s : stats.components)
+    {
+        if (s.type_id == recs::TypeId::get<DataF>())
+        {
+            REQUIRE(s.count == 3);
+            REQUIRE(s.chunk_count == 2);
+        }
+        else
+        {
+            REQUIRE(s.count == 1);
+            REQUIRE(s.chunk_count == 1);
+        }
+    }
+
+    REQUIRE(ecs.isValid(entities[0]));
+    REQUIRE(ecs.isValid(entities[1]));
+    REQUIRE(ecs.isValid(entities[1500]));
+    REQUIRE(ecs.getParent(entities[1]) == entities[0]);
+    REQUIRE(ecs.readComponent<DataF>(entities[1]).f == 1.f);
+    REQUIRE(ecs.readComponent<DataI>(entities[1500]).i == 1500);
+    REQUIRE(!ecs.isValid(entities[1000]));
+    REQUIRE(!ecs.isValid(entities[2999]));
+    REQUIRE(ecs.getEntities(recs::ComponentMask{}).size() == 3);
+
+    // Freed chunks are allocated again when needed
+    ecs.addComponent(entities[0], DataI{-1});
+    REQUIRE(ecs.readComponent<DataI>(entities[0]).i == -1);
+
+    // Slots are reused from the freelist first, then regrown without matching
+    // the trimmed ids
+    for (int i = 0; i < 2000; ++i)
+        (void)ecs.addEntity();
+    for (recs::EntityId const e : entities)
+    {
+        if (e != entities[0] && e != entities[1] && e != entities[1500])
+            REQUIRE(!ecs.isValid(e));
+    }
+
+    SECTION("Incremental")
+    {
+        std::vector<recs::EntityId> added;
+        for (int i = 0; i < 40000; ++i)
+        {
+            recs::EntityId const e = ecs.addEntity();
+            ecs.addComponent(e, DataF{});
+            added.push_back(e);
+        }
+        for (recs::EntityId const e : added)
+            ecs.removeEntity(e);
+
+        uint32_t steps = 1;
+        while (!ecs.compact(std::chrono::nanoseconds{0}))
+            steps++;
+        REQUIRE(steps > 1);
+
+        for (recs::ComponentStorage::ComponentStats const &s :
+             ecs.stats().components)
+        {
+            if (s.type_id == recs::TypeId::get<DataF>())
+                REQUIRE(s.chunk_count == 2);
+        }
+        REQUIRE(ecs.isValid(entities[1500]));
+    }
+}
+
+TEST_CASE("Reserve")
+{
+    recs::ComponentStorage ecs;
+
+    std::vector<recs::EntityId> entities;
+    for (int i = 0; i < 10; ++i)
+        entities.push_back(ecs.addEntity());
+    ecs.removeEntity(entities[3]);
+    ecs.removeEntity(entities[4]);
+
+    ecs.reserveEntities(2000);
+    ecs.reserveComponents<DataF>(2000);
+
+    auto const dataFStats = [&]
+    {
+        for (recs::ComponentStorage::ComponentStats const &s :
+             ecs.stats().components)
+        {
+            if (s.type_id == recs::TypeId::get<DataF>())
+                return s;
+        }
+        FAIL("Missing type");
+        return recs::ComponentStorage::ComponentStats{};
+    };
+
+    recs::ComponentStorage::Stats const reserved_stats = ecs.stats();
+    REQUIRE(
+        reserved_stats.mask_table_bytes >=
+        2008 * sizeof(recs::ComponentMask));
+    recs::ComponentStorage::ComponentStats const reserved = dataFStats();
+    REQUIRE(reserved.count == 0);
+    // Slots 3 and 4 are reused, then 2008 slots cover four chunks
+    REQUIRE(reserved.chunk_count == 4);
+
+    for (int i = 0; i < 2000; ++i)
+    {
+        recs::EntityId const e = ecs.addEntity();
+        ecs.addComponent(e, DataF{static_cast<float>(i)});
+        entities.push_back(e);
+    }
+
+    recs::ComponentStorage::Stats const stats = ecs.stats();
+    REQUIRE(stats.mask_table_bytes == reserved_stats.mask_table_bytes);
+    // The freelist is counted by its length so this shrinks
+    REQUIRE(stats.entity_table_bytes <= reserved_stats.entity_table_bytes);
+    recs::ComponentStorage::ComponentStats const added = dataFStats();
+    REQUIRE(added.count == 2000);
+    REQUIRE(added.chunk_count == reserved.chunk_count);
+    // Filled slots move from the overhead to the payload, so the total only
+    // changes if e.g. the presence bits grow
+    REQUIRE(
+        added.payload_bytes + added.overhead_bytes ==
+        reserved.payload_bytes + reserved.overhead_bytes);
+    REQUIRE(ecs.readComponent<DataF>(entities.back()).f == 1999.f);
+}
+
+TEST_CASE("getEntities parallel")
+{
+    recs::ComponentStorage cs;
+
+    std::vector<recs::EntityId> entities;
+    for (uint32_t i = 0; i < 300000; ++i)
+    {
+        recs::EntityId const e = cs.addEntity();
+        entities.push_back(e);
+        if (i % 2 == 0)
+            cs.addComponent(e, DataF{});
+        if (i % 100000 < 5000)
+            cs.addComponent(e, DataI{});
+    }
+    for (uint32_t i = 0; i < 300000; i += 3)
+        cs.removeEntity(entities[i]);
+
+    recs::ComponentMask f_mask;
+    f_mask.set(recs::TypeId::get<DataF>());
+    recs::ComponentMask fi_mask = f_mask;
+    fi_mask.set(recs::TypeId::get<DataI>());
+    recs::ComponentMask missing_mask;
+    missing_mask.set(recs::TypeId::get<double>());
+
+    recs::ThreadPool pool{4};
+    for (recs::ComponentMask const &mask :
+         {recs::ComponentMask{}, f_mask, fi_mask, missing_mask})
+    {
+        REQUIRE(std::ranges::equal(
+            cs.getEntities(mask, pool).entities(),
+            cs.getEntities(mask).entities()));
+    }
+
+    SECTION("From tasks of the same pool")
+    {
+        size_t const expected = cs.getEntities(f_mask).size();
+        std::atomic<uint32_t> matching{0};
+        {
+            recs::ThreadPool task_pool{2};
+            for (uint32_t i = 0; i < 8; ++i)
+            {
+                task_pool.submit(
+                    [&]
+                    {
+                        if (cs.getEntities(f_mask, task_pool).size() ==
+                            expected)
+                            matching++;
+                    });
+            }
+        }
+        REQUIRE(matching == 8);
+    }
+}
+
+TEST_CASE("Observers")
+{
+    recs::ComponentStorage ecs;
+
+    std::vector<recs::EntityId> added;
+    std::vector<recs::EntityId> removed;
+    size_t add_batch_count = 0;
+    ecs.onAdd<DataF>(
+        [&](std::span<recs::EntityId const> entities)
+        {
+            added.insert(added.end(), entities.begin(), entities.end());
+            add_batch_count++;
+        });
+    ecs.onRemove<DataF>(
+        [&](std::span<recs::EntityId const> entities)
+        { removed.insert(removed.end(), entities.begin(), entities.end()); });
+
+    recs::EntityId const e0 = ecs.addEntity();
+    recs::EntityId const e1 = ecs.addEntity();
+    recs::EntityId const e2 = ecs.addEntity();
+    ecs.addComponent(e0, DataF{});
+    ecs.addComponent(e1, DataF{});
+    // Unobserved types don't buffer anything
+    ecs.addComponent(e2, DataI{});
+
+    // Nothing is delivered before the flush
+    REQUIRE(added.empty());
+    ecs.flushObservers();
+    REQUIRE(added == std::vector<recs::EntityId>{e0, e1});
+    REQUIRE(add_batch_count == 1);
+    REQUIRE(removed.empty());
+
+    ecs.flushObservers();
+    REQUIRE(add_batch_count == 1);
+
+    ecs.removeComponent<DataF>(e1);
+    ecs.removeEntity(e0);
+    ecs.removeEntity(e2);
+    ecs.flushObservers();
+    REQUIRE(removed == std::vector<recs::EntityId>{e1, e0});
+    REQUIRE(add_batch_count == 1);
+
+    SECTION("Changes from observers")
+    {
+        // Observers can change the storage and the resulting events are
+        // delivered in the same flush
+        ecs.onAdd<DataI>(
+            [&](std::span<recs::EntityId const> entities)
+            {
+                for (recs::EntityId const id : entities)
+                    ecs.addComponent(id, DataF{});
+            });
+
+        recs::EntityId const e3 = ecs.addEntity();
+        ecs.addComponent(e3, DataI{});
+        added.clear();
+        ecs.flushObservers();
+        REQUIRE(added == std::vector<recs::EntityId>{e3});
+        REQUIRE(ecs.hasComponent<DataF>(e3));
+    }
 }
@@ -0,0 +1,196 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "recs/component_storage.hpp"
+#include "recs/type_registry.hpp"
+#include <algorithm>
+
+namespace
+{
+
+struct Velocity
+{
+    float x{0.f};
+    float y{0.f};
+};
+
+struct Score
+{
+    uint32_t value{0};
+};
+
+struct Unregistered
+{
+    uint8_t value{0};
+};
+
+void requireMatch(
+    recs::ComponentStorage const &source, recs::ComponentStorage const &replica,
+    std::vector<recs::EntityId> const &entities)
+{
+    REQUIRE(std::ranges::equal(
+        source.getEntities(recs::ComponentMask{}).entities(),
+        replica.getEntities(recs::ComponentMask{}).entities()));
+    for (recs::EntityId const e : entities)
+    {
+        REQUIRE(source.isValid(e) == replica.isValid(e));
+        if (!source.isValid(e))
+            continue;
+
+        REQUIRE(
+            source.hasComponent<Velocity>(e) ==
+            replica.hasComponent<Velocity>(e));
+        if (source.hasComponent<Velocity>(e))
+        {
+            REQUIRE(
+                source.readComponent<Velocity>(e).x ==
+                replica.readComponent<Velocity>(e).x);
+            REQUIRE(
+                source.readComponent<Velocity>(e).y ==
+                replica.readComponent<Velocity>(e).y);
+        }
+
+        REQUIRE(
+            source.hasComponent<Score>(e) == replica.hasComponent<Score>(e));
+        if (source.hasComponent<Score>(e))
+            REQUIRE(
+                source.readComponent<Score>(e).value ==
+                replica.readComponent<Score>(e).value);
+    }
+}
+
+} // namespace
+
+TEST_CASE("Delta")
+{
+    recs::TypeRegistry::registerType<Velocity>("Velocity");
+    recs::TypeRegistry::registerType<Score>("Score");
+
+    recs::ComponentStorage source;
+    recs::ComponentStorage replica;
+
+    std::vector<recs::EntityId> entities;
+    for (uint32_t i = 0; i < 2000; ++i)
+    {
+        recs::EntityId const e = source.addEntity();
+        entities.push_back(e);
+        source.addComponent(e, Velocity{static_cast<float>(i), 0.f});
+        if (i % 2 == 0)
+            source.addComponent(e, Score{i});
+    }
+    source.removeEntity(entities[5]);
+
+    std::vector<uint8_t> delta;
+    REQUIRE(source.writeDelta(0, delta));
+    REQUIRE(replica.applyDelta(delta));
+    requireMatch(source, replica, entities);
+
+    uint32_t const tick = source.advanceChangeTick();
+
+    SECTION("Nothing changed")
+    {
+        delta.clear();
+        REQUIRE(source.writeDelta(tick, delta));
+        REQUIRE(delta.size() < 64);
+        REQUIRE(replica.applyDelta(delta));
+        requireMatch(source, replica, entities);
+    }
+
+    SECTION("Changes")
+    {
+        // Reads don't show up in the delta
+        REQUIRE(source.readComponent<Velocity>(entities[100]).x == 100.f);
+        source.getComponent<Velocity>(entities[10]).y = 1.f;
+
+        delta.clear();
+        REQUIRE(source.writeDelta(tick, delta));
+        REQUIRE(delta.size() < 64 + sizeof(Velocity));
+        REQUIRE(replica.applyDelta(delta));
+        requireMatch(source, replica, entities);
+
+        uint32_t const tick2 = source.advanceChangeTick();
+        source.removeComponent<Score>(entities[20]);
+        source.addComponent(entities[21], Score{21});
+        source.removeEntity(entities[30]);
+        // Reuses the slot of 30 with a new generation
+        recs::EntityId const added = source.addEntity();
+        source.addComponent(added, Score{9999});
+        entities.push_back(added);
+        for (uint32_t i = 0; i < 10; ++i)
+            entities.push_back(source.addEntity());
+        source.getComponent<Velocity>(entities[1999]).x = -1.f;
+
+        delta.clear();
+        REQUIRE(source.writeDelta(tick2, delta));
+        REQUIRE(replica.applyDelta(delta));
+        requireMatch(source, replica, entities);
+        REQUIRE(!replica.isValid(entities[30]));
+        REQUIRE(replica.readComponent<Score>(added).value == 9999);
+
+        // The freelist is replicated so the replica keeps allocating
+        // the same ids as the source
+        REQUIRE(source.addEntity() == replica.addEntity());
+    }
+
+    SECTION("Compaction")
+    {
+        for (uint32_t i = 1000; i < 2000; ++i)
+            source.removeEntity(entities[i]);
+        REQUIRE(source.compact());
+
+        delta.clear();
+        REQUIRE(source.writeDelta(tick, delta));
+        REQUIRE(replica.applyDelta(delta));
+        requireMatch(source, replica, entities);
+
+        uint32_t const tick2 = source.advanceChangeTick();
+        // Regrows the trimmed slots with generations the replica hasn't seen
+        for (uint32_t i = 0; i < 10; ++i)
+            entities.push_back(source.addEntity());
+        delta.clear();
+        REQUIRE(source.writeDelta(tick2, delta));
+        REQUIRE(replica.applyDelta(delta));
+        requireMatch(source, replica, entities);
+        REQUIRE(!replica.isValid(entities[1000]));
+        REQUIRE(replica.isValid(entities.back()));
+    }
+
+    SECTION("Invalid deltas")
+    {
+        std::vector<uint8_t> const truncated{
+            delta.begin(), delta.begin() + delta.size() / 2};
+        recs::ComponentStorage other;
+        REQUIRE(!other.applyDelta(truncated));
+        REQUIRE(!other.applyDelta(std::span<uint8_t const>{}));
+
+        source.addComponent(entities[0], Unregistered{});
+        delta.clear();
+        REQUIRE(!source.writeDelta(0, delta));
+    }
+
+    SECTION("Generations")
+    {
+        // A single entity record without components. Generations are 3 byte
+        // varints.
+        auto const singleEntity = [](uint16_t generation, bool alive)
+        {
+            return std::vector<uint8_t>{
+                // Magic and version
+                0x52, 0x44, 0x4c, 0x54, 1, 0, 0, 0,
+                // Since tick, tick, entity count, type count, record count
+                0, 1, 1, 0, 1,
+                // Index delta, generation, alive, component count
+                0, static_cast<uint8_t>(0x80 | (generation & 0x7f)),
+                static_cast<uint8_t>(0x80 | ((generation >> 7) & 0x7f)),
+                static_cast<uint8_t>(generation >> 14),
+                static_cast<uint8_t>(alive ? 1 : 0), 0,
+                // No freelist
+                0};
+        };
+
+        recs::ComponentStorage other;
+        REQUIRE(other.applyDelta(singleEntity(0xFFFE, true)));
+        // Retired slots go one past the max generation
+        REQUIRE(other.applyDelta(singleEntity(0xFFFF, false)));
+        REQUIRE(!other.applyDelta(singleEntity(0xFFFF, true)));
+    }
+}
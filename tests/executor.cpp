@@ -0,0 +1,94 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "recs/executor.hpp"
+#include "recs/thread_pool.hpp"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+TEST_CASE("Executor")
+{
+    SECTION("Serial")
+    {
+        recs::SerialExecutor executor;
+        uint32_t const unknown_thread = recs::Executor::s_unknown_thread;
+        REQUIRE(executor.currentThread() == unknown_thread);
+
+        std::atomic<uint32_t> counter{6};
+        std::vector<uint32_t> order;
+        for (uint32_t i = 0; i < 3; ++i)
+        {
+            executor.submit(
+                [&, i]
+                {
+                    order.push_back(i);
+                    executor.decrement(counter);
+                    // Tasks can submit more tasks
+                    executor.submit(
+                        [&, i]
+                        {
+                            order.push_back(10 + i);
+                            executor.decrement(counter);
+                        });
+                });
+        }
+        // Nothing runs before waiting
+        REQUIRE(order.empty());
+
+        executor.wait(counter);
+        REQUIRE(counter == 0);
+        REQUIRE(order == std::vector<uint32_t>{0, 1, 2, 10, 11, 12});
+    }
+
+    SECTION("Pool")
+    {
+        recs::ThreadPool pool{4};
+        recs::PoolExecutor executor{pool};
+
+        std::atomic<uint32_t> counter{1000};
+        std::atomic<uint32_t> sum{0};
+        std::atomic<bool> on_workers{true};
+        for (uint32_t i = 0; i < 1000; ++i)
+        {
+            executor.submit(
+                [&, i]
+                {
+                    if (executor.currentThread() >= pool.threadCount())
+                        on_workers = false;
+                    sum += i;
+                    executor.decrement(counter);
+                });
+        }
+
+        executor.wait(counter);
+        REQUIRE(sum == 999 * 1000 / 2);
+        REQUIRE(on_workers);
+    }
+
+    SECTION("Waiter tasks")
+    {
+        recs::ThreadPool pool{4};
+        recs::PoolExecutor executor{pool};
+
+        std::atomic<uint32_t> counter{20};
+        std::vector<std::thread::id> threads(10);
+        for (uint32_t i = 0; i < 10; ++i)
+        {
+            executor.submit(
+                [&, i]
+                {
+                    executor.submitToWaiter(
+                        [&, i]
+                        {
+                            threads[i] = std::this_thread::get_id();
+                            executor.decrement(counter);
+                        });
+                    executor.decrement(counter);
+                });
+        }
+
+        executor.wait(counter);
+        for (std::thread::id const thread : threads)
+            REQUIRE(thread == std::this_thread::get_id());
+    }
+}
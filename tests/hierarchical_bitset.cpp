@@ -0,0 +1,64 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "recs/hierarchical_bitset.hpp"
+
+TEST_CASE("HierarchicalBitset")
+{
+    recs::HierarchicalBitset bits;
+    REQUIRE(bits.words().empty());
+    REQUIRE(bits.summary().empty());
+    REQUIRE(!bits.test(0));
+    // Resetting past the end is a no-op
+    bits.reset(100000);
+
+    bits.set(3);
+    bits.set(64 * 64 + 1);
+    REQUIRE(bits.test(3));
+    REQUIRE(!bits.test(4));
+    REQUIRE(bits.test(64 * 64 + 1));
+    REQUIRE(bits.words().size() == 65);
+    REQUIRE(bits.summary().size() == 2);
+    REQUIRE(bits.summary()[0] == 1);
+    REQUIRE(bits.summary()[1] == 1);
+
+    bits.set(5);
+    bits.reset(3);
+    REQUIRE(bits.summary()[0] == 1);
+    bits.reset(5);
+    REQUIRE(bits.words()[0] == 0);
+    REQUIRE(bits.summary()[0] == 0);
+
+    bits.set(70);
+    REQUIRE(bits.summary()[0] == 2);
+
+    SECTION("Truncate")
+    {
+        bits.truncate(71);
+        REQUIRE(bits.test(70));
+        REQUIRE(!bits.test(64 * 64 + 1));
+        REQUIRE(bits.words().size() == 2);
+        REQUIRE(bits.summary().size() == 1);
+
+        bits.truncate(70);
+        REQUIRE(bits.words().empty());
+        REQUIRE(bits.summary().empty());
+    }
+
+    SECTION("Reserve")
+    {
+        uint64_t const count = 3 * 64 * 64;
+        bits.reserve(count);
+        uint64_t const reserved_bytes = bits.allocatedBytes();
+        bits.set(count - 1);
+        REQUIRE(bits.test(count - 1));
+        REQUIRE(bits.allocatedBytes() == reserved_bytes);
+    }
+
+    SECTION("Clear")
+    {
+        bits.clear();
+        REQUIRE(!bits.test(70));
+        REQUIRE(bits.words().empty());
+        REQUIRE(bits.summary().empty());
+    }
+}
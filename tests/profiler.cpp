@@ -0,0 +1,120 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "recs/profiler.hpp"
+#include "recs/scheduler.hpp"
+#include "recs/thread_pool.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+
+struct Counter
+{
+    uint32_t value{0};
+};
+
+struct Marker
+{
+};
+
+using CounterEntity = recs::Access::Write<Counter>::As<recs::Entity>;
+using MarkedEntity =
+    recs::Access::Read<Counter>::With<Marker>::As<recs::Entity>;
+
+void countSystem(CounterEntity e) { e.getComponent<Counter>().value++; }
+
+void markedSystem(MarkedEntity e) { (void)e.getComponent<Counter>(); }
+
+} // namespace
+
+TEST_CASE("Profiler")
+{
+    recs::ComponentStorage cs;
+    for (uint32_t i = 0; i < 100; ++i)
+    {
+        recs::EntityId const e = cs.addEntity();
+        cs.addComponent(e, Counter{});
+        if (i % 4 == 0)
+            cs.addComponent(e, Marker{});
+    }
+
+    recs::Scheduler scheduler;
+    recs::SystemRef const count =
+        scheduler.registerSystem(countSystem, "Count");
+    scheduler.registerSystem(markedSystem).executeAfter(count);
+    recs::Schedule const schedule = scheduler.buildSchedule();
+
+    recs::Profiler profiler{3};
+
+    // Disabled by default
+    schedule.execute(cs, &profiler);
+    REQUIRE(profiler.frameCount() == 0);
+
+    profiler.setEnabled(true);
+
+    SECTION("Serial")
+    {
+        for (uint32_t i = 0; i < 5; ++i)
+            schedule.execute(cs, &profiler);
+    }
+
+    SECTION("Parallel")
+    {
+        recs::ThreadPool pool{2};
+        for (uint32_t i = 0; i < 5; ++i)
+            schedule.execute(cs, pool, &profiler);
+    }
+
+    // Only the most recent frames are kept
+    REQUIRE(profiler.frameCount() == 3);
+    for (size_t i = 0; i < profiler.frameCount(); ++i)
+    {
+        recs::Profiler::FrameSample const &frame = profiler.frame(i);
+        REQUIRE(frame.frame == i + 2);
+        REQUIRE(frame.systems.size() == 2);
+
+        recs::Profiler::SystemSample const &counted = frame.systems[0];
+        REQUIRE(counted.name == "Count");
+        REQUIRE(counted.entity_count == 100);
+
+        recs::Profiler::SystemSample const &marked = frame.systems[1];
+        REQUIRE(marked.name == "System 1");
+        REQUIRE(marked.entity_count == 25);
+        REQUIRE(marked.start_ns >= counted.end_ns);
+        REQUIRE(frame.start_ns <= counted.start_ns);
+        REQUIRE(frame.end_ns >= marked.end_ns);
+    }
+
+    std::stringstream trace;
+    profiler.writeChromeTrace(trace);
+    std::string const json = trace.str();
+    REQUIRE(json.starts_with("{\"traceEvents\":["));
+    REQUIRE(json.find("\"name\":\"Count\"") != std::string::npos);
+    REQUIRE(json.find("\"entities\":25") != std::string::npos);
+
+    // Frames recorded at different times have distinct, increasing timestamps
+    // at full precision
+    std::vector<double> frame_ts;
+    for (size_t pos = json.find(R"("cat":"frame")"); pos != std::string::npos;
+         pos = json.find(R"("cat":"frame")", pos + 1))
+    {
+        size_t const ts = json.find("\"ts\":", pos);
+        REQUIRE(ts != std::string::npos);
+        frame_ts.push_back(std::strtod(json.c_str() + ts + 5, nullptr));
+    }
+    REQUIRE(frame_ts.size() == profiler.frameCount());
+    for (size_t i = 0; i < frame_ts.size(); ++i)
+    {
+        double const expected_us =
+            static_cast<double>(profiler.frame(i).start_ns) / 1000.;
+        REQUIRE(std::abs(frame_ts[i] - expected_us) < 0.01);
+        if (i > 0)
+            REQUIRE(frame_ts[i] > frame_ts[i - 1]);
+    }
+
+    profiler.clear();
+    REQUIRE(profiler.frameCount() == 0);
+}
@@ -1,8 +1,19 @@
 #include <catch2/catch_test_macros.hpp>
 
 #include "recs/access.hpp"
+#include "recs/executor.hpp"
+#include "recs/profiler.hpp"
 #include "recs/scheduler.hpp"
+#include "recs/thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
+#include <limits>
+#include <numeric>
+#include <span>
+#include <thread>
+#include <vector>
 
 namespace
 {
@@ -101,6 +112,254 @@ void setUpGraph(Dag const &dag)
     dag.g.executeAfter(dag.e);
 }
 
+struct Buffered
+{
+    int32_t value{0};
+};
+
+static std::vector<char> s_run_order;
+void orderShortSystem(UintEntity) { s_run_order.push_back('s'); }
+void orderHeadSystem(UintEntity) { s_run_order.push_back('h'); }
+void orderTailSystem(UintEntity) { s_run_order.push_back('t'); }
+
+static std::thread::id s_main_thread_id;
+void mainThreadSystem(UintEntity)
+{
+    s_main_thread_id = std::this_thread::get_id();
+}
+
+static uint32_t s_pinned_worker = recs::ThreadPool::s_not_a_worker;
+void pinnedSystem(UintEntity)
+{
+    s_pinned_worker = recs::ThreadPool::currentWorkerIndex();
+}
+
+static uint32_t s_matched_calls = 0;
+void matchedSystem(IntEntity, UintQuery const &) { s_matched_calls++; }
+
+using IntWriteQuery = recs::Access::Write<int32_t>::As<recs::Query>;
+
+// Increments each entity once, two entities per execution
+recs::SystemTask sliceSystem(recs::SystemFrame<IntWriteQuery> &frame)
+{
+    size_t i = 0;
+    while (true)
+    {
+        IntWriteQuery const query = frame.query();
+        if (i >= query.size())
+            break;
+
+        size_t const end = std::min(i + 2, query.size());
+        for (; i < end; ++i)
+            query[i].getComponent<int32_t>() += 1;
+
+        co_await frame.nextFrame();
+    }
+}
+
+// Increments each entity once, yielding whenever the budget runs out
+recs::SystemTask budgetSystem(recs::SystemFrame<IntWriteQuery> &frame)
+{
+    for (size_t i = 0; i < frame.query().size(); ++i)
+    {
+        frame.query()[i].getComponent<int32_t>() += 1;
+        co_await frame.yieldIfOverBudget();
+    }
+}
+
+struct Visits
+{
+    uint32_t count{0};
+};
+using VisitEntity = recs::Access::Write<Visits>::As<recs::Entity>;
+void visitSystem(VisitEntity e) { e.getComponent<Visits>().count++; }
+
+struct PipeCount
+{
+    uint32_t value{0};
+};
+using PipeWriteEntity = recs::Access::Write<PipeCount>::As<recs::Entity>;
+using PipeReadEntity = recs::Access::Read<PipeCount>::As<recs::Entity>;
+void pipeWriteSystem(PipeWriteEntity e) { e.getComponent<PipeCount>().value++; }
+
+static std::vector<uint32_t> s_pipe_reads;
+void pipeReadSystem(PipeReadEntity e)
+{
+    s_pipe_reads.push_back(e.getComponent<PipeCount>().value);
+}
+
+struct Slow
+{
+};
+struct Fast
+{
+};
+using SlowEntity = recs::Access::Write<Slow>::As<recs::Entity>;
+using FastEntity = recs::Access::Write<Fast>::As<recs::Entity>;
+
+static std::atomic<uint32_t> s_fast_runs{0};
+void fastSystem(FastEntity) { s_fast_runs++; }
+
+// Waits on its first run for the next frame's fast system
+static std::atomic<bool> s_slow_overlapped{false};
+static bool s_slow_first_run = true;
+void slowSystem(SlowEntity)
+{
+    if (!s_slow_first_run)
+        return;
+    s_slow_first_run = false;
+
+    auto const deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds{5};
+    while (s_fast_runs < 2)
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+            return;
+        std::this_thread::yield();
+    }
+    s_slow_overlapped = true;
+}
+
+struct DetValue
+{
+    uint64_t value{0};
+};
+struct DetStep
+{
+    uint64_t step{0};
+};
+struct DetMix
+{
+    uint64_t mix{0};
+};
+
+using DetStepEntity =
+    recs::Access::Read<DetStep>::Write<DetValue>::As<recs::Entity>;
+void detStepSystem(DetStepEntity e)
+{
+    uint64_t &value = e.getComponent<DetValue>().value;
+    value = value * 6364136223846793005ull + e.getComponent<DetStep>().step;
+}
+
+using DetMixQuery =
+    recs::Access::Read<DetValue>::Write<DetMix>::As<recs::Query>;
+recs::SystemTask detMixSystem(recs::SystemFrame<DetMixQuery> &frame)
+{
+    for (size_t i = 0; i < frame.query().size(); ++i)
+    {
+        auto const e = frame.query()[i];
+        e.getComponent<DetMix>().mix ^= e.getComponent<DetValue>().value >> 7;
+        co_await frame.yieldIfOverBudget();
+    }
+}
+
+// FNV-1a over the live ids and their components
+uint64_t hashWorld(recs::ComponentStorage const &storage)
+{
+    uint64_t hash = 14695981039346656037ull;
+    auto const add = [&hash](void const *data, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= static_cast<uint8_t const *>(data)[i];
+            hash *= 1099511628211ull;
+        }
+    };
+
+    recs::ComponentStorage::Range const entities =
+        storage.getEntities(recs::ComponentMask{});
+    for (recs::EntityId const e : entities.entities())
+    {
+        add(&e, sizeof(e));
+        add(&storage.readComponent<DetValue>(e), sizeof(DetValue));
+        add(&storage.readComponent<DetMix>(e), sizeof(DetMix));
+    }
+    return hash;
+}
+
+// Forwards to a SerialExecutor and counts the submitted tasks
+class CountingExecutor : public recs::Executor
+{
+  public:
+    void submit(std::function<void()> &&task) override
+    {
+        submit_count++;
+        m_executor.submit(std::move(task));
+    }
+    void submitToWaiter(std::function<void()> &&task) override
+    {
+        submit_count++;
+        m_executor.submitToWaiter(std::move(task));
+    }
+    void wait(std::atomic<uint32_t> &counter) override
+    {
+        m_executor.wait(counter);
+    }
+    void decrement(std::atomic<uint32_t> &counter) override
+    {
+        m_executor.decrement(counter);
+    }
+
+    uint32_t submit_count{0};
+
+  private:
+    recs::SerialExecutor m_executor;
+};
+
+} // namespace
+
+template <> struct recs::DoubleBuffered<Buffered> : std::true_type
+{
+};
+
+namespace
+{
+
+using BufferedReadEntity = recs::Access::Read<Buffered>::As<recs::Entity>;
+using BufferedWriteEntity = recs::Access::Write<Buffered>::As<recs::Entity>;
+
+static std::atomic<int32_t> s_buffered_sum{0};
+void bufferedReadSystem(BufferedReadEntity e)
+{
+    s_buffered_sum += e.getComponent<Buffered>().value;
+}
+
+void bufferedWriteSystem(BufferedWriteEntity e)
+{
+    e.getComponent<Buffered>().value += 1;
+}
+
+// Returns true if the other overlapping system started while this one was
+// running
+static std::atomic<uint32_t> s_overlap_arrivals{0};
+bool waitForOverlap()
+{
+    s_overlap_arrivals++;
+    auto const deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds{5};
+    while (s_overlap_arrivals < 2)
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+            return false;
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+static std::atomic<bool> s_read_overlapped{false};
+void overlapReadSystem(BufferedReadEntity e)
+{
+    (void)e.getComponent<Buffered>();
+    s_read_overlapped = waitForOverlap();
+}
+
+static std::atomic<bool> s_write_overlapped{false};
+void overlapWriteSystem(BufferedWriteEntity e)
+{
+    e.getComponent<Buffered>().value += 1;
+    s_write_overlapped = waitForOverlap();
+}
+
 } // namespace
 
 TEST_CASE("Scheduler basic")
@@ -292,4 +551,822 @@ TEST_CASE("Scheduler dependencies")
         REQUIRE(s_f_ran_after_d_and_e);
         REQUIRE(s_g_ran_after_e);
     }
+
+    SECTION("Diamond")
+    {
+        // The tail is reached through the head before the short system it
+        // also depends on
+        recs::SystemRef const head = scheduler.registerSystem(orderHeadSystem);
+        recs::SystemRef const tail = scheduler.registerSystem(orderTailSystem);
+        recs::SystemRef const short_sys =
+            scheduler.registerSystem(orderShortSystem);
+        tail.executeAfter(head);
+        short_sys.executeAfter(head);
+        tail.executeAfter(short_sys);
+
+        recs::Schedule const schedule = scheduler.buildSchedule();
+        s_run_order.clear();
+        schedule.execute(storage);
+        REQUIRE(s_run_order == std::vector<char>{'h', 's', 't'});
+
+        recs::ThreadPool pool{2};
+        s_run_order.clear();
+        schedule.execute(storage, pool);
+        REQUIRE(s_run_order == std::vector<char>{'h', 's', 't'});
+    }
+}
+
+TEST_CASE("Scheduler parallel")
+{
+    recs::Scheduler scheduler;
+    recs::ComponentStorage storage;
+    recs::ThreadPool pool{4};
+
+    int32_t ref_int_sum = 0;
+    uint32_t ref_uint_sum = 0;
+    for (int32_t i = 0; i < 1000; ++i)
+    {
+        recs::EntityId const e = storage.addEntity();
+        storage.addComponent(e, i);
+        storage.addComponent(e, static_cast<uint32_t>(i));
+        ref_int_sum += i;
+        ref_uint_sum += i;
+    }
+
+    scheduler.registerSystem(intSumSystem);
+    scheduler.registerSystem(uintSumSystem);
+
+    Dag dag;
+    dag.a = scheduler.registerSystem(uintASystem);
+    dag.b = scheduler.registerSystem(uintBSystem);
+    dag.c = scheduler.registerSystem(uintCSystem);
+    dag.d = scheduler.registerSystem(uintDSystem);
+    dag.e = scheduler.registerSystem(uintESystem);
+    dag.f = scheduler.registerSystem(uintFSystem);
+    dag.g = scheduler.registerSystem(uintGSystem);
+    setUpGraph(dag);
+
+    recs::Schedule const schedule = scheduler.buildSchedule();
+    // The DAG systems share the query of uintSumSystem
+    REQUIRE(schedule.queryCount() == 2);
+    for (uint32_t frame = 0; frame < 10; ++frame)
+    {
+        s_int_sum = 0;
+        s_uint_sum = 0;
+        s_a_ran = false;
+        s_b_ran = false;
+        s_c_ran = false;
+        s_d_ran = false;
+        s_e_ran = false;
+        s_f_ran = false;
+        s_g_ran = false;
+        s_d_ran_after_a = false;
+        s_e_ran_after_a_and_b = false;
+        s_f_ran_after_d_and_e = false;
+        s_g_ran_after_e = false;
+        schedule.execute(storage, pool);
+        REQUIRE(s_int_sum == ref_int_sum);
+        REQUIRE(s_uint_sum == ref_uint_sum);
+        REQUIRE(s_c_ran);
+        REQUIRE(s_d_ran_after_a);
+        REQUIRE(s_e_ran_after_a_and_b);
+        REQUIRE(s_f_ran_after_d_and_e);
+        REQUIRE(s_g_ran_after_e);
+    }
+}
+
+TEST_CASE("Scheduler shared queries")
+{
+    recs::Scheduler scheduler;
+    recs::ComponentStorage storage;
+
+    scheduler.registerSystem(intSumSystem);
+    scheduler.registerSystem(uintSumSystem);
+    scheduler.registerSystem(combinedSumSystem);
+    // Queries the same masks as intSumSystem and uintSumSystem
+    scheduler.registerSystem(uintDiffSystem);
+
+    recs::Schedule const schedule = scheduler.buildSchedule();
+    REQUIRE(schedule.queryCount() == 3);
+
+    // Queries are evaluated again on every execution
+    for (int32_t i = 1; i <= 3; ++i)
+    {
+        recs::EntityId const e = storage.addEntity();
+        storage.addComponent(e, i);
+        storage.addComponent(e, static_cast<uint32_t>(i));
+
+        s_int_sum = 0;
+        s_uint_sum = 0;
+        s_combined_sum = 0;
+        s_uint_diff = 0;
+        schedule.execute(storage);
+
+        int32_t const ref_sum = i * (i + 1) / 2;
+        REQUIRE(s_int_sum == ref_sum);
+        REQUIRE(s_uint_sum == static_cast<uint32_t>(ref_sum));
+        REQUIRE(s_combined_sum == static_cast<uint32_t>(2 * ref_sum));
+        // Every pair (a, b) adds a - b which cancels out
+        REQUIRE(s_uint_diff == 0);
+    }
+}
+
+TEST_CASE("Scheduler costs")
+{
+    recs::Scheduler scheduler;
+    recs::ComponentStorage storage;
+    storage.addComponent(storage.addEntity(), 0u);
+
+    // Registered first so it's the first root in the schedule
+    recs::SystemRef const short_sys =
+        scheduler.registerSystem(orderShortSystem, "Short");
+    recs::SystemRef const head =
+        scheduler.registerSystem(orderHeadSystem, "Head");
+    recs::SystemRef const tail =
+        scheduler.registerSystem(orderTailSystem, "Tail");
+    tail.executeAfter(head);
+    short_sys.setCost(10);
+    head.setCost(10);
+    tail.setCost(100);
+
+    recs::Schedule schedule = scheduler.buildSchedule();
+    REQUIRE(schedule.criticalPathNs() == 110);
+    REQUIRE(schedule.predictedMakespanNs(1) == 120);
+    REQUIRE(schedule.predictedMakespanNs(2) == 110);
+
+    SECTION("Critical path first")
+    {
+        // A single worker runs the longer chain first, even though the short
+        // system is earlier in the schedule
+        recs::ThreadPool pool{1};
+        s_run_order.clear();
+        schedule.execute(storage, pool);
+        REQUIRE(s_run_order == std::vector<char>{'h', 't', 's'});
+    }
+
+    SECTION("Measured costs")
+    {
+        recs::Profiler profiler{4};
+        profiler.setEnabled(true);
+        for (int32_t i = 0; i < 3; ++i)
+            schedule.execute(storage, &profiler);
+
+        uint64_t total_ns = 0;
+        for (size_t s = 0; s < 3; ++s)
+        {
+            uint64_t system_ns = 0;
+            for (size_t f = 0; f < profiler.frameCount(); ++f)
+            {
+                recs::Profiler::SystemSample const &sample =
+                    profiler.frame(f).systems[s];
+                system_ns += sample.end_ns - sample.start_ns;
+            }
+            total_ns += system_ns / profiler.frameCount();
+        }
+
+        schedule.updateCosts(profiler);
+        REQUIRE(schedule.predictedMakespanNs(1) == total_ns);
+    }
+
+    SECTION("Frames from other schedules")
+    {
+        recs::Scheduler other_scheduler;
+        other_scheduler.registerSystem(orderShortSystem, "Other");
+        recs::Schedule const other = other_scheduler.buildSchedule();
+
+        recs::Profiler profiler;
+        profiler.setEnabled(true);
+        other.execute(storage, &profiler);
+
+        schedule.updateCosts(profiler);
+        REQUIRE(schedule.predictedMakespanNs(1) == 120);
+    }
+}
+
+TEST_CASE("Scheduler run conditions")
+{
+    recs::Scheduler scheduler;
+    recs::ComponentStorage storage;
+    recs::ThreadPool pool{2};
+
+    recs::EntityId const e = storage.addEntity();
+    storage.addComponent(e, 1);
+
+    SECTION("Enabled")
+    {
+        recs::SystemRef const int_sum = scheduler.registerSystem(intSumSystem);
+        recs::SystemRef const dependent =
+            scheduler.registerSystem(uintASystem);
+        dependent.executeAfter(int_sum);
+        storage.addComponent(e, 1u);
+
+        recs::Schedule schedule = scheduler.buildSchedule();
+        REQUIRE(schedule.enabled(int_sum));
+
+        schedule.setEnabled(int_sum, false);
+        REQUIRE(!schedule.enabled(int_sum));
+        for (int32_t frame = 0; frame < 2; ++frame)
+        {
+            s_int_sum = 0;
+            s_a_ran = false;
+            if (frame == 0)
+                schedule.execute(storage);
+            else
+                schedule.execute(storage, pool);
+            REQUIRE(s_int_sum == 0);
+            // Dependents of skipped systems still run
+            REQUIRE(s_a_ran);
+        }
+
+        schedule.setEnabled(int_sum, true);
+        s_int_sum = 0;
+        schedule.execute(storage, pool);
+        REQUIRE(s_int_sum == 1);
+    }
+
+    SECTION("Condition")
+    {
+        bool run = false;
+        scheduler.registerSystem(intSumSystem).runIf([&run] { return run; });
+
+        recs::Schedule const schedule = scheduler.buildSchedule();
+        for (int32_t frame = 0; frame < 4; ++frame)
+        {
+            run = frame % 2 == 1;
+            s_int_sum = 0;
+            if (frame < 2)
+                schedule.execute(storage);
+            else
+                schedule.execute(storage, pool);
+            REQUIRE(s_int_sum == (run ? 1 : 0));
+        }
+    }
+
+    SECTION("Matches")
+    {
+        scheduler.registerSystem(matchedSystem).runIfMatches();
+
+        recs::Schedule const schedule = scheduler.buildSchedule();
+        s_matched_calls = 0;
+        schedule.execute(storage);
+        REQUIRE(s_matched_calls == 0);
+
+        storage.addComponent(storage.addEntity(), 1u);
+        schedule.execute(storage, pool);
+        REQUIRE(s_matched_calls == 1);
+    }
+}
+
+TEST_CASE("Scheduler executors")
+{
+    recs::Scheduler scheduler;
+    recs::ComponentStorage storage;
+
+    recs::EntityId const e = storage.addEntity();
+    storage.addComponent(e, 0u);
+
+    Dag dag;
+    dag.a = scheduler.registerSystem(uintASystem);
+    dag.b = scheduler.registerSystem(uintBSystem);
+    dag.c = scheduler.registerSystem(uintCSystem);
+    dag.d = scheduler.registerSystem(uintDSystem);
+    dag.e = scheduler.registerSystem(uintESystem);
+    dag.f = scheduler.registerSystem(uintFSystem);
+    dag.g = scheduler.registerSystem(uintGSystem);
+    setUpGraph(dag);
+
+    recs::Schedule schedule = scheduler.buildSchedule();
+
+    SECTION("Serial")
+    {
+        recs::SerialExecutor executor;
+        s_d_ran_after_a = false;
+        s_e_ran_after_a_and_b = false;
+        s_f_ran_after_d_and_e = false;
+        s_g_ran_after_e = false;
+        schedule.execute(storage, executor);
+        REQUIRE(s_c_ran);
+        REQUIRE(s_d_ran_after_a);
+        REQUIRE(s_e_ran_after_a_and_b);
+        REQUIRE(s_f_ran_after_d_and_e);
+        REQUIRE(s_g_ran_after_e);
+    }
+
+    SECTION("External")
+    {
+        CountingExecutor executor;
+        schedule.execute(storage, executor);
+        REQUIRE(executor.submit_count == 7);
+
+        // Skipped systems don't get tasks
+        schedule.setEnabled(dag.c, false);
+        executor.submit_count = 0;
+        s_g_ran_after_e = false;
+        schedule.execute(storage, executor);
+        REQUIRE(executor.submit_count == 6);
+        REQUIRE(s_g_ran_after_e);
+    }
+}
+
+TEST_CASE("Scheduler affinity")
+{
+    recs::Scheduler scheduler;
+    recs::ComponentStorage storage;
+    storage.addComponent(storage.addEntity(), 0u);
+
+    SECTION("Threads")
+    {
+        scheduler.registerSystem(mainThreadSystem).runOnMainThread();
+        scheduler.registerSystem(pinnedSystem).pinToWorker(2);
+        recs::Schedule schedule = scheduler.buildSchedule();
+
+        recs::ThreadPool pool{4};
+        for (int32_t i = 0; i < 10; ++i)
+        {
+            s_main_thread_id = std::thread::id{};
+            s_pinned_worker = recs::ThreadPool::s_not_a_worker;
+            schedule.execute(storage, pool);
+            REQUIRE(s_main_thread_id == std::this_thread::get_id());
+            REQUIRE(s_pinned_worker == 2);
+        }
+
+        recs::PoolExecutor executor{pool};
+        s_main_thread_id = std::thread::id{};
+        s_pinned_worker = recs::ThreadPool::s_not_a_worker;
+        schedule.executePipelined(storage, executor);
+        schedule.finishPipelined();
+        REQUIRE(s_main_thread_id == std::this_thread::get_id());
+        REQUIRE(s_pinned_worker == 2);
+
+        // Pools without the worker run the system on any of theirs
+        recs::ThreadPool small_pool{2};
+        s_pinned_worker = recs::ThreadPool::s_not_a_worker;
+        schedule.execute(storage, small_pool);
+        REQUIRE(s_pinned_worker < 2);
+    }
+
+    SECTION("Priority classes")
+    {
+        recs::SystemRef const short_sys =
+            scheduler.registerSystem(orderShortSystem, "Short");
+        recs::SystemRef const head =
+            scheduler.registerSystem(orderHeadSystem, "Head");
+        recs::SystemRef const tail =
+            scheduler.registerSystem(orderTailSystem, "Tail");
+        tail.executeAfter(head);
+        short_sys.setCost(10);
+        head.setCost(10);
+        tail.setCost(100);
+
+        // The class outweighs the longer chain
+        short_sys.setPriority(recs::SystemPriority::High);
+        head.setPriority(recs::SystemPriority::Low);
+        recs::Schedule const schedule = scheduler.buildSchedule();
+
+        recs::ThreadPool pool{1};
+        s_run_order.clear();
+        schedule.execute(storage, pool);
+        REQUIRE(s_run_order == std::vector<char>{'s', 'h', 't'});
+    }
+}
+
+TEST_CASE("Scheduler coroutines")
+{
+    recs::Scheduler scheduler;
+    recs::ComponentStorage storage;
+    std::vector<recs::EntityId> entities;
+    for (int32_t i = 0; i < 5; ++i)
+    {
+        entities.push_back(storage.addEntity());
+        storage.addComponent(entities.back(), 0);
+    }
+
+    auto const values = [&]
+    {
+        std::vector<int32_t> ret;
+        for (recs::EntityId const e : entities)
+            ret.push_back(storage.getComponent<int32_t>(e));
+        return ret;
+    };
+
+    SECTION("Next frame")
+    {
+        scheduler.registerSystem(sliceSystem, "Slice");
+        // Conflicts with the coroutine's write access
+        scheduler.registerSystem(intSumSystem);
+
+        recs::Schedule const schedule = scheduler.buildSchedule();
+        recs::ThreadPool pool{2};
+
+        schedule.execute(storage);
+        REQUIRE(values() == std::vector<int32_t>{1, 1, 0, 0, 0});
+        s_int_sum = 0;
+        schedule.execute(storage, pool);
+        REQUIRE(values() == std::vector<int32_t>{1, 1, 1, 1, 0});
+        REQUIRE(s_int_sum == 4);
+        schedule.execute(storage);
+        REQUIRE(values() == std::vector<int32_t>{1, 1, 1, 1, 1});
+        // Completes without changes and restarts on the next execution
+        schedule.execute(storage);
+        REQUIRE(values() == std::vector<int32_t>{1, 1, 1, 1, 1});
+        schedule.execute(storage, pool);
+        REQUIRE(values() == std::vector<int32_t>{2, 2, 1, 1, 1});
+
+        // Other schedules run their own instance
+        recs::Schedule const other = scheduler.buildSchedule();
+        other.execute(storage);
+        REQUIRE(values() == std::vector<int32_t>{3, 3, 1, 1, 1});
+    }
+
+    SECTION("Budget")
+    {
+        scheduler.registerSystem(
+            budgetSystem, "Budget", std::chrono::nanoseconds{0});
+
+        recs::Schedule const schedule = scheduler.buildSchedule();
+        schedule.execute(storage);
+        REQUIRE(values() == std::vector<int32_t>{1, 0, 0, 0, 0});
+        schedule.execute(storage);
+        REQUIRE(values() == std::vector<int32_t>{1, 1, 0, 0, 0});
+    }
+
+    SECTION("Large budget")
+    {
+        // Saturates instead of overflowing the clock
+        scheduler.registerSystem(
+            budgetSystem, "Budget",
+            std::chrono::nanoseconds::max() - std::chrono::nanoseconds{1});
+
+        recs::Schedule const schedule = scheduler.buildSchedule();
+        schedule.execute(storage);
+        REQUIRE(values() == std::vector<int32_t>{1, 1, 1, 1, 1});
+    }
+
+    SECTION("Unlimited budget")
+    {
+        scheduler.registerSystem(budgetSystem);
+
+        recs::Schedule const schedule = scheduler.buildSchedule();
+        schedule.execute(storage);
+        REQUIRE(values() == std::vector<int32_t>{1, 1, 1, 1, 1});
+    }
+}
+
+TEST_CASE("Scheduler time slicing")
+{
+    recs::Scheduler scheduler;
+    recs::ComponentStorage storage;
+    std::vector<recs::EntityId> entities;
+    for (uint32_t i = 0; i < 5; ++i)
+    {
+        entities.push_back(storage.addEntity());
+        storage.addComponent(entities.back(), Visits{});
+    }
+
+    auto const visits = [&]
+    {
+        std::vector<uint32_t> ret;
+        for (recs::EntityId const e : entities)
+            ret.push_back(storage.getComponent<Visits>(e).count);
+        return ret;
+    };
+
+    SECTION("Entity budget")
+    {
+        scheduler.registerSystem(visitSystem).timeSlice(2);
+        recs::Schedule const schedule = scheduler.buildSchedule();
+        recs::ThreadPool pool{2};
+
+        schedule.execute(storage);
+        REQUIRE(visits() == std::vector<uint32_t>{1, 1, 0, 0, 0});
+        schedule.execute(storage, pool);
+        REQUIRE(visits() == std::vector<uint32_t>{1, 1, 1, 1, 0});
+        // Wraps around
+        schedule.execute(storage);
+        REQUIRE(visits() == std::vector<uint32_t>{2, 1, 1, 1, 1});
+
+        // Other schedules have their own cursor
+        recs::Schedule const other = scheduler.buildSchedule();
+        other.execute(storage);
+        REQUIRE(visits() == std::vector<uint32_t>{3, 2, 1, 1, 1});
+    }
+
+    SECTION("Churn")
+    {
+        scheduler.registerSystem(visitSystem).timeSlice(2);
+        recs::Schedule const schedule = scheduler.buildSchedule();
+
+        schedule.execute(storage);
+        REQUIRE(visits() == std::vector<uint32_t>{1, 1, 0, 0, 0});
+
+        // Removing the last visited and the next entity doesn't skip or
+        // repeat others
+        storage.removeEntity(entities[1]);
+        storage.removeEntity(entities[2]);
+        entities.erase(entities.begin() + 1, entities.begin() + 3);
+        schedule.execute(storage);
+        REQUIRE(visits() == std::vector<uint32_t>{1, 1, 1});
+
+        // New entities reuse the freed slots behind the cursor and are
+        // visited on the next rotation
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            entities.push_back(storage.addEntity());
+            storage.addComponent(entities.back(), Visits{});
+        }
+        schedule.execute(storage);
+        REQUIRE(visits() == std::vector<uint32_t>{2, 1, 1, 1, 0});
+    }
+
+    SECTION("Query systems")
+    {
+        recs::EntityId const e = storage.addEntity();
+        storage.addComponent(e, 1);
+        storage.addComponent(e, 2u);
+        scheduler.registerSystem(uintDiffSystem).timeSlice(1);
+        recs::Schedule const schedule = scheduler.buildSchedule();
+
+        s_uint_diff = 0;
+        schedule.execute(storage);
+        REQUIRE(s_uint_diff == -1);
+    }
+
+    SECTION("Time budget")
+    {
+        for (uint32_t i = 0; i < 100; ++i)
+        {
+            entities.push_back(storage.addEntity());
+            storage.addComponent(entities.back(), Visits{});
+        }
+
+        scheduler.registerSystem(visitSystem)
+            .timeSlice(
+                std::numeric_limits<size_t>::max(),
+                std::chrono::microseconds{0});
+        recs::Schedule const schedule = scheduler.buildSchedule();
+
+        // A batch per execution
+        schedule.execute(storage);
+        std::vector<uint32_t> counts = visits();
+        REQUIRE(
+            std::accumulate(counts.begin(), counts.end(), 0u) ==
+            recs::Scheduler::s_slice_batch_size);
+
+        uint32_t executions = 1;
+        while (std::ranges::find(counts, 0u) != counts.end())
+        {
+            schedule.execute(storage);
+            counts = visits();
+            executions++;
+        }
+        REQUIRE(std::ranges::max(counts) == 1);
+        REQUIRE(executions == (105 + 15) / 16);
+    }
+
+    SECTION("Large time budget")
+    {
+        // Doesn't fit the clock's units
+        scheduler.registerSystem(visitSystem)
+            .timeSlice(
+                2, std::chrono::microseconds{
+                       std::chrono::microseconds::max().count() / 2});
+        recs::Schedule const schedule = scheduler.buildSchedule();
+
+        schedule.execute(storage);
+        std::vector<uint32_t> const counts = visits();
+        REQUIRE(std::accumulate(counts.begin(), counts.end(), 0u) == 2);
+    }
+}
+
+TEST_CASE("Scheduler pipelining")
+{
+    recs::Scheduler scheduler;
+    recs::ComponentStorage storage;
+
+    SECTION("Conflicts across frames")
+    {
+        storage.addComponent(storage.addEntity(), PipeCount{});
+        scheduler.registerSystem(pipeWriteSystem).pipeline();
+        scheduler.registerSystem(pipeReadSystem);
+        recs::Schedule schedule = scheduler.buildSchedule();
+
+        recs::ThreadPool pool{4};
+        recs::PoolExecutor pool_executor{pool};
+        recs::SerialExecutor serial_executor;
+        for (recs::Executor *executor :
+             {static_cast<recs::Executor *>(&pool_executor),
+              static_cast<recs::Executor *>(&serial_executor)})
+        {
+            s_pipe_reads.clear();
+            for (uint32_t frame = 0; frame < 50; ++frame)
+                schedule.executePipelined(storage, *executor);
+            schedule.finishPipelined();
+
+            // Each read sees exactly its own frame's write
+            REQUIRE(s_pipe_reads.size() == 50);
+            uint32_t const first = s_pipe_reads.front();
+            for (uint32_t i = 0; i < 50; ++i)
+                REQUIRE(s_pipe_reads[i] == first + i);
+        }
+    }
+
+    SECTION("Overlap")
+    {
+        recs::EntityId const e = storage.addEntity();
+        storage.addComponent(e, Slow{});
+        storage.addComponent(e, Fast{});
+        scheduler.registerSystem(slowSystem);
+        scheduler.registerSystem(fastSystem).pipeline();
+        recs::Schedule schedule = scheduler.buildSchedule();
+
+        recs::ThreadPool pool{2};
+        recs::PoolExecutor executor{pool};
+        s_fast_runs = 0;
+        s_slow_overlapped = false;
+        s_slow_first_run = true;
+        // The second frame's fast system runs while the first frame's slow
+        // one waits for it
+        schedule.executePipelined(storage, executor);
+        schedule.executePipelined(storage, executor);
+        schedule.finishPipelined();
+        REQUIRE(s_slow_overlapped);
+        REQUIRE(s_fast_runs == 2);
+
+        // Regular executions still work after finishing
+        schedule.execute(storage, pool);
+        REQUIRE(s_fast_runs == 3);
+    }
+}
+
+TEST_CASE("Scheduler deterministic")
+{
+    // Budgets that would stop the systems after the first batch
+    recs::Scheduler scheduler;
+    scheduler.registerSystem(detStepSystem)
+        .timeSlice(
+            std::numeric_limits<size_t>::max(), std::chrono::microseconds{0})
+        .pipeline();
+    scheduler.registerSystem(
+        detMixSystem, "Mix", std::chrono::nanoseconds{0});
+    scheduler.setDeterministic(true);
+
+    enum class Mode
+    {
+        Serial,
+        Pool,
+        Executor,
+        Pipelined,
+    };
+
+    // Runs a simulation with structural changes between frames
+    auto const simulate = [&](Mode mode, uint32_t thread_count)
+    {
+        recs::Schedule schedule = scheduler.buildSchedule();
+        recs::ComponentStorage storage;
+        recs::ThreadPool pool{thread_count};
+        recs::PoolExecutor executor{pool};
+
+        auto const spawn = [&storage](uint64_t step)
+        {
+            recs::EntityId const e = storage.addEntity();
+            storage.addComponent(e, DetValue{step});
+            storage.addComponent(e, DetStep{step});
+            storage.addComponent(e, DetMix{});
+        };
+        for (uint64_t i = 0; i < 2000; ++i)
+            spawn(i);
+
+        for (uint64_t frame = 0; frame < 20; ++frame)
+        {
+            switch (mode)
+            {
+            case Mode::Serial:
+                schedule.execute(storage);
+                break;
+            case Mode::Pool:
+                schedule.execute(storage, pool);
+                break;
+            case Mode::Executor:
+                schedule.execute(storage, executor);
+                break;
+            case Mode::Pipelined:
+                schedule.executePipelined(storage, executor);
+                schedule.finishPipelined();
+                break;
+            }
+
+            recs::ComponentStorage::Range const entities =
+                storage.getEntities(recs::ComponentMask{});
+            for (recs::EntityId const e : entities.entities())
+            {
+                if (storage.readComponent<DetValue>(e).value % 5 == 0)
+                    storage.removeEntity(e);
+            }
+            for (uint64_t i = 0; i < 50; ++i)
+                spawn(frame * 100 + i);
+        }
+
+        return hashWorld(storage);
+    };
+
+    uint64_t const reference = simulate(Mode::Serial, 1);
+    for (uint32_t const thread_count : {1u, 2u, 4u})
+    {
+        REQUIRE(simulate(Mode::Pool, thread_count) == reference);
+        REQUIRE(simulate(Mode::Executor, thread_count) == reference);
+        REQUIRE(simulate(Mode::Pipelined, thread_count) == reference);
+    }
+
+    SECTION("Budgets are ignored")
+    {
+        recs::ComponentStorage storage;
+        for (uint64_t i = 0; i < 100; ++i)
+        {
+            recs::EntityId const e = storage.addEntity();
+            storage.addComponent(e, DetValue{});
+            storage.addComponent(e, DetStep{1});
+            storage.addComponent(e, DetMix{});
+        }
+
+        recs::Schedule const schedule = scheduler.buildSchedule();
+        schedule.execute(storage);
+        recs::ComponentStorage::Range const entities =
+            storage.getEntities(recs::ComponentMask{});
+        for (recs::EntityId const e : entities.entities())
+            REQUIRE(storage.readComponent<DetValue>(e).value == 1);
+    }
+}
+
+TEST_CASE("Scheduler observers")
+{
+    recs::Scheduler scheduler;
+    recs::ComponentStorage storage;
+    scheduler.registerSystem(uintSumSystem);
+    recs::Schedule const schedule = scheduler.buildSchedule();
+
+    // Changes made by observers are visible to the systems of the execution
+    // that flushes them
+    storage.onAdd<int32_t>(
+        [&storage](std::span<recs::EntityId const> entities)
+        {
+            for (recs::EntityId const id : entities)
+                storage.addComponent(id, 5u);
+        });
+
+    storage.addComponent(storage.addEntity(), 1);
+    s_uint_sum = 0;
+    schedule.execute(storage);
+    REQUIRE(s_uint_sum == 5);
+
+    recs::ThreadPool pool{2};
+    storage.addComponent(storage.addEntity(), 1);
+    s_uint_sum = 0;
+    schedule.execute(storage, pool);
+    REQUIRE(s_uint_sum == 10);
+}
+
+TEST_CASE("Scheduler double buffered")
+{
+    recs::Scheduler scheduler;
+    recs::ComponentStorage storage;
+
+    SECTION("Reads see the previous frame")
+    {
+        for (int32_t i = 0; i < 1000; ++i)
+            storage.addComponent(storage.addEntity(), Buffered{1});
+
+        recs::SystemRef const write =
+            scheduler.registerSystem(bufferedWriteSystem);
+        recs::SystemRef const read =
+            scheduler.registerSystem(bufferedReadSystem);
+        // Even explicitly after the write
+        read.executeAfter(write);
+
+        recs::Schedule const schedule = scheduler.buildSchedule();
+        recs::ThreadPool pool{2};
+        for (int32_t frame = 0; frame < 4; ++frame)
+        {
+            s_buffered_sum = 0;
+            if (frame % 2 == 0)
+                schedule.execute(storage);
+            else
+                schedule.execute(storage, pool);
+            REQUIRE(s_buffered_sum == 1000 * (frame + 1));
+        }
+    }
+
+    SECTION("Readers and writers overlap")
+    {
+        storage.addComponent(storage.addEntity(), Buffered{0});
+
+        scheduler.registerSystem(overlapReadSystem);
+        scheduler.registerSystem(overlapWriteSystem);
+
+        recs::Schedule const schedule = scheduler.buildSchedule();
+        recs::ThreadPool pool{2};
+        s_overlap_arrivals = 0;
+        schedule.execute(storage, pool);
+        REQUIRE(s_read_overlapped);
+        REQUIRE(s_write_overlapped);
+    }
 }
@@ -0,0 +1,100 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "recs/snapshot.hpp"
+
+namespace
+{
+
+struct Position
+{
+    float x{0.f};
+    float y{0.f};
+};
+
+struct Tag
+{
+    uint32_t value{0};
+};
+
+} // namespace
+
+TEST_CASE("Snapshot")
+{
+    recs::ComponentStorage cs;
+
+    std::vector<recs::EntityId> entities;
+    for (uint32_t i = 0; i < 2000; ++i)
+    {
+        recs::EntityId const e = cs.addEntity();
+        entities.push_back(e);
+        cs.addComponent(e, Position{static_cast<float>(i), 0.f});
+        if (i % 2 == 0)
+            cs.addComponent(e, Tag{i});
+    }
+    cs.setParent(entities[1], entities[0]);
+
+    recs::Snapshot const s0 = cs.captureSnapshot();
+    REQUIRE(s0.copiedBytes() > 0);
+
+    SECTION("Unchanged chunks are shared")
+    {
+        recs::Snapshot const s1 = cs.captureSnapshot(&s0);
+        REQUIRE(s1.copiedBytes() == 0);
+
+        // Reading doesn't count as a change
+        REQUIRE(cs.readComponent<Position>(entities[10]).x == 10.f);
+        recs::Snapshot const s2 = cs.captureSnapshot(&s1);
+        REQUIRE(s2.copiedBytes() == 0);
+
+        // A single write copies a single chunk
+        cs.getComponent<Position>(entities[10]).y = 1.f;
+        recs::Snapshot const s3 = cs.captureSnapshot(&s2);
+        REQUIRE(s3.copiedBytes() > 0);
+        REQUIRE(s3.copiedBytes() <= 512 * sizeof(Position));
+    }
+
+    SECTION("Restore")
+    {
+        cs.getComponent<Position>(entities[10]).y = 1.f;
+        cs.removeComponent<Tag>(entities[20]);
+        cs.removeEntity(entities[30]);
+        cs.removeParent(entities[1]);
+        recs::Snapshot const s1 = cs.captureSnapshot(&s0);
+
+        recs::EntityId const added = cs.addEntity();
+        cs.addComponent(added, Tag{9999});
+        cs.getComponent<Position>(entities[1999]).y = 2.f;
+
+        cs.restoreSnapshot(s0);
+        REQUIRE(cs.readComponent<Position>(entities[10]).y == 0.f);
+        REQUIRE(cs.readComponent<Position>(entities[1999]).y == 0.f);
+        REQUIRE(cs.hasComponent<Tag>(entities[20]));
+        REQUIRE(cs.readComponent<Tag>(entities[20]).value == 20);
+        REQUIRE(cs.isValid(entities[30]));
+        REQUIRE(cs.readComponent<Position>(entities[30]).x == 30.f);
+        REQUIRE(cs.getParent(entities[1]) == entities[0]);
+        REQUIRE(cs.getEntities(recs::ComponentMask{}).size() == 2000);
+
+        recs::ComponentMask tag_mask;
+        tag_mask.set(recs::TypeId::get<Tag>());
+        REQUIRE(cs.getEntities(tag_mask).size() == 1000);
+
+        // Jumping forward again
+        cs.restoreSnapshot(s1);
+        REQUIRE(cs.readComponent<Position>(entities[10]).y == 1.f);
+        REQUIRE(!cs.hasComponent<Tag>(entities[20]));
+        REQUIRE(!cs.isValid(entities[30]));
+        REQUIRE(!cs.isValid(cs.getParent(entities[1])));
+        REQUIRE(cs.getEntities(tag_mask).size() == 998);
+
+        // Handles are allocated like they were before the restore
+        recs::EntityId const readded = cs.addEntity();
+        REQUIRE(readded == added);
+
+        // Capturing after a restore can share with the restored snapshot
+        cs.removeEntity(readded);
+        cs.restoreSnapshot(s1);
+        recs::Snapshot const s2 = cs.captureSnapshot(&s1);
+        REQUIRE(s2.copiedBytes() == 0);
+    }
+}
@@ -0,0 +1,43 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "recs/system_task.hpp"
+#include <utility>
+
+namespace
+{
+
+recs::SystemTask countTask(uint32_t &count)
+{
+    count++;
+    co_await std::suspend_always{};
+    count++;
+}
+
+} // namespace
+
+TEST_CASE("SystemTask")
+{
+    uint32_t count = 0;
+    recs::SystemTask task = countTask(count);
+    REQUIRE(task.valid());
+    // Starts suspended
+    REQUIRE(count == 0);
+    REQUIRE(!task.done());
+
+    task.resume();
+    REQUIRE(count == 1);
+    REQUIRE(!task.done());
+
+    recs::SystemTask moved = std::move(task);
+    REQUIRE(!task.valid());
+    REQUIRE(moved.valid());
+
+    moved.resume();
+    REQUIRE(count == 2);
+    REQUIRE(moved.done());
+
+    // Suspended coroutines are destroyed with the task
+    moved = countTask(count);
+    moved.resume();
+    REQUIRE(count == 3);
+}
@@ -0,0 +1,51 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "recs/thread_pool.hpp"
+#include <atomic>
+#include <vector>
+
+TEST_CASE("Thread pool")
+{
+    std::atomic<uint32_t> sum{0};
+    {
+        recs::ThreadPool pool{4};
+        REQUIRE(pool.threadCount() == 4);
+
+        for (uint32_t i = 0; i < 1000; ++i)
+        {
+            pool.submit(
+                [&sum, &pool, i]
+                {
+                    sum += i;
+                    // Tasks can submit more tasks
+                    if (i % 10 == 0)
+                        pool.submit([&sum] { sum += 1; });
+                });
+        }
+        // Destruction waits for the queued tasks
+    }
+    REQUIRE(sum == 999 * 1000 / 2 + 100);
+}
+
+TEST_CASE("Thread pool pinned tasks")
+{
+    uint32_t const not_a_worker = recs::ThreadPool::s_not_a_worker;
+    std::vector<uint32_t> workers(100, not_a_worker);
+    {
+        recs::ThreadPool pool{4};
+        // Workers the pool doesn't have fall back to any worker
+        for (uint32_t i = 0; i < 100; ++i)
+        {
+            pool.submit(
+                i % 6, [&workers, i]
+                { workers[i] = recs::ThreadPool::currentWorkerIndex(); });
+        }
+    }
+    for (uint32_t i = 0; i < 100; ++i)
+    {
+        if (i % 6 < 4)
+            REQUIRE(workers[i] == i % 6);
+        else
+            REQUIRE(workers[i] < 4);
+    }
+}
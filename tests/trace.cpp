@@ -0,0 +1,284 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "recs/trace.hpp"
+#include <chrono>
+#include <vector>
+
+namespace
+{
+
+struct Position
+{
+    float x{0.f};
+    float y{0.f};
+};
+
+struct Tag
+{
+};
+
+struct Health
+{
+    double value{0.0};
+};
+
+} // namespace
+
+TEST_CASE("Trace replay")
+{
+    recs::TraceRecorder recorder;
+
+    recs::ComponentStorage cs;
+    cs.setTraceRecorder(&recorder);
+
+    recs::ComponentMask position_mask;
+    position_mask.set(recs::TypeId::get<Position>());
+    recs::ComponentMask health_mask;
+    health_mask.set(recs::TypeId::get<Health>());
+
+    // Frame 0
+    recs::EntityId const e0 = cs.addEntity();
+    recs::EntityId const e1 = cs.addEntity();
+    recs::EntityId const e2 = cs.addEntity();
+    cs.addComponent(e0, Position{});
+    cs.addComponent(e0, Tag{});
+    cs.addComponent(e1, Position{});
+    cs.addComponent(e2, Tag{});
+    REQUIRE(cs.getEntities(position_mask).size() == 2);
+    recorder.markFrame();
+
+    // Frame 1, health is queried before it's added to anything
+    REQUIRE(cs.getEntities(health_mask).empty());
+    cs.removeEntity(e1);
+    cs.removeComponent<Tag>(e0);
+    recs::EntityId const e3 = cs.addEntity();
+    cs.addComponent(e3, Health{});
+    REQUIRE(cs.getEntities(position_mask).size() == 1);
+    REQUIRE(cs.getEntities(health_mask).size() == 1);
+    recorder.markFrame();
+
+    cs.setTraceRecorder(nullptr);
+    // Not recorded
+    (void)cs.addEntity();
+
+    recs::TraceReplayer replayer;
+    REQUIRE(replayer.load(recorder.data()));
+
+    recs::ComponentStorage replay_cs;
+    REQUIRE(
+        replayer.replayFrame(replay_cs) == recs::TraceReplayer::Result::Frame);
+    REQUIRE(replay_cs.getEntities(recs::ComponentMask{}).size() == 3);
+    {
+        recs::TraceReplayer::Stats const &stats = replayer.stats();
+        REQUIRE(stats.entity_adds == 3);
+        REQUIRE(stats.component_adds == 4);
+        REQUIRE(stats.queries == 1);
+        REQUIRE(stats.query_results == 2);
+    }
+
+    REQUIRE(
+        replayer.replayFrame(replay_cs) == recs::TraceReplayer::Result::Frame);
+    REQUIRE(replay_cs.getEntities(recs::ComponentMask{}).size() == 3);
+    {
+        recs::TraceReplayer::Stats const &stats = replayer.stats();
+        REQUIRE(stats.entity_adds == 4);
+        REQUIRE(stats.entity_removes == 1);
+        REQUIRE(stats.component_adds == 5);
+        REQUIRE(stats.component_removes == 1);
+        REQUIRE(stats.queries == 4);
+        REQUIRE(stats.query_results == 4);
+    }
+
+    REQUIRE(
+        replayer.replayFrame(replay_cs) == recs::TraceReplayer::Result::End);
+}
+
+TEST_CASE("Trace replay compaction")
+{
+    recs::TraceRecorder recorder;
+
+    recs::ComponentStorage cs;
+    cs.setTraceRecorder(&recorder);
+
+    std::vector<recs::EntityId> entities;
+    for (int32_t i = 0; i < 10; ++i)
+    {
+        entities.push_back(cs.addEntity());
+        cs.addComponent(entities.back(), Position{});
+    }
+    cs.removeEntity(entities[2]);
+    for (size_t i = 5; i < entities.size(); ++i)
+        cs.removeEntity(entities[i]);
+    REQUIRE(cs.compact());
+
+    // Trimmed slots are no longer in the freelist so new entities get
+    // different indices than without the compaction
+    for (int32_t i = 0; i < 3; ++i)
+        cs.addComponent(cs.addEntity(), Position{});
+    recorder.markFrame();
+
+    recs::TraceReplayer replayer;
+    REQUIRE(replayer.load(recorder.data()));
+
+    recs::ComponentStorage replay_cs;
+    REQUIRE(
+        replayer.replayFrame(replay_cs) == recs::TraceReplayer::Result::Frame);
+    REQUIRE(replayer.stats().compactions == 1);
+    REQUIRE(replayer.stats().entity_adds == 13);
+    REQUIRE(replay_cs.getEntities(recs::ComponentMask{}).size() == 7);
+    REQUIRE(
+        replay_cs.stats().entity_slot_count == cs.stats().entity_slot_count);
+    REQUIRE(
+        replayer.replayFrame(replay_cs) == recs::TraceReplayer::Result::End);
+
+    SECTION("Budgeted")
+    {
+        // Enough chunks for the budget to be checked
+        for (uint32_t i = 0; i < 64 * 512; ++i)
+        {
+            entities.push_back(cs.addEntity());
+            cs.addComponent(entities.back(), Position{});
+        }
+        for (size_t i = 20; i < entities.size(); ++i)
+            cs.removeEntity(entities[i]);
+        REQUIRE(!cs.compact(std::chrono::nanoseconds{0}));
+        // Changes between the passes
+        cs.addComponent(cs.addEntity(), Position{});
+        REQUIRE(cs.compact());
+        recorder.markFrame();
+
+        REQUIRE(replayer.load(recorder.data()));
+        recs::ComponentStorage budgeted_cs;
+        while (replayer.replayFrame(budgeted_cs) ==
+               recs::TraceReplayer::Result::Frame)
+        {
+        }
+        REQUIRE(replayer.stats().compactions == 2);
+        REQUIRE(
+            budgeted_cs.stats().entity_slot_count ==
+            cs.stats().entity_slot_count);
+    }
+
+    SECTION("Untrimmable")
+    {
+        // The replayed tables can't be trimmed below the live entities
+        std::vector<uint8_t> invalid = recorder.data();
+        invalid.push_back(7);
+        invalid.push_back(0);
+
+        REQUIRE(replayer.load(invalid));
+        recs::ComponentStorage invalid_cs;
+        REQUIRE(
+            replayer.replayFrame(invalid_cs) ==
+            recs::TraceReplayer::Result::Frame);
+        REQUIRE(
+            replayer.replayFrame(invalid_cs) ==
+            recs::TraceReplayer::Result::Error);
+    }
+}
+
+TEST_CASE("Trace replay type ids")
+{
+    auto const record = [](auto component)
+    {
+        recs::TraceRecorder recorder;
+        recs::ComponentStorage cs;
+        cs.setTraceRecorder(&recorder);
+        cs.addComponent(cs.addEntity(), component);
+        recorder.markFrame();
+        cs.setTraceRecorder(nullptr);
+        return recorder.data();
+    };
+    std::vector<uint8_t> const position_trace = record(Position{});
+    std::vector<uint8_t> const health_trace = record(Health{});
+
+    auto const replay = [](recs::TraceReplayer &replayer)
+    {
+        recs::ComponentStorage replay_cs;
+        REQUIRE(
+            replayer.replayFrame(replay_cs) ==
+            recs::TraceReplayer::Result::Frame);
+        REQUIRE(replayer.stats().component_adds == 1);
+    };
+
+    recs::TraceReplayer replayer;
+    REQUIRE(replayer.load(position_trace));
+    replay(replayer);
+    uint64_t const type_count = recs::TypeId::count();
+
+    // More loads than there are type ids
+    for (size_t i = 0; i < recs::TypeId::s_max_component_type_count; ++i)
+    {
+        REQUIRE(replayer.load(position_trace));
+        replay(replayer);
+    }
+    REQUIRE(recs::TypeId::count() == type_count);
+
+    // A different layout for the same trace type gets a new id
+    REQUIRE(replayer.load(health_trace));
+    replay(replayer);
+    REQUIRE(recs::TypeId::count() == type_count + 1);
+}
+
+TEST_CASE("Trace replay malformed")
+{
+    recs::TraceRecorder recorder;
+
+    recs::ComponentStorage cs;
+    cs.setTraceRecorder(&recorder);
+    recs::EntityId const e0 = cs.addEntity();
+    cs.addComponent(e0, Position{});
+    cs.removeEntity(e0);
+    cs.setTraceRecorder(nullptr);
+
+    std::vector<uint8_t> const &trace = recorder.data();
+
+    {
+        recs::TraceReplayer replayer;
+        REQUIRE(!replayer.load(std::vector<uint8_t>{}));
+        std::vector<uint8_t> bad_magic = trace;
+        bad_magic[0]++;
+        REQUIRE(!replayer.load(bad_magic));
+    }
+
+    // Truncating anywhere inside the ops is either an error or an early end
+    for (size_t size = 8; size < trace.size(); ++size)
+    {
+        recs::TraceReplayer replayer;
+        REQUIRE(replayer.load(std::vector<uint8_t>{
+            trace.begin(), trace.begin() + static_cast<ptrdiff_t>(size)}));
+
+        recs::ComponentStorage replay_cs;
+        recs::TraceReplayer::Result result = recs::TraceReplayer::Result::Frame;
+        while (result == recs::TraceReplayer::Result::Frame)
+            result = replayer.replayFrame(replay_cs);
+        REQUIRE(replayer.stats().entity_removes == 0);
+    }
+
+    {
+        // The entity was removed before the component is removed
+        std::vector<uint8_t> invalid = trace;
+        invalid.push_back(5);
+        invalid.push_back(0);
+        invalid.push_back(0);
+
+        recs::TraceReplayer replayer;
+        REQUIRE(replayer.load(invalid));
+        recs::ComponentStorage replay_cs;
+        REQUIRE(
+            replayer.replayFrame(replay_cs) ==
+            recs::TraceReplayer::Result::Error);
+    }
+
+    {
+        std::vector<uint8_t> unknown_op = trace;
+        unknown_op.push_back(0xFF);
+
+        recs::TraceReplayer replayer;
+        REQUIRE(replayer.load(unknown_op));
+        recs::ComponentStorage replay_cs;
+        REQUIRE(
+            replayer.replayFrame(replay_cs) ==
+            recs::TraceReplayer::Result::Error);
+    }
+}
@@ -0,0 +1,92 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "recs/type_registry.hpp"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+struct alignas(16) Registered
+{
+    float value[3]{};
+};
+
+struct RegisteredLater
+{
+    uint16_t value{0};
+};
+
+template <int N> struct Racy
+{
+    int value{N};
+};
+
+template <int... Ns> std::vector<uint64_t> racyIds()
+{
+    return {recs::TypeId::get<Racy<Ns>>()...};
+}
+
+} // namespace
+
+TEST_CASE("TypeRegistry")
+{
+    // Ids are handed out densely in registration order
+    uint64_t const first_id = recs::TypeId::count();
+    uint64_t const id =
+        recs::TypeRegistry::registerType<Registered>("Registered");
+    uint64_t const later_id =
+        recs::TypeRegistry::registerType<RegisteredLater>("RegisteredLater");
+    REQUIRE(id == first_id);
+    REQUIRE(later_id == first_id + 1);
+    REQUIRE(recs::TypeId::get<Registered>() == id);
+    REQUIRE(recs::TypeId::count() == first_id + 2);
+
+    // Registering again is a no-op
+    REQUIRE(recs::TypeRegistry::registerType<Registered>("Registered") == id);
+
+    recs::TypeRegistry::TypeInfo const *info = recs::TypeRegistry::info(id);
+    REQUIRE(info != nullptr);
+    REQUIRE(info->name == "Registered");
+    REQUIRE(info->size == sizeof(Registered));
+    REQUIRE(info->alignment == 16);
+    REQUIRE(info->stable_id == recs::TypeRegistry::hashName("Registered"));
+
+    REQUIRE(recs::TypeRegistry::stableId(id) == info->stable_id);
+    REQUIRE(recs::TypeRegistry::typeId(info->stable_id) == id);
+    REQUIRE(
+        recs::TypeRegistry::stableId(later_id) ==
+        recs::TypeRegistry::hashName("RegisteredLater"));
+
+    REQUIRE(
+        recs::TypeRegistry::typeId(recs::TypeRegistry::hashName("Missing")) ==
+        recs::TypeRegistry::s_invalid_id);
+    REQUIRE(recs::TypeRegistry::info(recs::TypeId::get<double>()) == nullptr);
+    REQUIRE(
+        recs::TypeRegistry::stableId(recs::TypeId::get<double>()) ==
+        recs::TypeRegistry::s_invalid_id);
+}
+
+TEST_CASE("TypeId concurrent first use")
+{
+    uint64_t const first_id = recs::TypeId::count();
+
+    std::vector<std::vector<uint64_t>> ids(4);
+    {
+        std::vector<std::jthread> threads;
+        for (std::vector<uint64_t> &thread_ids : ids)
+            threads.emplace_back(
+                [&thread_ids]
+                { thread_ids = racyIds<0, 1, 2, 3, 4, 5, 6, 7>(); });
+    }
+
+    // Every thread sees the same ids and no ids are skipped
+    for (std::vector<uint64_t> const &thread_ids : ids)
+        REQUIRE(thread_ids == ids[0]);
+
+    std::vector<uint64_t> sorted = ids[0];
+    std::sort(sorted.begin(), sorted.end());
+    for (uint64_t i = 0; i < sorted.size(); ++i)
+        REQUIRE(sorted[i] == first_id + i);
+}
@@ -0,0 +1,329 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "recs/component_storage.hpp"
+#include "recs/type_registry.hpp"
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+namespace
+{
+
+struct Position
+{
+    float x{0.f};
+    float y{0.f};
+    float z{0.f};
+};
+
+struct Health
+{
+    int32_t value{0};
+};
+
+struct Unregistered
+{
+    uint8_t value{0};
+};
+
+std::filesystem::path tempPath(char const *name)
+{
+    return std::filesystem::temp_directory_path() / name;
+}
+
+// Mirror the file layout in world_file.cpp for corrupting saved files
+struct FileHeader
+{
+    uint32_t magic{0};
+    uint32_t version{0};
+    uint64_t file_size{0};
+    uint64_t chunk_size{0};
+    uint64_t entity_count{0};
+    uint64_t freelist_count{0};
+    uint64_t hierarchy_node_count{0};
+    uint64_t generation_floor{0};
+    uint64_t type_count{0};
+    uint64_t mask_word_count{0};
+    uint64_t generations_offset{0};
+    uint64_t alive_offset{0};
+    uint64_t freelist_offset{0};
+    uint64_t hierarchy_offset{0};
+    uint64_t masks_offset{0};
+    uint64_t types_offset{0};
+};
+
+struct FileType
+{
+    uint64_t stable_id{0};
+    uint32_t component_size{0};
+    uint32_t component_alignment{0};
+    uint64_t count{0};
+    uint64_t chunk_count{0};
+    uint64_t chunks_offset{0};
+};
+
+struct FileChunk
+{
+    uint64_t data_offset{0};
+    uint64_t count{0};
+};
+
+struct FileHierarchyNode
+{
+    uint64_t parent{0};
+    uint64_t first_child{0};
+    uint64_t next_sibling{0};
+    uint64_t prev_sibling{0};
+};
+
+std::vector<uint8_t> readFile(std::filesystem::path const &path)
+{
+    std::ifstream file{path, std::ios::binary};
+    return std::vector<uint8_t>{
+        std::istreambuf_iterator<char>{file},
+        std::istreambuf_iterator<char>{}};
+}
+
+void writeFile(
+    std::filesystem::path const &path, std::vector<uint8_t> const &bytes)
+{
+    std::ofstream file{path, std::ios::binary | std::ios::trunc};
+    file.write(
+        reinterpret_cast<char const *>(bytes.data()),
+        static_cast<std::streamsize>(bytes.size()));
+}
+
+template <typename T> T readAt(std::vector<uint8_t> const &bytes, size_t offset)
+{
+    T value;
+    std::memcpy(&value, bytes.data() + offset, sizeof(T));
+    return value;
+}
+
+template <typename T>
+void writeAt(std::vector<uint8_t> &bytes, size_t offset, T const &value)
+{
+    std::memcpy(bytes.data() + offset, &value, sizeof(T));
+}
+
+} // namespace
+
+TEST_CASE("World file")
+{
+    recs::TypeRegistry::registerType<Position>("Position");
+    recs::TypeRegistry::registerType<Health>("Health");
+
+    std::filesystem::path const path = tempPath("recs_world_file_test.bin");
+
+    std::vector<recs::EntityId> entities;
+    {
+        recs::ComponentStorage cs;
+        for (int32_t i = 0; i < 2000; ++i)
+        {
+            recs::EntityId const e = cs.addEntity();
+            entities.push_back(e);
+            float const f = static_cast<float>(i);
+            cs.addComponent(e, Position{f, 2.f * f, 3.f * f});
+            if (i % 3 == 0)
+                cs.addComponent(e, Health{i});
+        }
+        // Leave holes and a freelist behind
+        for (size_t i = 0; i < entities.size(); i += 7)
+            cs.removeEntity(entities[i]);
+        cs.setParent(entities[2], entities[1]);
+        cs.setParent(entities[3], entities[2]);
+
+        REQUIRE(cs.saveToFile(path));
+    }
+
+    recs::ComponentStorage cs;
+    REQUIRE(cs.loadFromFile(path));
+
+    for (size_t i = 0; i < entities.size(); ++i)
+    {
+        recs::EntityId const e = entities[i];
+        if (i % 7 == 0)
+        {
+            REQUIRE(!cs.isValid(e));
+            continue;
+        }
+
+        REQUIRE(cs.isValid(e));
+        REQUIRE(cs.hasComponent<Position>(e));
+        REQUIRE(cs.getComponent<Position>(e).y == 2.f * static_cast<float>(i));
+        REQUIRE(cs.hasComponent<Health>(e) == (i % 3 == 0));
+        if (i % 3 == 0)
+            REQUIRE(
+                cs.getComponent<Health>(e).value == static_cast<int32_t>(i));
+    }
+
+    REQUIRE(cs.getParent(entities[3]) == entities[2]);
+    REQUIRE(cs.getParent(entities[2]) == entities[1]);
+    cs.updateHierarchy();
+    REQUIRE(cs.hierarchyLevelCount() == 3);
+
+    recs::ComponentMask mask;
+    mask.set(recs::TypeId::get<Health>());
+    REQUIRE(cs.getEntities(mask).size() == 571);
+
+    // Freed handles are reused in the same order as before saving
+    recs::EntityId const reused = cs.addEntity();
+    REQUIRE(!cs.isValid(entities[0]));
+    REQUIRE(cs.isValid(reused));
+
+    // Loaded components are modifiable and can be removed and added again
+    cs.getComponent<Position>(entities[1]).x = -1.f;
+    cs.removeComponent<Health>(entities[3]);
+    cs.addComponent(entities[3], Health{-3});
+    cs.addComponent(reused, Health{-4});
+    REQUIRE(cs.getComponent<Position>(entities[1]).x == -1.f);
+    REQUIRE(cs.getComponent<Health>(entities[3]).value == -3);
+    REQUIRE(cs.getComponent<Health>(reused).value == -4);
+
+    SECTION("Writes don't reach the file")
+    {
+        recs::ComponentStorage other;
+        REQUIRE(other.loadFromFile(path));
+        REQUIRE(other.getComponent<Position>(entities[1]).x == 1.f);
+        REQUIRE(other.getComponent<Health>(entities[3]).value == 3);
+    }
+
+    SECTION("Save loaded storage")
+    {
+        std::filesystem::path const resaved_path =
+            tempPath("recs_world_file_test_resaved.bin");
+        REQUIRE(cs.saveToFile(resaved_path));
+
+        recs::ComponentStorage other;
+        REQUIRE(other.loadFromFile(resaved_path));
+        REQUIRE(other.getComponent<Position>(entities[1]).x == -1.f);
+        REQUIRE(other.getComponent<Health>(reused).value == -4);
+
+        std::filesystem::remove(resaved_path);
+    }
+
+    SECTION("Invalid file")
+    {
+        std::filesystem::path const garbage_path =
+            tempPath("recs_world_file_test_garbage.bin");
+        {
+            std::ofstream file{garbage_path, std::ios::binary};
+            file << "definitely not a world";
+        }
+
+        REQUIRE(!cs.loadFromFile(garbage_path));
+        REQUIRE(cs.getEntities(recs::ComponentMask{}).empty());
+        REQUIRE(!cs.loadFromFile(tempPath("recs_world_file_missing.bin")));
+
+        std::filesystem::remove(garbage_path);
+    }
+
+    SECTION("Malformed file")
+    {
+        std::vector<uint8_t> const bytes = readFile(path);
+        FileHeader const header = readAt<FileHeader>(bytes, 0);
+        FileType const type = readAt<FileType>(bytes, header.types_offset);
+        uint64_t const node_offset = header.hierarchy_offset +
+                                     3 * sizeof(FileHierarchyNode) +
+                                     offsetof(FileHierarchyNode, parent);
+        uint64_t const type_count_offset =
+            header.types_offset + offsetof(FileType, count);
+        uint64_t const chunk_offset_offset =
+            type.chunks_offset + offsetof(FileChunk, data_offset);
+        uint64_t const chunk_count_offset =
+            type.chunks_offset + offsetof(FileChunk, count);
+
+        std::filesystem::path const corrupt_path =
+            tempPath("recs_world_file_test_corrupt.bin");
+        auto const loadCorrupted = [&](auto const &corrupt)
+        {
+            std::vector<uint8_t> corrupted = bytes;
+            corrupt(corrupted);
+            writeFile(corrupt_path, corrupted);
+            recs::ComponentStorage other;
+            bool const loaded = other.loadFromFile(corrupt_path);
+            // Nothing is left behind from a failed load
+            if (!loaded)
+                REQUIRE(other.getEntities(recs::ComponentMask{}).empty());
+            return loaded;
+        };
+
+        // The unmodified file loads
+        REQUIRE(loadCorrupted([](std::vector<uint8_t> &) { }));
+
+        // Freelist index out of bounds
+        REQUIRE(!loadCorrupted(
+            [&](std::vector<uint8_t> &b)
+            {
+                writeAt<uint64_t>(
+                    b, header.freelist_offset, header.entity_count + 5);
+            }));
+        // Freelist index of an alive entity
+        REQUIRE(!loadCorrupted(
+            [&](std::vector<uint8_t> &b)
+            { writeAt<uint64_t>(b, header.freelist_offset, 1); }));
+        // Hierarchy link out of bounds
+        REQUIRE(!loadCorrupted(
+            [&](std::vector<uint8_t> &b)
+            { writeAt<uint64_t>(b, node_offset, 1'000'000'000); }));
+        // Grandparent that doesn't have the node as a child
+        REQUIRE(!loadCorrupted(
+            [&](std::vector<uint8_t> &b)
+            { writeAt<uint64_t>(b, node_offset, 1); }));
+        // Component on a removed entity
+        REQUIRE(!loadCorrupted(
+            [&](std::vector<uint8_t> &b)
+            { writeAt<uint64_t>(b, header.masks_offset, 1); }));
+        // Component of a type that isn't in the file
+        REQUIRE(!loadCorrupted(
+            [&](std::vector<uint8_t> &b)
+            {
+                uint64_t const offset = header.masks_offset +
+                                        header.mask_word_count *
+                                            sizeof(uint64_t);
+                writeAt<uint64_t>(b, offset, 1ull << 5);
+            }));
+        // Component in a chunk that isn't stored
+        REQUIRE(!loadCorrupted(
+            [&](std::vector<uint8_t> &b)
+            { writeAt<uint64_t>(b, chunk_offset_offset, 0); }));
+        // Chunk count that doesn't match the masks
+        REQUIRE(!loadCorrupted(
+            [&](std::vector<uint8_t> &b)
+            {
+                writeAt<uint64_t>(
+                    b, chunk_count_offset,
+                    readAt<uint64_t>(b, chunk_count_offset) + 1);
+            }));
+        // Same type listed twice with otherwise consistent masks and counts
+        REQUIRE(!loadCorrupted(
+            [&](std::vector<uint8_t> &b)
+            {
+                writeAt(b, header.types_offset + sizeof(FileType), type);
+                for (uint64_t i = 0; i < header.entity_count; ++i)
+                {
+                    uint64_t const offset = header.masks_offset +
+                                            i * header.mask_word_count *
+                                                sizeof(uint64_t);
+                    uint64_t const word = readAt<uint64_t>(b, offset) & 1;
+                    writeAt<uint64_t>(b, offset, word | (word << 1));
+                }
+            }));
+        // Type count that doesn't match the masks
+        REQUIRE(!loadCorrupted(
+            [&](std::vector<uint8_t> &b)
+            { writeAt<uint64_t>(b, type_count_offset, type.count + 1); }));
+
+        std::filesystem::remove(corrupt_path);
+    }
+
+    SECTION("Unregistered type")
+    {
+        cs.addComponent(entities[1], Unregistered{});
+        REQUIRE(!cs.saveToFile(tempPath("recs_world_file_unregistered.bin")));
+    }
+
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,132 @@
+// Replays an operation trace recorded with TraceRecorder, e.g. from
+// 'simulator --record', against a fresh storage and reports frame time
+// percentiles, the slowest frames and operation counts. Lets storage changes
+// be evaluated against a real workload without its systems.
+
+#include "recs/trace.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+
+size_t const s_worst_frame_count = 5;
+
+struct FrameTime
+{
+    size_t frame{0};
+    double ms{0.};
+};
+
+double percentile(std::vector<FrameTime> const &sorted, double p)
+{
+    size_t const index = static_cast<size_t>(
+        p * static_cast<double>(sorted.size() - 1) + .5);
+    return sorted[index].ms;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2 || std::string_view{argv[1]} == "--help" ||
+        std::string_view{argv[1]} == "-h")
+    {
+        std::printf("Usage: replay TRACE\n");
+        return EXIT_FAILURE;
+    }
+
+    recs::TraceReplayer replayer;
+    if (!replayer.load(argv[1]))
+    {
+        std::fprintf(stderr, "Failed to load '%s'\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    recs::ComponentStorage cs;
+    std::vector<FrameTime> frame_times;
+    while (true)
+    {
+        auto const frame_start = std::chrono::steady_clock::now();
+        recs::TraceReplayer::Result const result = replayer.replayFrame(cs);
+        double const ms = std::chrono::duration<double, std::milli>(
+                              std::chrono::steady_clock::now() - frame_start)
+                              .count();
+
+        if (result == recs::TraceReplayer::Result::End)
+            break;
+        if (result == recs::TraceReplayer::Result::TypeIdsExhausted)
+        {
+            std::fprintf(stderr, "Ran out of component type ids\n");
+            return EXIT_FAILURE;
+        }
+        if (result == recs::TraceReplayer::Result::Error)
+        {
+            std::fprintf(
+                stderr, "Invalid trace at frame %zu\n", frame_times.size());
+            return EXIT_FAILURE;
+        }
+
+        frame_times.push_back(FrameTime{
+            .frame = frame_times.size(),
+            .ms = ms,
+        });
+    }
+
+    if (frame_times.empty())
+    {
+        std::printf("No frames\n");
+        return EXIT_SUCCESS;
+    }
+
+    double total_ms = 0.;
+    for (FrameTime const &time : frame_times)
+        total_ms += time.ms;
+
+    std::vector<FrameTime> sorted = frame_times;
+    std::sort(
+        sorted.begin(), sorted.end(),
+        [](FrameTime const &a, FrameTime const &b) { return a.ms < b.ms; });
+
+    std::printf(
+        "Frames %zu, total %.2f ms, mean %.3f ms\n", frame_times.size(),
+        total_ms, total_ms / static_cast<double>(frame_times.size()));
+    std::printf(
+        "Frame time p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+        percentile(sorted, .5), percentile(sorted, .9),
+        percentile(sorted, .99), sorted.back().ms);
+
+    std::printf("Slowest frames:");
+    size_t const worst_count = std::min(s_worst_frame_count, sorted.size());
+    for (size_t i = 0; i < worst_count; ++i)
+    {
+        FrameTime const &time = sorted[sorted.size() - 1 - i];
+        std::printf(" %zu (%.3f ms)", time.frame, time.ms);
+    }
+    std::printf("\n");
+
+    recs::TraceReplayer::Stats const &stats = replayer.stats();
+    std::printf(
+        "Entities added %llu, removed %llu\n",
+        static_cast<unsigned long long>(stats.entity_adds),
+        static_cast<unsigned long long>(stats.entity_removes));
+    std::printf(
+        "Components added %llu, removed %llu\n",
+        static_cast<unsigned long long>(stats.component_adds),
+        static_cast<unsigned long long>(stats.component_removes));
+    std::printf(
+        "Queries %llu, %.1f entities per query\n",
+        static_cast<unsigned long long>(stats.queries),
+        stats.queries > 0 ? static_cast<double>(stats.query_results) /
+                                static_cast<double>(stats.queries)
+                          : 0.);
+    std::printf(
+        "Compactions %llu\n",
+        static_cast<unsigned long long>(stats.compactions));
+
+    return EXIT_SUCCESS;
+}
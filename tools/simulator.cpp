@@ -0,0 +1,637 @@
+// Headless synthetic game workload for evaluating storage and scheduling
+// changes. Builds a world of movers with spawners, damage-over-time,
+// despawning and proximity sensors, runs it for a number of frames with
+// churn and reports frame time percentiles, allocations and memory use.
+
+#include "recs/profiler.hpp"
+#include "recs/scheduler.hpp"
+#include "recs/thread_pool.hpp"
+#include "recs/trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <optional>
+#include <random>
+#include <string_view>
+#include <type_traits>
+
+namespace
+{
+
+// Allocation tracking through the global operator new/delete. Every
+// allocation is prefixed with its size so that the live byte count can be
+// kept without platform specific size queries.
+
+std::atomic<uint64_t> s_allocation_count{0};
+std::atomic<uint64_t> s_live_bytes{0};
+
+size_t const s_header_size = alignof(std::max_align_t);
+
+void *trackedAlloc(size_t size, size_t alignment)
+{
+    alignment = std::max(alignment, s_header_size);
+    // Room for aligning and for the header in front of the returned pointer
+    size_t const padded_size = size + alignment + s_header_size;
+    uint8_t *const base = static_cast<uint8_t *>(std::malloc(padded_size));
+    if (base == nullptr)
+        return nullptr;
+
+    uintptr_t const aligned =
+        (reinterpret_cast<uintptr_t>(base) + s_header_size + alignment - 1) &
+        ~(alignment - 1);
+    uint8_t *const ptr = reinterpret_cast<uint8_t *>(aligned);
+    std::memcpy(ptr - sizeof(size_t), &size, sizeof(size_t));
+    std::memcpy(ptr - 2 * sizeof(size_t), &base, sizeof(uint8_t *));
+
+    s_allocation_count.fetch_add(1, std::memory_order_relaxed);
+    s_live_bytes.fetch_add(size, std::memory_order_relaxed);
+
+    return ptr;
+}
+
+void trackedFree(void *ptr)
+{
+    if (ptr == nullptr)
+        return;
+
+    uint8_t *const bytes = static_cast<uint8_t *>(ptr);
+    size_t size = 0;
+    uint8_t *base = nullptr;
+    std::memcpy(&size, bytes - sizeof(size_t), sizeof(size_t));
+    std::memcpy(&base, bytes - 2 * sizeof(size_t), sizeof(uint8_t *));
+
+    s_live_bytes.fetch_sub(size, std::memory_order_relaxed);
+    std::free(base);
+}
+
+void *trackedNew(size_t size, size_t alignment)
+{
+    void *const ptr = trackedAlloc(size, alignment);
+    if (ptr == nullptr)
+        throw std::bad_alloc{};
+    return ptr;
+}
+
+} // namespace
+
+void *operator new(size_t size)
+{
+    return trackedNew(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+void *operator new[](size_t size)
+{
+    return trackedNew(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+void *operator new(size_t size, std::align_val_t alignment)
+{
+    return trackedNew(size, static_cast<size_t>(alignment));
+}
+void *operator new[](size_t size, std::align_val_t alignment)
+{
+    return trackedNew(size, static_cast<size_t>(alignment));
+}
+void *operator new(size_t size, std::nothrow_t const &) noexcept
+{
+    return trackedAlloc(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+void *operator new[](size_t size, std::nothrow_t const &) noexcept
+{
+    return trackedAlloc(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+void operator delete(void *ptr) noexcept { trackedFree(ptr); }
+void operator delete[](void *ptr) noexcept { trackedFree(ptr); }
+void operator delete(void *ptr, size_t) noexcept { trackedFree(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { trackedFree(ptr); }
+void operator delete(void *ptr, std::align_val_t) noexcept
+{
+    trackedFree(ptr);
+}
+void operator delete[](void *ptr, std::align_val_t) noexcept
+{
+    trackedFree(ptr);
+}
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept
+{
+    trackedFree(ptr);
+}
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept
+{
+    trackedFree(ptr);
+}
+
+namespace
+{
+
+struct Config
+{
+    uint32_t entities{100'000};
+    uint32_t frames{600};
+    // 0 runs the schedule serially on the calling thread
+    uint32_t threads{0};
+    uint32_t spawners{100};
+    // Spawned by each spawner per second
+    float spawn_rate{10.f};
+    // Fraction of entities taking damage over time
+    float damage_fraction{.25f};
+    uint32_t sensors{16};
+    float sensor_radius{10.f};
+    float world_size{1000.f};
+    uint32_t seed{0};
+    // Chrome trace of the last frames if set
+    char const *trace_path{nullptr};
+    // Operation trace of the whole run for the replay tool if set
+    char const *record_path{nullptr};
+};
+
+float const s_dt = 1.f / 60.f;
+
+struct Position
+{
+    float x{0.f};
+    float y{0.f};
+};
+
+struct Velocity
+{
+    float x{0.f};
+    float y{0.f};
+};
+
+struct Health
+{
+    float value{100.f};
+};
+
+struct DamageOverTime
+{
+    float per_second{0.f};
+};
+
+struct Lifetime
+{
+    float seconds{0.f};
+};
+
+struct Spawner
+{
+    float accumulator{0.f};
+    float rate{0.f};
+    // Spawns the main loop should perform at the next sync point
+    uint32_t pending{0};
+};
+
+struct Sensor
+{
+    float radius{0.f};
+    uint32_t neighbors{0};
+};
+
+// Written once before the frames run
+float s_world_size = 0.f;
+
+using MoveEntity =
+    recs::Access::Read<Velocity>::Write<Position>::As<recs::Entity>;
+void moveSystem(MoveEntity e)
+{
+    Velocity const &velocity = e.getComponent<Velocity>();
+    Position &position = e.getComponent<Position>();
+    position.x += velocity.x * s_dt;
+    position.y += velocity.y * s_dt;
+    // Wrap around to keep the density constant
+    if (position.x < 0.f)
+        position.x += s_world_size;
+    else if (position.x >= s_world_size)
+        position.x -= s_world_size;
+    if (position.y < 0.f)
+        position.y += s_world_size;
+    else if (position.y >= s_world_size)
+        position.y -= s_world_size;
+}
+
+using DamageEntity =
+    recs::Access::Read<DamageOverTime>::Write<Health>::As<recs::Entity>;
+void damageSystem(DamageEntity e)
+{
+    e.getComponent<Health>().value -=
+        e.getComponent<DamageOverTime>().per_second * s_dt;
+}
+
+using LifetimeEntity = recs::Access::Write<Lifetime>::As<recs::Entity>;
+void lifetimeSystem(LifetimeEntity e)
+{
+    e.getComponent<Lifetime>().seconds -= s_dt;
+}
+
+using SpawnerEntity = recs::Access::Write<Spawner>::As<recs::Entity>;
+void spawnerSystem(SpawnerEntity e)
+{
+    Spawner &spawner = e.getComponent<Spawner>();
+    spawner.accumulator += spawner.rate * s_dt;
+    while (spawner.accumulator >= 1.f)
+    {
+        spawner.accumulator -= 1.f;
+        spawner.pending++;
+    }
+}
+
+using SensorEntity =
+    recs::Access::Read<Position>::Write<Sensor>::As<recs::Entity>;
+using PositionEntity = recs::Access::Read<Position>::As<recs::Entity>;
+using PositionQuery = recs::Access::Read<Position>::As<recs::Query>;
+void proximitySystem(SensorEntity e, PositionQuery const &movers)
+{
+    Position const &position = e.getComponent<Position>();
+    Sensor &sensor = e.getComponent<Sensor>();
+    float const radius_sq = sensor.radius * sensor.radius;
+
+    sensor.neighbors = 0;
+    for (PositionEntity const &mover : movers)
+    {
+        Position const &other = mover.getComponent<Position>();
+        float const dx = other.x - position.x;
+        float const dy = other.y - position.y;
+        if (dx * dx + dy * dy <= radius_sq)
+            sensor.neighbors++;
+    }
+}
+
+class World
+{
+  public:
+    // Setup is recorded into recorder if it's not null
+    World(Config const &config, recs::TraceRecorder *recorder)
+    : m_config{config}
+    , m_rng{config.seed}
+    {
+        m_cs.setTraceRecorder(recorder);
+
+        uint64_t const entity_count =
+            uint64_t{config.entities} + config.spawners + config.sensors;
+        m_cs.reserveEntities(entity_count);
+        m_cs.reserveComponents<Position>(entity_count);
+        m_cs.reserveComponents<Velocity>(config.entities);
+        m_cs.reserveComponents<Health>(config.entities);
+
+        for (uint32_t i = 0; i < config.entities; ++i)
+            spawnMover();
+
+        std::uniform_real_distribution<float> position_dist{
+            0.f, config.world_size};
+        for (uint32_t i = 0; i < config.spawners; ++i)
+        {
+            recs::EntityId const e = m_cs.addEntity();
+            m_cs.addComponent(e, Spawner{.rate = config.spawn_rate});
+        }
+        for (uint32_t i = 0; i < config.sensors; ++i)
+        {
+            recs::EntityId const e = m_cs.addEntity();
+            m_cs.addComponent(
+                e, Position{position_dist(m_rng), position_dist(m_rng)});
+            m_cs.addComponent(e, Sensor{.radius = config.sensor_radius});
+        }
+    }
+
+    recs::ComponentStorage &storage() { return m_cs; }
+
+    // Structural changes that the systems requested, done between frames
+    void sync()
+    {
+        recs::ComponentMask spawner_mask;
+        spawner_mask.set(recs::TypeId::get<Spawner>());
+        uint32_t spawn_count = 0;
+        recs::ComponentStorage::Range const spawners =
+            m_cs.getEntities(spawner_mask);
+        for (size_t i = 0; i < spawners.size(); ++i)
+        {
+            Spawner &spawner = spawners.getComponent<Spawner>(i);
+            spawn_count += spawner.pending;
+            spawner.pending = 0;
+        }
+
+        recs::ComponentMask health_mask;
+        health_mask.set(recs::TypeId::get<Health>());
+        recs::ComponentMask lifetime_mask;
+        lifetime_mask.set(recs::TypeId::get<Lifetime>());
+
+        m_despawned.clear();
+        recs::ComponentStorage::Range const damaged =
+            m_cs.getEntities(health_mask);
+        for (size_t i = 0; i < damaged.size(); ++i)
+        {
+            if (m_cs.readComponent<Health>(damaged.getId(i)).value <= 0.f)
+                m_despawned.push_back(damaged.getId(i));
+        }
+        recs::ComponentStorage::Range const mortal =
+            m_cs.getEntities(lifetime_mask);
+        for (size_t i = 0; i < mortal.size(); ++i)
+        {
+            recs::EntityId const e = mortal.getId(i);
+            // Could already be despawned from damage
+            if (m_cs.readComponent<Lifetime>(e).seconds <= 0.f &&
+                !(m_cs.hasComponent<Health>(e) &&
+                  m_cs.readComponent<Health>(e).value <= 0.f))
+                m_despawned.push_back(e);
+        }
+
+        for (recs::EntityId const e : m_despawned)
+            m_cs.removeEntity(e);
+        for (uint32_t i = 0; i < spawn_count; ++i)
+            spawnMover();
+
+        m_spawned_total += spawn_count;
+        m_despawned_total += m_despawned.size();
+    }
+
+    [[nodiscard]] uint64_t spawnedTotal() const { return m_spawned_total; }
+    [[nodiscard]] uint64_t despawnedTotal() const { return m_despawned_total; }
+
+  private:
+    void spawnMover()
+    {
+        std::uniform_real_distribution<float> position_dist{
+            0.f, m_config.world_size};
+        std::uniform_real_distribution<float> velocity_dist{-10.f, 10.f};
+        std::uniform_real_distribution<float> unit_dist{0.f, 1.f};
+        std::uniform_real_distribution<float> lifetime_dist{5.f, 60.f};
+
+        recs::EntityId const e = m_cs.addEntity();
+        m_cs.addComponent(
+            e, Position{position_dist(m_rng), position_dist(m_rng)});
+        m_cs.addComponent(
+            e, Velocity{velocity_dist(m_rng), velocity_dist(m_rng)});
+        m_cs.addComponent(e, Health{});
+        if (unit_dist(m_rng) < m_config.damage_fraction)
+            m_cs.addComponent(
+                e, DamageOverTime{.per_second = 5.f + 20.f * unit_dist(m_rng)});
+        if (unit_dist(m_rng) < .5f)
+            m_cs.addComponent(e, Lifetime{lifetime_dist(m_rng)});
+    }
+
+    Config const &m_config;
+    std::mt19937 m_rng;
+    recs::ComponentStorage m_cs;
+    std::vector<recs::EntityId> m_despawned;
+    uint64_t m_spawned_total{0};
+    uint64_t m_despawned_total{0};
+};
+
+void printUsage()
+{
+    std::printf(
+        "Usage: simulator [options]\n"
+        "  --entities N        Initial movers (100000)\n"
+        "  --frames N          Frames to simulate (600)\n"
+        "  --threads N         Worker threads, 0 runs serially (0)\n"
+        "  --spawners N        Spawner entities (100)\n"
+        "  --spawn-rate F      Spawns per spawner per second (10)\n"
+        "  --damage-fraction F Fraction of movers taking damage (0.25)\n"
+        "  --sensors N         Proximity sensors (16)\n"
+        "  --sensor-radius F   Proximity radius (10)\n"
+        "  --world-size F      World extent (1000)\n"
+        "  --seed N            Random seed (0)\n"
+        "  --trace PATH        Chrome trace of the last 120 frames\n"
+        "  --record PATH       Operation trace of the run for replay\n");
+}
+
+template <typename T> bool parseValue(std::string_view str, T &value)
+{
+    if constexpr (std::is_floating_point_v<T>)
+    {
+        // from_chars for floats isn't universally available yet
+        char *end = nullptr;
+        std::string const copy{str};
+        value = std::strtof(copy.c_str(), &end);
+        return end == copy.c_str() + copy.size() && !copy.empty();
+    }
+    else
+    {
+        auto const [ptr, ec] =
+            std::from_chars(str.data(), str.data() + str.size(), value);
+        return ec == std::errc{} && ptr == str.data() + str.size();
+    }
+}
+
+std::optional<Config> parseArgs(int argc, char *argv[])
+{
+    Config config;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string_view const arg{argv[i]};
+        if (arg == "--help" || arg == "-h" || i + 1 >= argc)
+            return std::nullopt;
+
+        std::string_view const value{argv[++i]};
+        bool valid = false;
+        if (arg == "--entities")
+            valid = parseValue(value, config.entities);
+        else if (arg == "--frames")
+            valid = parseValue(value, config.frames);
+        else if (arg == "--threads")
+            valid = parseValue(value, config.threads);
+        else if (arg == "--spawners")
+            valid = parseValue(value, config.spawners);
+        else if (arg == "--spawn-rate")
+            valid = parseValue(value, config.spawn_rate);
+        else if (arg == "--damage-fraction")
+            valid = parseValue(value, config.damage_fraction);
+        else if (arg == "--sensors")
+            valid = parseValue(value, config.sensors);
+        else if (arg == "--sensor-radius")
+            valid = parseValue(value, config.sensor_radius);
+        else if (arg == "--world-size")
+            valid = parseValue(value, config.world_size);
+        else if (arg == "--seed")
+            valid = parseValue(value, config.seed);
+        else if (arg == "--trace")
+        {
+            config.trace_path = argv[i];
+            valid = true;
+        }
+        else if (arg == "--record")
+        {
+            config.record_path = argv[i];
+            valid = true;
+        }
+
+        if (!valid)
+        {
+            std::fprintf(
+                stderr, "Invalid argument '%s %s'\n", argv[i - 1], argv[i]);
+            return std::nullopt;
+        }
+    }
+
+    if (config.frames == 0 || config.world_size <= 0.f)
+        return std::nullopt;
+
+    return config;
+}
+
+double percentile(std::vector<double> const &sorted, double p)
+{
+    size_t const index = static_cast<size_t>(
+        p * static_cast<double>(sorted.size() - 1) + .5);
+    return sorted[index];
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::optional<Config> const config = parseArgs(argc, argv);
+    if (!config.has_value())
+    {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+    s_world_size = config->world_size;
+
+    recs::Scheduler scheduler;
+    scheduler.registerSystem(moveSystem, "Move");
+    scheduler.registerSystem(damageSystem, "Damage over time");
+    scheduler.registerSystem(lifetimeSystem, "Lifetime");
+    scheduler.registerSystem(spawnerSystem, "Spawner");
+    scheduler.registerSystem(proximitySystem, "Proximity");
+    recs::Schedule schedule = scheduler.buildSchedule();
+
+    std::unique_ptr<recs::ThreadPool> pool;
+    if (config->threads > 0)
+        pool = std::make_unique<recs::ThreadPool>(config->threads);
+
+    recs::Profiler profiler;
+    profiler.setEnabled(config->trace_path != nullptr);
+
+    std::unique_ptr<recs::TraceRecorder> recorder;
+    if (config->record_path != nullptr)
+        recorder = std::make_unique<recs::TraceRecorder>();
+
+    std::vector<double> frame_ms;
+    frame_ms.reserve(config->frames);
+
+    // Everything allocated after this is owned by the world
+    uint64_t const base_bytes = s_live_bytes.load();
+
+    auto const setup_start = std::chrono::steady_clock::now();
+    World world{*config, recorder.get()};
+    double const setup_ms =
+        std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - setup_start)
+            .count();
+    // Setup is the first frame of the recording
+    if (recorder != nullptr)
+        recorder->markFrame();
+
+    uint64_t const frame_allocations_start = s_allocation_count.load();
+    for (uint32_t frame = 0; frame < config->frames; ++frame)
+    {
+        auto const frame_start = std::chrono::steady_clock::now();
+
+        if (pool != nullptr)
+            schedule.execute(world.storage(), *pool, &profiler);
+        else
+            schedule.execute(world.storage(), &profiler);
+        world.sync();
+        if (recorder != nullptr)
+            recorder->markFrame();
+
+        frame_ms.push_back(
+            std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - frame_start)
+                .count());
+    }
+    uint64_t const frame_allocations =
+        s_allocation_count.load() - frame_allocations_start;
+
+    uint64_t recording_bytes = 0;
+    if (recorder != nullptr)
+    {
+        world.storage().setTraceRecorder(nullptr);
+        recording_bytes = recorder->data().capacity();
+    }
+
+    size_t const live_entities =
+        world.storage().getEntities(recs::ComponentMask{}).size();
+    uint64_t const world_bytes =
+        s_live_bytes.load() - base_bytes - recording_bytes;
+
+    std::vector<double> sorted_ms = frame_ms;
+    std::sort(sorted_ms.begin(), sorted_ms.end());
+    double total_ms = 0.;
+    for (double const ms : frame_ms)
+        total_ms += ms;
+
+    std::printf("Setup %.2f ms\n", setup_ms);
+    std::printf(
+        "Frames %u, threads %u, mean %.3f ms\n", config->frames,
+        config->threads, total_ms / static_cast<double>(frame_ms.size()));
+    std::printf(
+        "Frame time p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+        percentile(sorted_ms, .5), percentile(sorted_ms, .9),
+        percentile(sorted_ms, .99), sorted_ms.back());
+    std::printf(
+        "Spawned %llu, despawned %llu, live entities %zu\n",
+        static_cast<unsigned long long>(world.spawnedTotal()),
+        static_cast<unsigned long long>(world.despawnedTotal()),
+        live_entities);
+    std::printf(
+        "Allocations %llu during frames, %.1f per frame\n",
+        static_cast<unsigned long long>(frame_allocations),
+        static_cast<double>(frame_allocations) /
+            static_cast<double>(config->frames));
+    std::printf(
+        "Memory %.2f MiB, %.1f bytes per live entity\n",
+        static_cast<double>(world_bytes) / (1024. * 1024.),
+        live_entities > 0 ? static_cast<double>(world_bytes) /
+                                static_cast<double>(live_entities)
+                          : 0.);
+
+    recs::ComponentStorage::Stats const storage_stats =
+        world.storage().stats();
+    double const mib = 1024. * 1024.;
+    std::printf(
+        "Storage %.2f MiB: components %.2f MiB + %.2f MiB overhead, masks "
+        "%.2f MiB, %llu dead slots\n",
+        static_cast<double>(storage_stats.total_bytes) / mib,
+        static_cast<double>(storage_stats.component_payload_bytes) / mib,
+        static_cast<double>(storage_stats.component_overhead_bytes) / mib,
+        static_cast<double>(storage_stats.mask_table_bytes) / mib,
+        static_cast<unsigned long long>(storage_stats.dead_slot_count));
+
+    if (profiler.enabled())
+    {
+        schedule.updateCosts(profiler);
+        std::printf(
+            "Schedule critical path %.3f ms, predicted %.3f ms on %u "
+            "threads\n",
+            static_cast<double>(schedule.criticalPathNs()) * 1e-6,
+            static_cast<double>(schedule.predictedMakespanNs(
+                std::max(config->threads, 1u))) *
+                1e-6,
+            std::max(config->threads, 1u));
+    }
+
+    if (config->trace_path != nullptr &&
+        !profiler.exportChromeTrace(config->trace_path))
+    {
+        std::fprintf(stderr, "Failed to write '%s'\n", config->trace_path);
+        return EXIT_FAILURE;
+    }
+
+    if (recorder != nullptr)
+    {
+        if (!recorder->save(config->record_path))
+        {
+            std::fprintf(
+                stderr, "Failed to write '%s'\n", config->record_path);
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}